@@ -0,0 +1,356 @@
+#include <array>
+#include <cmath>
+#include <filesystem>
+#include <list>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <boost/property_tree/ptree.hpp>
+#include <gdal_priv.h>
+#include <valhalla/baldr/attributes_controller.h>
+#include <valhalla/baldr/directededge.h>
+#include <valhalla/baldr/graphconstants.h>
+#include <valhalla/baldr/graphid.h>
+#include <valhalla/baldr/graphreader.h>
+#include <valhalla/baldr/nodeinfo.h>
+#include <valhalla/baldr/pathlocation.h>
+#include <valhalla/baldr/predictedspeeds.h>
+#include <valhalla/baldr/tilehierarchy.h>
+#include <valhalla/midgard/logging.h>
+#include <valhalla/midgard/pointll.h>
+#include <valhalla/mjolnir/graphtilebuilder.h>
+
+#include "costing.h"
+#include "export.h"
+#include "rest.h"
+#include "tile_stats.h"
+#include "traffic.h"
+
+namespace {
+namespace baldr = valhalla::baldr;
+namespace midgard = valhalla::midgard;
+namespace mjolnir = valhalla::mjolnir;
+
+// the synthetic graph: a block of level 2 tiles, each with a grid of
+// nodes connected to their 4 neighbours
+constexpr uint32_t kLevel = 2;
+constexpr uint32_t kTilesPerSide = 4;
+constexpr uint32_t kNodesPerSide = 32;
+constexpr uint32_t kShapePoints = 5;
+const midgard::PointLL kOrigin{13.4, 52.5};
+
+/**
+ * A free flow speed profile over the week, with rush hours dipping
+ * differently per edge.
+ */
+std::array<int16_t, baldr::kCoefficientCount> speed_profile(uint32_t seed) {
+  std::array<float, baldr::kBucketsPerWeek> speeds;
+  for (uint32_t b = 0; b < baldr::kBucketsPerWeek; ++b) {
+    auto hour = (b % (baldr::kBucketsPerWeek / 7)) / 12.f;
+    auto rush = std::exp(-std::pow(hour - 8.f, 2.f)) +
+                std::exp(-std::pow(hour - 17.f, 2.f));
+    speeds[b] = 50.f - (10.f + seed % 20) * rush;
+  }
+  return baldr::compress_speed_buckets(speeds.data());
+}
+
+void build_tile(const std::string& tile_dir, const baldr::GraphId& tile_id) {
+  const auto& tiles = baldr::TileHierarchy::levels()[kLevel].tiles;
+  auto base = tiles.Base(tile_id.tileid());
+  auto spacing = tiles.TileSize() / kNodesPerSide;
+  auto node_ll = [&](uint32_t x, uint32_t y) {
+    return midgard::PointLL(base.lng() + (x + 0.5) * spacing,
+                            base.lat() + (y + 0.5) * spacing);
+  };
+
+  mjolnir::GraphTileBuilder builder(tile_dir, tile_id, false);
+  builder.header_builder().set_base_ll(base);
+  auto& nodes = builder.nodes();
+  auto& edges = builder.directededges();
+
+  const std::array<std::pair<int, int>, 4> neighbours{
+      {{1, 0}, {0, 1}, {-1, 0}, {0, -1}}};
+  for (uint32_t y = 0; y < kNodesPerSide; ++y) {
+    for (uint32_t x = 0; x < kNodesPerSide; ++x) {
+      baldr::GraphId start(tile_id.tileid(), kLevel,
+                           y * kNodesPerSide + x);
+      auto start_ll = node_ll(x, y);
+
+      baldr::NodeInfo node;
+      node.set_latlng(base, start_ll);
+      node.set_access(baldr::kAllAccess);
+      node.set_type(baldr::NodeType::kStreetIntersection);
+      node.set_edge_index(edges.size());
+
+      uint32_t count = 0;
+      for (const auto& [dx, dy] : neighbours) {
+        int nx = static_cast<int>(x) + dx;
+        int ny = static_cast<int>(y) + dy;
+        if (nx < 0 || ny < 0 || nx >= static_cast<int>(kNodesPerSide) ||
+            ny >= static_cast<int>(kNodesPerSide))
+          continue;
+
+        baldr::GraphId end(tile_id.tileid(), kLevel,
+                           ny * kNodesPerSide + nx);
+        auto end_ll = node_ll(nx, ny);
+        std::list<midgard::PointLL> shape;
+        for (uint32_t i = 0; i < kShapePoints; ++i) {
+          auto t = static_cast<double>(i) / (kShapePoints - 1);
+          shape.emplace_back(start_ll.lng() +
+                                 t * (end_ll.lng() - start_ll.lng()),
+                             start_ll.lat() +
+                                 t * (end_ll.lat() - start_ll.lat()));
+        }
+
+        baldr::DirectedEdge edge;
+        edge.set_endnode(end);
+        edge.set_length(start_ll.Distance(end_ll));
+        edge.set_classification(
+            static_cast<baldr::RoadClass>(edges.size() % 8));
+        edge.set_use(baldr::Use::kRoad);
+        edge.set_speed(50);
+        edge.set_density(edges.size() % 16);
+        edge.set_forwardaccess(baldr::kAllAccess);
+        edge.set_reverseaccess(baldr::kAllAccess);
+        edge.set_forward(true);
+        edge.set_localedgeidx(count);
+
+        bool added = false;
+        auto offset =
+            builder.AddEdgeInfo(edges.size(), start, end, edges.size(), 0.f,
+                                0, 50, shape, {"Synthetic Street"}, {}, {},
+                                0, added);
+        edge.set_edgeinfo_offset(offset);
+        edges.emplace_back(std::move(edge));
+        count++;
+      }
+      node.set_edge_count(count);
+      nodes.emplace_back(std::move(node));
+    }
+  }
+  builder.StoreTileData();
+
+  // every other edge gets a predicted speed profile
+  mjolnir::GraphTileBuilder speeds(tile_dir, tile_id, false);
+  std::vector<baldr::DirectedEdge> directededges;
+  const baldr::GraphTile& tile = speeds;
+  for (uint32_t i = 0; i < tile.header()->directededgecount(); ++i) {
+    auto edge = *tile.directededge(i);
+    if (i % 2 == 0) {
+      speeds.AddPredictedSpeed(i, speed_profile(i),
+                               tile.header()->directededgecount());
+      edge.set_has_predicted_speed(true);
+      edge.set_free_flow_speed(50);
+      edge.set_constrained_flow_speed(35);
+    }
+    directededges.emplace_back(std::move(edge));
+  }
+  speeds.UpdatePredictedSpeeds(directededges);
+}
+
+struct synthetic_graph_t {
+  std::filesystem::path root;
+  boost::property_tree::ptree config;
+  std::vector<baldr::GraphId> tiles;
+
+  std::string tile_dir() const {
+    return config.get<std::string>("mjolnir.tile_dir");
+  }
+};
+
+std::filesystem::path graph_root() {
+  return std::filesystem::temp_directory_path() /
+         ("valhalla_tools_bench_" + std::to_string(getpid()));
+}
+
+synthetic_graph_t build_graph() {
+  synthetic_graph_t graph;
+  graph.root = graph_root();
+  std::filesystem::create_directories(graph.root / "tiles");
+  graph.config.put("mjolnir.tile_dir", (graph.root / "tiles").string());
+  graph.config.put("mjolnir.concurrency", 1);
+
+  const auto& tiles = baldr::TileHierarchy::levels()[kLevel].tiles;
+  for (uint32_t row = 0; row < kTilesPerSide; ++row) {
+    for (uint32_t col = 0; col < kTilesPerSide; ++col) {
+      midgard::PointLL ll(kOrigin.lng() + col * tiles.TileSize(),
+                          kOrigin.lat() + row * tiles.TileSize());
+      baldr::GraphId tile_id(tiles.TileId(ll), kLevel, 0);
+      build_tile(graph.tile_dir(), tile_id);
+      graph.tiles.push_back(tile_id);
+    }
+  }
+  return graph;
+}
+
+const synthetic_graph_t& graph() {
+  static const synthetic_graph_t g = build_graph();
+  return g;
+}
+
+struct attribute_set_t {
+  const char* name;
+  std::vector<std::string> attributes;
+  bool predicted_speeds;
+};
+
+const std::vector<attribute_set_t> kAttributeSets{
+    {"edge_id", {baldr::kEdgeId}, false},
+    {"edge_basic",
+     {baldr::kEdgeId, baldr::kEdgeRoadClass, baldr::kEdgeDensity,
+      baldr::kEdgeIsUrban, baldr::kEdgeCountryCrossing},
+     false},
+    {"edge_predicted_speeds",
+     {baldr::kEdgeId, valhalla::tools::kEdgePredictedSpeeds},
+     true},
+    {"node_type", {baldr::kNodeType}, false},
+};
+
+void BM_ExportTile(benchmark::State& state) {
+  const auto& g = graph();
+  const auto& set = kAttributeSets[state.range(0)];
+  state.SetLabel(set.name);
+
+  std::vector<unsigned int> indices;
+  if (set.predicted_speeds) {
+    // one day in 5 minute buckets
+    for (unsigned int i = 0; i < baldr::kBucketsPerWeek / 7; ++i)
+      indices.push_back(i);
+  }
+  baldr::PathLocation::SearchFilter search_filter;
+  valhalla::tools::AttributeFilter
+      filter(std::vector<std::string>(set.attributes), {},
+             std::move(indices), search_filter, false);
+
+  baldr::GraphReader reader(g.config.get_child("mjolnir"));
+  auto costing = valhalla::tools::create_costing("none");
+  auto* driver = GetGDALDriverManager()->GetDriverByName("FlatGeobuf");
+  if (!driver) {
+    state.SkipWithError("FlatGeobuf driver not available");
+    return;
+  }
+  char** dataset_options = nullptr;
+  dataset_options =
+      CSLSetNameValue(dataset_options, "SPATIAL_INDEX", "YES");
+  auto output_dir = (g.root / "export").string();
+
+  size_t features = 0;
+  for (auto _ : state) {
+    features += valhalla::tools::export_tile(reader, g.tiles.front(),
+                                             output_dir, "", costing,
+                                             driver, dataset_options,
+                                             filter);
+  }
+  state.counters["features"] =
+      benchmark::Counter(features, benchmark::Counter::kIsRate);
+  CSLDestroy(dataset_options);
+}
+BENCHMARK(BM_ExportTile)
+    ->DenseRange(0, kAttributeSets.size() - 1)
+    ->Unit(benchmark::kMillisecond);
+
+void BM_SerializeEdge(benchmark::State& state) {
+  const auto& g = graph();
+  baldr::GraphReader reader(g.config.get_child("mjolnir"));
+  // even edges have predicted speeds, odd ones don't
+  baldr::GraphId edge_id = g.tiles.front();
+  edge_id.set_id(state.range(0) ? 0 : 1);
+  state.SetLabel(state.range(0) ? "with_predicted_speeds"
+                                : "without_predicted_speeds");
+
+  size_t bytes = 0;
+  for (auto _ : state) {
+    auto json = ::tools::serialize_edge(reader, edge_id);
+    bytes += json.size();
+    benchmark::DoNotOptimize(json);
+  }
+  state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_SerializeEdge)->Arg(0)->Arg(1)->Unit(
+    benchmark::kMicrosecond);
+
+void BM_DecompressSpeedBucketWeek(benchmark::State& state) {
+  auto coefficients = speed_profile(7);
+  for (auto _ : state) {
+    float sum = 0;
+    for (uint32_t b = 0; b < baldr::kBucketsPerWeek; ++b)
+      sum += baldr::decompress_speed_bucket(coefficients.data(), b);
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * baldr::kBucketsPerWeek);
+}
+BENCHMARK(BM_DecompressSpeedBucketWeek);
+
+void BM_RemovePredictedTraffic(benchmark::State& state) {
+  const auto& g = graph();
+  const auto& tile_id = g.tiles.front();
+  auto suffix = baldr::GraphTile::FileSuffix(tile_id);
+  auto pristine = std::filesystem::path(g.tile_dir()) / suffix;
+  auto scratch_dir = g.root / "scratch";
+  auto scratch = scratch_dir / suffix;
+  std::filesystem::create_directories(scratch.parent_path());
+  auto tile_bytes = std::filesystem::file_size(pristine);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::filesystem::copy_file(
+        pristine, scratch,
+        std::filesystem::copy_options::overwrite_existing);
+    state.ResumeTiming();
+
+    valhalla::tools::EnhancedGraphTileBuilder
+        builder(scratch_dir.string(), tile_id, false);
+    builder.RemovePredictedTraffic();
+  }
+  state.SetBytesProcessed(state.iterations() * tile_bytes);
+}
+BENCHMARK(BM_RemovePredictedTraffic)->Unit(benchmark::kMicrosecond);
+
+void BM_TileStats(benchmark::State& state) {
+  auto config = graph().config;
+  valhalla::tools::tile_stats_options_t options;
+  options.sections = state.range(0);
+  state.SetLabel(options.sections ? "sections" : "histograms");
+
+  for (auto _ : state) {
+    valhalla::tools::tile_stats(config, options, "", "json", "");
+  }
+  state.counters["tiles"] =
+      benchmark::Counter(state.iterations() * graph().tiles.size(),
+                         benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_TileStats)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+int main(int argc, char** argv) {
+  // write JSON results unless told otherwise
+  std::vector<char*> args(argv, argv + argc);
+  std::string out = "--benchmark_out=valhalla_tools_bench.json";
+  std::string out_format = "--benchmark_out_format=json";
+  bool has_out = false;
+  for (int i = 1; i < argc; ++i)
+    has_out |= std::string(argv[i]).starts_with("--benchmark_out=");
+  if (!has_out) {
+    args.push_back(out.data());
+    args.push_back(out_format.data());
+  }
+  int count = static_cast<int>(args.size());
+
+  benchmark::Initialize(&count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(count, args.data()))
+    return EXIT_FAILURE;
+
+  // the tools log per tile, which would only measure the logger
+  valhalla::midgard::logging::Configure({{"type", ""}});
+  GDALAllRegister();
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+
+  std::error_code ec;
+  std::filesystem::remove_all(graph_root(), ec);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+namespace valhalla {
+
+namespace tools {
+
+/**
+ * Formats the output of a chunk of complete input lines into a buffer
+ */
+using chunk_processor_t =
+    std::function<void(std::string_view lines, std::string& output)>;
+
+/**
+ * @brief Streams line based input through a pool of threads while keeping
+ * the order of the output. The input is read in large chunks cut at line
+ * ends, every chunk is formatted by a worker into its own buffer, which is
+ * reused for later chunks, and the buffers are written in input order.
+ * Memory is bounded by a few chunks per thread no matter how long the
+ * input is.
+ *
+ * @param in           the input stream
+ * @param out          the output stream
+ * @param concurrency  number of worker threads
+ * @param process      called concurrently, once per chunk
+ * @param chunk_size   approximate number of input bytes per chunk
+ * @throws the first exception thrown by process, after all threads are
+ *         done
+ */
+void process_lines(std::istream& in,
+                   std::ostream& out,
+                   size_t concurrency,
+                   const chunk_processor_t& process,
+                   size_t chunk_size = 4 << 20);
+
+/**
+ * @brief Calls fn for every non empty line of a chunk, without the line
+ * end.
+ */
+template <typename fn_t> void for_each_line(std::string_view lines, fn_t fn) {
+  while (!lines.empty()) {
+    auto end = lines.find('\n');
+    auto line = lines.substr(0, end);
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+    if (!line.empty())
+      fn(line);
+    if (end == std::string_view::npos)
+      break;
+    lines.remove_prefix(end + 1);
+  }
+}
+
+} // namespace tools
+} // namespace valhalla
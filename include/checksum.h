@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace valhalla {
+
+namespace tools {
+
+/**
+ * @brief Fast non-cryptographic 64 bit checksum (XXH64) of a memory
+ * range. Used to tell identical tiles apart without comparing them
+ * byte by byte.
+ *
+ * @param data  pointer to the first byte
+ * @param size  number of bytes
+ * @param seed  optional seed
+ */
+uint64_t checksum(const void* data, size_t size, uint64_t seed = 0);
+
+inline uint64_t checksum(std::string_view data, uint64_t seed = 0) {
+  return checksum(data.data(), data.size(), seed);
+}
+
+} // namespace tools
+} // namespace valhalla
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+#include <valhalla/sif/dynamiccost.h>
+
+namespace valhalla {
+
+namespace tools {
+
+/**
+ * @brief Creates a costing with its default options from the costing's
+ * name, e.g. "auto" or "pedestrian". Unknown names yield the "none"
+ * costing.
+ *
+ * @param costing_str the costing's name
+ */
+sif::cost_ptr_t create_costing(const std::string& costing_str);
+
+} // namespace tools
+} // namespace valhalla
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+
+namespace valhalla {
+
+namespace tools {
+
+enum class pinning_t { kNone, kCpu, kNuma };
+
+struct executor_options_t {
+  size_t concurrency{1};
+  // kCpu pins every worker to one CPU, kNuma to all CPUs of one NUMA node,
+  // round robin over the nodes
+  pinning_t pinning{pinning_t::kNone};
+  // how often progress is logged, 0 to never log it
+  std::chrono::seconds progress_interval{10};
+
+  /**
+   * @brief Reads mjolnir.concurrency, mjolnir.pin_threads (none, cpu or
+   * numa) and mjolnir.progress_interval (seconds).
+   *
+   * @throws std::runtime_error for an unknown pinning
+   */
+  static executor_options_t
+  from_config(const boost::property_tree::ptree& config);
+};
+
+/**
+ * @brief Thrown by executor_t::for_each if the run was interrupted with
+ * SIGINT.
+ */
+class interrupted_error : public std::runtime_error {
+public:
+  interrupted_error() : std::runtime_error("Interrupted") {
+  }
+};
+
+/**
+ * @brief Whether SIGINT was received since the first executor was
+ * created. The first SIGINT lets running tasks finish, the second one
+ * kills the process.
+ */
+bool interrupted();
+
+/**
+ * @brief A fixed pool of worker threads that runs one batch of indexed
+ * tasks at a time.
+ */
+class executor_t {
+public:
+  using task_t = std::function<void(size_t worker, size_t index)>;
+
+  explicit executor_t(const executor_options_t& options);
+  ~executor_t();
+
+  executor_t(const executor_t&) = delete;
+  executor_t& operator=(const executor_t&) = delete;
+
+  /**
+   * Number of worker threads, workers are numbered [0, size())
+   */
+  size_t size() const {
+    return workers_.size();
+  }
+
+  /**
+   * @brief Runs fn(worker, i) for every i in [0, count) and waits for all
+   * of them. Indices are handed out one by one, so uneven work balances
+   * itself. If a task throws, the error is logged with its index and no
+   * further tasks are started. While waiting, the progress is logged with
+   * the rate and an estimate of the remaining time.
+   *
+   * @param count  the number of tasks
+   * @param fn     the task, called with the worker's number and the index
+   * @param label  names the tasks in the progress and error logs, empty
+   *               to not log progress
+   * @throws the first exception thrown by a task, interrupted_error if
+   *         SIGINT was received
+   */
+  void for_each(size_t count, const task_t& fn, const std::string& label = "");
+
+private:
+  struct job_t;
+
+  void run(size_t worker);
+  void log_progress(const job_t& job,
+                    std::chrono::steady_clock::time_point start) const;
+
+  std::vector<std::thread> workers_;
+  std::chrono::seconds progress_interval_;
+
+  std::mutex lock_;
+  std::condition_variable wake_;
+  std::condition_variable finished_;
+  job_t* job_{nullptr};
+  uint64_t generation_{0};
+  size_t finished_workers_{0};
+  bool stop_{false};
+};
+
+/**
+ * @brief Lazily constructed state per worker of an executor, e.g. a
+ * GraphReader or partial results.
+ */
+template <typename T> class per_worker_t {
+public:
+  per_worker_t(const executor_t& executor, std::function<T*()> make)
+      : values_(executor.size()), make_(std::move(make)) {
+  }
+
+  /**
+   * The worker's value, created on first access. Only ever call this
+   * from the worker itself.
+   */
+  T& operator[](size_t worker) {
+    if (!values_[worker])
+      values_[worker].reset(make_());
+    return *values_[worker];
+  }
+
+  /**
+   * Calls fn(value) for the values of all workers that created one.
+   */
+  template <typename fn_t> void for_each(fn_t fn) {
+    for (auto& value : values_) {
+      if (value)
+        fn(*value);
+    }
+  }
+
+private:
+  std::vector<std::unique_ptr<T>> values_;
+  std::function<T*()> make_;
+};
+
+} // namespace tools
+} // namespace valhalla
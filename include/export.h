@@ -0,0 +1,242 @@
+#pragma once
+
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <gdal_priv.h>
+#include <valhalla/baldr/attributes_controller.h>
+#include <valhalla/baldr/directededge.h>
+#include <valhalla/baldr/graphid.h>
+#include <valhalla/baldr/graphreader.h>
+#include <valhalla/baldr/graphtileptr.h>
+#include <valhalla/baldr/pathlocation.h>
+#include <valhalla/sif/dynamiccost.h>
+
+#include "fgb_writer.h"
+#include "simplify.h"
+
+namespace valhalla {
+
+namespace tools {
+
+const std::string kEdgePredictedSpeeds = "edge.predicted_speeds";
+const std::string kEdgeLiveTraffic = "edge.live_traffic";
+
+struct AttributeFilter {
+  AttributeFilter(
+      std::vector<std::string>&& includes_v,
+      std::vector<std::string>&& excludes_v,
+      std::vector<unsigned int>&& predspeedindices,
+      baldr::PathLocation::SearchFilter& searchfilter,
+      bool only_shortcuts) {
+
+    search_filter = searchfilter;
+
+    pred_speed_indices = std::move(predspeedindices);
+    std::unordered_set<std::string> includes;
+    includes.reserve(includes_v.size());
+    for (auto& inc : includes_v) {
+      includes.insert(std::move(inc));
+    }
+    std::unordered_set<std::string> excludes;
+    excludes.reserve(excludes_v.size());
+    for (auto& exc : excludes_v) {
+      excludes.insert(std::move(exc));
+    }
+
+    std::vector<std::pair<bool&, std::string>> edge_pairs = {
+        {localidx, baldr::kEdgeId},
+        {density, baldr::kEdgeDensity},
+        {road_class, baldr::kEdgeRoadClass},
+        {use, baldr::kEdgeUse},
+        {speed, baldr::kEdgeSpeed},
+        {tunnel, baldr::kEdgeTunnel},
+        {bridge, baldr::kEdgeBridge},
+        {traversability, baldr::kEdgeTraversability},
+        {surface, baldr::kEdgeSurface},
+        {urban, baldr::kEdgeIsUrban},
+        {predicted_speeds, kEdgePredictedSpeeds},
+        {country_crossing, baldr::kEdgeCountryCrossing},
+        {live_traffic, kEdgeLiveTraffic},
+    };
+
+    std::vector<std::pair<bool&, std::string>> node_pairs = {
+        {type, baldr::kNodeType},
+    };
+
+    for (auto& p : edge_pairs) {
+      if (includes.find(p.second) != includes.end()) {
+        edges = true;
+        p.first = true;
+      }
+
+      if (excludes.find(p.second) != includes.end()) {
+        edges = true;
+        p.first = false;
+      }
+    }
+
+    for (auto& p : node_pairs) {
+      if (includes.find(p.second) != includes.end()) {
+        nodes = true;
+        p.first = true;
+      }
+
+      if (excludes.find(p.second) != includes.end()) {
+        nodes = true;
+        p.first = false;
+      }
+    }
+
+    shortcuts_only = only_shortcuts;
+  }
+
+  /**
+   * Taken from upstream valhalla (src/loki/search.cc)
+   */
+  bool is_filtered(const baldr::DirectedEdge* de,
+                   baldr::graph_tile_ptr tile,
+                   sif::cost_ptr_t costing) const {
+    // check if this edge matches any of the exclusion filters
+    uint32_t road_class = static_cast<uint32_t>(de->classification());
+    uint32_t min_road_class =
+        static_cast<uint32_t>(search_filter.min_road_class_);
+    uint32_t max_road_class =
+        static_cast<uint32_t>(search_filter.max_road_class_);
+
+    // Note that min_ and max_road_class are integers where, by default,
+    // max_road_class is 0 and min_road_class is 7. This filter rejects
+    // roads where the functional road class is outside of the min to max
+    // range.
+    return (road_class > min_road_class || road_class < max_road_class) ||
+           (search_filter.exclude_tunnel_ && de->tunnel()) ||
+           (search_filter.exclude_bridge_ && de->bridge()) ||
+           (search_filter.exclude_toll_ && de->toll()) ||
+           (search_filter.exclude_ramp_ &&
+            (de->use() == baldr::Use::kRamp)) ||
+           (search_filter.exclude_ferry_ &&
+            (de->use() == baldr::Use::kFerry ||
+             de->use() == baldr::Use::kRailFerry)) ||
+           (search_filter.exclude_closures_ &&
+            (costing->flow_mask() & baldr::kCurrentFlowMask) &&
+            tile->IsClosed(de)) ||
+           (search_filter.level_ != baldr::kMaxLevel &&
+            !tile->edgeinfo(de).includes_level(search_filter.level_));
+  }
+
+  baldr::PathLocation::SearchFilter search_filter;
+
+  // edges
+  bool localidx{false};
+  bool road_class{false};
+  bool use{false};
+  bool speed{false};
+  bool tunnel{false};
+  bool bridge{false};
+  bool traversability{false};
+  bool surface{false};
+  bool density{false};
+  bool urban{false};
+  bool country_crossing{false};
+  bool predicted_speeds{false};
+  std::vector<unsigned int> pred_speed_indices{};
+  // from mjolnir.traffic_extract, see live_speed_columns
+  bool live_traffic{false};
+
+  bool shortcuts_only{false};
+
+  // edge shapes
+  simplify_options_t simplify{};
+
+  // nodes
+  bool type{false};
+
+  // which data sets does the user want
+  bool edges{false};
+  bool nodes{false};
+};
+
+/**
+ * @brief Exports the features of a tile that pass the filter into
+ * FlatGeobuf files in the output directory, laid out like the tile
+ * directory.
+ *
+ * @param reader           the graph reader to fetch the tile with
+ * @param tile_id          the tile to export
+ * @param output_dir       the directory to write the files to
+ * @param file_suffix      suffix applied prior to the file extension
+ * @param costing          the costing to filter allowed/disallowed edges
+ * @param gdal_driver      the FlatGeobuf driver
+ * @param dataset_options  layer creation options
+ * @param filter           which attributes to include/exclude
+ * @return the number of features written
+ */
+size_t export_tile(baldr::GraphReader& reader,
+                   const baldr::GraphId tile_id,
+                   const std::string& output_dir,
+                   const std::string& file_suffix,
+                   sif::cost_ptr_t costing,
+                   GDALDriver* gdal_driver,
+                   char** dataset_options,
+                   const AttributeFilter& filter);
+
+/**
+ * @brief The CREATE TABLE statements for the tables export_tile_pgcopy
+ * writes rows for, with a column per attribute in the filter.
+ */
+std::string pgcopy_schema(const AttributeFilter& filter,
+                          const std::string& edges_table,
+                          const std::string& nodes_table);
+
+/**
+ * @brief Appends the features of a tile that pass the filter as rows in
+ * PostgreSQL's binary COPY format, see pgcopy_schema for the columns.
+ *
+ * @param reader     the graph reader to fetch the tile with
+ * @param tile_id    the tile to export
+ * @param costing    the costing to filter allowed/disallowed edges
+ * @param filter     which attributes to include/exclude
+ * @param edge_rows  where to append the edges, nullptr for none
+ * @param node_rows  where to append the nodes, nullptr for none
+ * @return the number of rows written
+ */
+size_t export_tile_pgcopy(baldr::GraphReader& reader,
+                          const baldr::GraphId tile_id,
+                          sif::cost_ptr_t costing,
+                          const AttributeFilter& filter,
+                          std::string* edge_rows,
+                          std::string* node_rows);
+
+/**
+ * @brief The columns of the edges and nodes layers export_tile_fgb
+ * writes: the GraphId as id, then a column per attribute in the filter,
+ * the same as export_tile's.
+ */
+std::vector<fgb_column_t> fgb_edge_columns(const AttributeFilter& filter);
+std::vector<fgb_column_t> fgb_node_columns(const AttributeFilter& filter);
+
+/**
+ * @brief Adds the features of a tile that pass the filter to the layers
+ * of a merged export, see fgb_edge_columns and fgb_node_columns.
+ *
+ * @param reader   the graph reader to fetch the tile with
+ * @param tile_id  the tile to export
+ * @param costing  the costing to filter allowed/disallowed edges
+ * @param filter   which attributes to include/exclude
+ * @param edges    the edges layer, nullptr for none
+ * @param nodes    the nodes layer, nullptr for none
+ * @param worker   the worker that adds the features
+ * @return the number of features written
+ */
+size_t export_tile_fgb(baldr::GraphReader& reader,
+                       const baldr::GraphId tile_id,
+                       sif::cost_ptr_t costing,
+                       const AttributeFilter& filter,
+                       fgb_writer_t* edges,
+                       fgb_writer_t* nodes,
+                       size_t worker);
+
+} // namespace tools
+} // namespace valhalla
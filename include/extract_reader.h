@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+
+#include <boost/property_tree/ptree.hpp>
+#include <valhalla/baldr/graphreader.h>
+
+namespace valhalla {
+
+namespace tools {
+
+/**
+ * @brief A GraphReader with its own mapping of the tile and traffic
+ * extracts. valhalla's readers share the mapping of the first extract the
+ * process opened, so two plain readers over different extracts in one
+ * process both read the first one.
+ */
+class extract_reader_t : public baldr::GraphReader {
+public:
+  using extract_ptr_t = std::shared_ptr<const tile_extract_t>;
+
+  /**
+   * @brief Maps the extracts of a mjolnir config, to be shared by the
+   * readers of one tile set, e.g. one per thread. Empty if the config has
+   * no extract, the readers use the tile dir then.
+   */
+  static extract_ptr_t
+  map_extract(const boost::property_tree::ptree& mjolnir);
+
+  /**
+   * @param mjolnir  the mjolnir config, its extracts are mapped just for
+   *                 this reader
+   */
+  explicit extract_reader_t(const boost::property_tree::ptree& mjolnir);
+
+  /**
+   * @param mjolnir  the mjolnir config
+   * @param extract  its extracts, from map_extract
+   */
+  extract_reader_t(const boost::property_tree::ptree& mjolnir,
+                   extract_ptr_t extract);
+};
+
+} // namespace tools
+} // namespace valhalla
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <valhalla/midgard/pointll.h>
+
+namespace valhalla {
+
+namespace tools {
+
+// the values of FlatGeobuf's ColumnType and GeometryType
+enum class fgb_column_type_t : uint8_t {
+  kInt = 5,
+  kLong = 7,
+  kDouble = 10,
+  kString = 11
+};
+enum class fgb_geometry_type_t : uint8_t { kPoint = 1, kLineString = 2 };
+
+struct fgb_column_t {
+  std::string name;
+  fgb_column_type_t type;
+};
+
+/**
+ * @brief The properties of one feature in FlatGeobuf's encoding, every
+ * value is prefixed by the index of its column.
+ */
+class fgb_properties_t {
+public:
+  void add_int(uint16_t column, int32_t value);
+  void add_long(uint16_t column, int64_t value);
+  void add_double(uint16_t column, double value);
+  void add_string(uint16_t column, std::string_view value);
+
+  void clear() {
+    bytes_.clear();
+  }
+
+  const std::string& bytes() const {
+    return bytes_;
+  }
+
+private:
+  std::string bytes_;
+};
+
+/**
+ * @brief Writes one FlatGeobuf layer of any size with a bounded amount of
+ * memory, without GDAL.
+ *
+ * Workers add features concurrently, each to its own buffer. Every
+ * feature is encoded right away and keyed by the Hilbert value of its
+ * bounding box center. A full buffer is sorted by key and spilled to a
+ * run file next to the output. finish() merges all runs and writes the
+ * header, the packed Hilbert R-tree and the features straight into the
+ * output, so memory never depends on the number of features. Too many
+ * runs to open at once are merged into fewer runs first.
+ */
+class fgb_writer_t {
+public:
+  /**
+   * @param path           the .fgb file to write
+   * @param layer          the layer's name
+   * @param geometry_type  the type of all geometries in the layer
+   * @param columns        the attribute columns
+   * @param workers        the number of workers that add features
+   * @param memory_budget  bytes of features to keep in memory across all
+   *                       workers before spilling
+   */
+  fgb_writer_t(const std::string& path,
+               const std::string& layer,
+               fgb_geometry_type_t geometry_type,
+               std::vector<fgb_column_t> columns,
+               size_t workers,
+               size_t memory_budget);
+  ~fgb_writer_t();
+
+  fgb_writer_t(const fgb_writer_t&) = delete;
+  fgb_writer_t& operator=(const fgb_writer_t&) = delete;
+
+  /**
+   * @brief Adds a feature. Only ever call this with the worker's own
+   * number, different workers may add concurrently.
+   *
+   * @throws std::runtime_error if a run can't be written
+   */
+  void add(size_t worker,
+           const std::vector<midgard::PointLL>& points,
+           const fgb_properties_t& properties);
+
+  /**
+   * @brief Merges the runs and writes the file, the run files are
+   * removed.
+   *
+   * @returns the number of features written
+   * @throws std::runtime_error on read/write errors
+   */
+  uint64_t finish();
+
+private:
+  struct impl_t;
+  std::unique_ptr<impl_t> impl_;
+};
+
+} // namespace tools
+} // namespace valhalla
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <valhalla/baldr/traffictile.h>
+
+#include "executor.h"
+#include "tile_extract.h"
+
+namespace valhalla {
+
+namespace tools {
+
+/**
+ * @brief The live traffic of a directed edge, decoded from its 64 bit
+ * word in the traffic extract. Speeds are in kph, congestion and
+ * breakpoints are fractions. Unknown values are negative, everything is
+ * unknown unless valid.
+ */
+struct live_speed_t {
+  bool valid{false};
+  int overall_speed{-1};
+  int speeds[3]{-1, -1, -1};
+  double congestion[3]{-1, -1, -1};
+  double breakpoints[2]{-1, -1};
+};
+
+live_speed_t decode_live_speed(const volatile baldr::TrafficSpeed& speed);
+live_speed_t decode_live_speed(uint64_t word);
+
+/**
+ * @brief The names of the live traffic columns, in the order of
+ * append_live_speed_csv and the export backends: the overall speed, the
+ * three subsegment speeds, their congestion and the two breakpoints.
+ */
+const std::vector<std::string>& live_speed_columns();
+
+// the first columns, the speeds, are whole kph
+constexpr size_t kLiveSpeedIntColumns = 4;
+
+/**
+ * @brief The value of column i of live_speed_columns, negative if unknown.
+ */
+double live_speed_value(const live_speed_t& speed, size_t column);
+
+/**
+ * @brief Appends the columns of a live speed to a CSV row, each with a
+ * leading comma. Unknown values are empty.
+ */
+void append_live_speed_csv(std::string& row, const live_speed_t& speed);
+
+/**
+ * @brief Finds the directed edges whose live traffic changed, straight
+ * from the words of a memory mapped traffic extract without reading any
+ * graph tiles. It keeps a copy of the words it saw last, 8 bytes per
+ * directed edge in the extract.
+ */
+class traffic_delta_t {
+public:
+  /**
+   * @param path  the traffic extract, mjolnir.traffic_extract
+   * @throws std::runtime_error if it can't be mapped or has no index
+   */
+  explicit traffic_delta_t(std::string path);
+  ~traffic_delta_t();
+
+  traffic_delta_t(const traffic_delta_t&) = delete;
+  traffic_delta_t& operator=(const traffic_delta_t&) = delete;
+
+  /**
+   * @brief Appends a CSV row (id, then live_speed_columns) for every edge
+   * whose word changed since the last poll. The first poll, and the first
+   * one after the extract was replaced by another file, has every edge
+   * with a non-zero word.
+   *
+   * @returns the number of rows
+   * @throws std::runtime_error if a replaced extract can't be mapped
+   */
+  size_t poll(executor_t& executor, std::string& rows);
+
+private:
+  void map();
+  void unmap();
+
+  std::string path_;
+  uint64_t inode_{0};
+  uint64_t size_{0};
+  const char* data_{nullptr};
+  std::vector<tile_index_entry_t> tiles_;
+  // where the words of every tile start in previous_
+  std::vector<uint64_t> starts_;
+  std::vector<uint64_t> previous_;
+};
+
+} // namespace tools
+} // namespace valhalla
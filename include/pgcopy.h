@@ -0,0 +1,109 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <valhalla/midgard/pointll.h>
+
+namespace valhalla {
+
+namespace tools {
+
+/**
+ * @brief Appends rows in PostgreSQL's binary COPY format to a buffer.
+ * Geometries are EWKB with SRID 4326, so they go into PostGIS geometry
+ * columns as they are.
+ */
+class pgcopy_encoder_t {
+public:
+  explicit pgcopy_encoder_t(std::string& out) : out_(out) {
+  }
+
+  void begin_row(uint16_t fields);
+
+  void add_null();
+  void add_bool(bool value);
+  void add_int16(int16_t value);
+  void add_int32(int32_t value);
+  void add_int64(int64_t value);
+  void add_float8(double value);
+  void add_text(std::string_view value);
+  void add_point(const midgard::PointLL& point);
+  void add_linestring(const std::vector<midgard::PointLL>& points);
+
+private:
+  std::string& out_;
+};
+
+/**
+ * @brief A binary COPY stream to a file, named pipe or stdout that many
+ * workers write to. Every worker hands in the rows of one numbered chunk
+ * (e.g. the index of its tile) and the chunks are written in order, so
+ * the output doesn't depend on scheduling. Workers that are too far
+ * ahead wait until the chunks before theirs are written.
+ */
+class pgcopy_sink_t {
+public:
+  /**
+   * @param path       the file or named pipe to write to, - for stdout
+   * @param max_queued bytes of out of order chunks to keep before
+   *                   workers have to wait
+   * @throws std::runtime_error if path can't be opened
+   */
+  explicit pgcopy_sink_t(const std::string& path,
+                         size_t max_queued = 256 << 20);
+  ~pgcopy_sink_t();
+
+  pgcopy_sink_t(const pgcopy_sink_t&) = delete;
+  pgcopy_sink_t& operator=(const pgcopy_sink_t&) = delete;
+
+  /**
+   * @brief Writes chunk number sequence once all chunks before it are
+   * written. Every number from 0 has to be handed in exactly once, empty
+   * chunks included.
+   *
+   * @throws std::runtime_error on write errors or if the sink was aborted
+   */
+  void write(size_t sequence, std::string&& rows);
+
+  /**
+   * @brief Wakes up and fails all waiting writers, for when a chunk will
+   * never be handed in because its worker failed.
+   */
+  void abort();
+
+  /**
+   * @brief Writes the end of the stream and closes it.
+   *
+   * @throws std::runtime_error if chunks are missing or on write errors
+   */
+  void finish();
+
+  uint64_t bytes() const {
+    return bytes_;
+  }
+
+private:
+  void write_all(const std::string& data);
+
+  std::string path_;
+  int fd_{-1};
+  size_t max_queued_;
+
+  std::mutex lock_;
+  std::condition_variable written_;
+  std::map<size_t, std::string> queued_;
+  size_t queued_bytes_{0};
+  size_t next_{0};
+  bool writing_{false};
+  bool aborted_{false};
+  uint64_t bytes_{0};
+};
+
+} // namespace tools
+} // namespace valhalla
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+#include <valhalla/baldr/graphid.h>
+
+namespace valhalla {
+
+namespace tools {
+
+/**
+ * @brief Loads the tiles a scan is about to process into the page cache
+ * while the workers are busy with the current ones, so GetGraphTile and
+ * friends find them there instead of blocking on storage.
+ *
+ * The tiles are read from the tile extract if mjolnir.tile_extract has a
+ * valid index, from mjolnir.tile_dir otherwise. With io_uring the reads
+ * are submitted asynchronously, without it (or if the kernel refuses a
+ * ring, or for a tile bigger than the ring's 256 MiB of reads)
+ * posix_fadvise(WILLNEED) starts the kernel's readahead instead.
+ * At most mjolnir.prefetch_depth tiles per worker (mjolnir.concurrency)
+ * are loading ahead of the furthest tile being processed, 0 turns
+ * prefetching off.
+ */
+class tile_prefetcher_t {
+public:
+  /**
+   * @param config  the valhalla config
+   * @param tiles   the tiles in the order they are going to be processed
+   */
+  tile_prefetcher_t(const boost::property_tree::ptree& config,
+                    const std::vector<baldr::GraphId>& tiles);
+  ~tile_prefetcher_t();
+
+  tile_prefetcher_t(const tile_prefetcher_t&) = delete;
+  tile_prefetcher_t& operator=(const tile_prefetcher_t&) = delete;
+
+  /**
+   * @brief To be called by a worker before it loads tiles[index]. Counts
+   * whether the tile was already loaded and moves the window ahead.
+   * Thread safe.
+   */
+  void advance(size_t index);
+
+  /**
+   * @brief Logs how many of the processed tiles were loaded in time.
+   */
+  void log_stats() const;
+
+private:
+  struct impl_t;
+  std::unique_ptr<impl_t> impl_;
+};
+
+} // namespace tools
+} // namespace valhalla
@@ -1,6 +1,11 @@
 #pragma once
 #include <absl/strings/str_format.h>
 #include <boost/property_tree/ptree.hpp>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <prime_server/http_protocol.hpp>
 #include <prime_server/http_util.hpp>
 #include <prime_server/prime_server.hpp>
@@ -8,13 +13,107 @@
 #include <valhalla/sif/dynamiccost.h>
 #include <valhalla/valhalla.h>
 
+#include "way_index.h"
+
 namespace tools {
 static prime_server::headers_t::value_type
     CORS{"Access-Control-Allow-Origin", "*"};
 
+/**
+ * @brief ETags of edges, made of the tile's dataset id, a checksum of the
+ * tile and the edge's live traffic word, so they change whenever the
+ * serialized edge would. The tile checksums are cached, tiles only change
+ * with the graph, which gets its own edge_etag_t.
+ */
+class edge_etag_t {
+public:
+  /**
+   * @throws std::runtime_error if the edge doesn't exist
+   */
+  std::string operator()(valhalla::baldr::GraphReader& reader,
+                         const valhalla::baldr::GraphId id);
+
+private:
+  std::unordered_map<uint64_t, uint64_t> tile_checksums_;
+};
+
+/**
+ * @brief Everything requests read from one version of the graph.
+ */
+struct graph_t {
+  graph_t(const boost::property_tree::ptree& pt, uint64_t generation);
+
+  // has its own mapping of the tile and traffic extracts
+  std::unique_ptr<valhalla::baldr::GraphReader> reader;
+  // only set if mjolnir.way_index points to a valid index
+  std::unique_ptr<valhalla::tools::way_index_t> way_index;
+  edge_etag_t edge_etag;
+  uint64_t generation;
+};
+
+/**
+ * @brief The graph requests are answered from, which can be reloaded
+ * without downtime. A request holds on to the graph it started with, a
+ * reload opens the new one next to it and swaps it in, and the old graph
+ * with its extract mappings goes away with the last request using it.
+ */
+class graph_handle_t {
+public:
+  /**
+   * @param pt           the config of the first graph
+   * @param config_path  the config file to read again on every reload,
+   *                     empty to reopen the same config
+   * @throws std::runtime_error if the first graph has no tiles
+   */
+  graph_handle_t(const boost::property_tree::ptree& pt,
+                 std::string config_path);
+  ~graph_handle_t();
+
+  graph_handle_t(const graph_handle_t&) = delete;
+  graph_handle_t& operator=(const graph_handle_t&) = delete;
+
+  std::shared_ptr<graph_t> get() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    return graph_;
+  }
+
+  /**
+   * @brief Has the reload thread open the graph again and returns right
+   * away. Requests that come in while a reload runs make it run once
+   * more afterwards. If the new graph can't be opened or has no tiles,
+   * the old one stays and its generation is skipped.
+   *
+   * @return the generation of the graph once this reload is done
+   */
+  uint64_t reload();
+
+  /**
+   * @brief Reloads on every SIGHUP from a thread of the handle's own
+   * until it's destroyed. SIGHUP has to be blocked in all threads.
+   */
+  void reload_on_hangup();
+
+private:
+  void run();
+
+  boost::property_tree::ptree pt_;
+  std::string config_path_;
+  mutable std::mutex lock_;
+  std::shared_ptr<graph_t> graph_;
+
+  std::condition_variable wake_;
+  bool pending_{false};
+  bool stop_{false};
+  // the generation of the last requested reload
+  uint64_t requested_{0};
+  std::thread thread_;
+  std::thread hangup_thread_;
+};
+
 class rest_worker_t {
 public:
-  rest_worker_t(const boost::property_tree::ptree& pt);
+  rest_worker_t(const boost::property_tree::ptree& pt,
+                graph_handle_t& graph);
 
   ~rest_worker_t();
 
@@ -33,9 +132,10 @@ protected:
 
   inline prime_server::worker_t::result_t
   to_response(const std::string& data,
-              prime_server::http_request_info_t& request_info) const {
+              prime_server::http_request_info_t& request_info,
+              prime_server::headers_t headers = {}) const {
 
-    prime_server::headers_t headers{CORS};
+    headers.insert(CORS);
     auto status_code = 204U;
     if (!data.empty()) {
       headers.emplace(prime_server::http::JSON_MIME);
@@ -49,9 +149,21 @@ protected:
     result.messages.emplace_back(response.to_string());
     return result;
   }
-  valhalla::baldr::GraphReader reader;
+  graph_handle_t& graph;
+  // Cache-Control of /edge responses, from httpd.service.edge_max_age
+  std::string edge_cache_control;
+  // whether POST /admin/reload is served, httpd.service.admin_reload
+  bool admin_reload;
 };
 
-void run_service(const boost::property_tree::ptree& pt);
+void run_service(const boost::property_tree::ptree& pt,
+                 graph_handle_t& graph);
+
+/**
+ * Serializes a directed edge with its edge info, live and predicted speeds
+ * to JSON.
+ */
+std::string serialize_edge(valhalla::baldr::GraphReader& reader,
+                           const valhalla::baldr::GraphId id);
 
 } // namespace tools
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+#include <valhalla/baldr/graphid.h>
+
+namespace valhalla {
+
+namespace tools {
+
+/**
+ * @brief One of n shards of a tile set, so a scan can be spread over
+ * machines that share the tiles. Tiles are sorted by id and cut into n
+ * contiguous ranges of about the same number of tile bytes, which every
+ * machine computes the same way from the same tiles.
+ */
+class shard_t {
+public:
+  shard_t() = default;
+
+  /**
+   * @throws std::runtime_error unless index < count
+   */
+  shard_t(uint32_t index, uint32_t count, std::string marker_dir = ".");
+
+  /**
+   * @brief Reads mjolnir.shard ("i/n", 0 based, defaults to the whole
+   * tile set) and mjolnir.shard_marker_dir (defaults to the working
+   * directory).
+   *
+   * @throws std::runtime_error if the shard can't be parsed
+   */
+  static shard_t from_config(const boost::property_tree::ptree& config);
+
+  bool enabled() const {
+    return count_ > 1;
+  }
+
+  /**
+   * @brief Keeps only the tiles of this shard, sorted by id. The tile
+   * sizes come from the index of mjolnir.tile_extract if it has one, from
+   * the files in mjolnir.tile_dir otherwise. Does nothing if not sharded.
+   */
+  void select(const boost::property_tree::ptree& config,
+              std::vector<baldr::GraphId>& tiles);
+
+  /**
+   * @brief Writes <marker_dir>/shard-<i>-of-<n>.done, a small JSON with
+   * the shard's tile count and bytes, once the shard is complete. The
+   * marker is renamed into place, so it's either there in full or not at
+   * all. Does nothing if not sharded.
+   */
+  void mark_done() const;
+
+  uint32_t index() const {
+    return index_;
+  }
+
+  uint32_t count() const {
+    return count_;
+  }
+
+  std::string str() const {
+    return std::to_string(index_) + "/" + std::to_string(count_);
+  }
+
+private:
+  uint32_t index_{0};
+  uint32_t count_{1};
+  std::string marker_dir_{"."};
+  uint64_t tiles_{0};
+  uint64_t bytes_{0};
+};
+
+} // namespace tools
+} // namespace valhalla
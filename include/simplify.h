@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <valhalla/midgard/pointll.h>
+
+namespace valhalla {
+
+namespace tools {
+
+enum class simplify_method_t : uint8_t { kDouglasPeucker, kVisvalingam };
+
+struct simplify_options_t {
+  // in meters, 0 turns simplification off
+  double tolerance{0};
+  // if set, the tolerance is the size of a pixel at this zoom instead
+  int zoom{-1};
+  simplify_method_t method{simplify_method_t::kDouglasPeucker};
+  // leave out edges that are shorter than the tolerance
+  bool drop_short_edges{false};
+
+  bool enabled() const {
+    return tolerance > 0 || zoom >= 0;
+  }
+
+  /**
+   * The tolerance in meters at a latitude, for a zoom that's the ground
+   * size of a 256 px web mercator tile's pixel there
+   */
+  double tolerance_at(double lat) const;
+};
+
+/**
+ * @brief Parses a --simplify value, a tolerance in meters ("5") or a
+ * target zoom ("z10"), and a method name, douglas-peucker or visvalingam.
+ *
+ * @throws std::runtime_error if either can't be parsed
+ */
+simplify_options_t parse_simplify_options(const std::string& value,
+                                          const std::string& method);
+
+/**
+ * @brief Simplifies a shape in place, the first and last point are always
+ * kept. Douglas-Peucker keeps every point that's further than the
+ * tolerance from the simplified line, Visvalingam drops points whose
+ * triangle with their neighbours is smaller than tolerance². Both
+ * work on a local equirectangular projection in meters.
+ *
+ * @param shape      the points to simplify
+ * @param tolerance  in meters
+ * @param method     the algorithm to use
+ */
+void simplify(std::vector<midgard::PointLL>& shape,
+              double tolerance,
+              simplify_method_t method);
+
+} // namespace tools
+} // namespace valhalla
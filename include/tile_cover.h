@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <valhalla/baldr/graphid.h>
+#include <valhalla/midgard/aabb2.h>
+#include <valhalla/midgard/pointll.h>
+
+namespace valhalla {
+
+namespace tools {
+
+using ring_t = std::vector<midgard::PointLL>;
+// outer ring followed by its holes
+using polygon_t = std::vector<ring_t>;
+using multipolygon_t = std::vector<polygon_t>;
+using linestring_t = std::vector<midgard::PointLL>;
+
+/**
+ * A named area for batch covers
+ */
+struct region_t {
+  std::string name;
+  multipolygon_t polygons;
+};
+
+/**
+ * @brief A set of tiles stored as one bit per tile of every hierarchy
+ * level, indexed by tile id. Merging and counting are word wise, which
+ * keeps unions of many covers cheap.
+ */
+class tile_cover_t {
+public:
+  tile_cover_t();
+
+  void set(uint32_t level, uint32_t tile_id);
+
+  /**
+   * Sets the tiles [first, last] of a level, both inclusive.
+   */
+  void set_range(uint32_t level, uint32_t first, uint32_t last);
+
+  bool test(uint32_t level, uint32_t tile_id) const;
+
+  tile_cover_t& operator|=(const tile_cover_t& other);
+  tile_cover_t& operator&=(const tile_cover_t& other);
+
+  /**
+   * Number of tiles in the set
+   */
+  size_t count() const;
+
+  /**
+   * Number of tiles that are in this and the other set
+   */
+  size_t count_shared(const tile_cover_t& other) const;
+
+  /**
+   * The tiles as GraphIds, sorted by level and tile id
+   */
+  std::vector<baldr::GraphId> graph_ids() const;
+
+private:
+  std::vector<std::vector<uint64_t>> bits_;
+};
+
+/**
+ * @brief Parses Polygons and MultiPolygons from GeoJSON. Accepts bare
+ * geometries, Features, FeatureCollections and GeometryCollections, other
+ * geometry types are ignored.
+ *
+ * @param json  the GeoJSON string
+ * @throws std::runtime_error if the JSON can't be parsed
+ */
+multipolygon_t parse_geojson_polygons(const std::string& json);
+
+/**
+ * @brief Parses named regions, either from a GeoJSON FeatureCollection
+ * (one region per Feature, named by its "name" property) or from CSV rows
+ * of name,minx,miny,maxx,maxy. Empty rows and rows starting with # are
+ * skipped.
+ *
+ * @param input  the GeoJSON or CSV string
+ * @throws std::runtime_error if the input can't be parsed
+ */
+std::vector<region_t> parse_regions(const std::string& input);
+
+/**
+ * @brief Parses lines from an encoded polyline, GeoJSON (LineStrings and
+ * MultiLineStrings, bare or as Features) or CSV with one lon,lat point
+ * per row. The format is guessed from the input, input starting with {
+ * is only GeoJSON if it parses as a JSON object. CSV rows that don't
+ * start with two numbers (e.g. a header) are skipped.
+ *
+ * @param input      the input string
+ * @param precision  precision of an encoded polyline, 1e-6 or 1e-5
+ * @throws std::runtime_error if the input can't be parsed
+ */
+std::vector<linestring_t> parse_linestrings(const std::string& input,
+                                            double precision = 1e-6);
+
+/**
+ * @brief Adds all tiles of the given levels within some meters of the
+ * line. Every segment walks the grid cell by cell, the part of the
+ * segment inside a cell is buffered as a rectangle, so the work is
+ * linear in the number of points and tiles.
+ *
+ * @param line    the line to cover
+ * @param buffer  buffer around the line in meters
+ * @param levels  the hierarchy levels to cover
+ * @param cover   the tile set to add the tiles to
+ */
+void cover_linestring(const linestring_t& line,
+                      double buffer,
+                      const std::vector<uint32_t>& levels,
+                      tile_cover_t& cover);
+
+/**
+ * @brief Adds all tiles of the given levels that intersect the polygons,
+ * optionally buffered by some meters. The grid of every level is
+ * rasterized row by row: tiles touched by the boundary are found by
+ * clipping every segment to the row, tiles in the interior by filling the
+ * spans between the boundary crossings of the row's center line. The
+ * buffer is applied as a rectangle around the boundary, so tiles might be
+ * included that are slightly farther away than the buffer distance.
+ *
+ * @param polygons  the polygons to cover
+ * @param buffer    buffer around the polygons in meters
+ * @param levels    the hierarchy levels to cover
+ * @param cover     the tile set to add the tiles to
+ */
+void cover_polygons(const multipolygon_t& polygons,
+                    double buffer,
+                    const std::vector<uint32_t>& levels,
+                    tile_cover_t& cover);
+
+/**
+ * @brief Turns a bounding box into a polygon
+ */
+polygon_t to_polygon(const midgard::AABB2<midgard::PointLL>& bbox);
+
+} // namespace tools
+} // namespace valhalla
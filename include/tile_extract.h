@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace valhalla {
+
+namespace tools {
+
+constexpr uint64_t kTarBlockSize = 512;
+
+/**
+ * @brief One entry of the index.bin at the start of a tile extract, laid
+ * out like on disk (little endian <QLL): the offset of the tile's bytes in
+ * the tar, the tile id (level | tile id << 3) and the tile's size.
+ */
+struct tile_index_entry_t {
+  uint64_t offset;
+  uint32_t tile_id;
+  uint32_t size;
+};
+static_assert(sizeof(tile_index_entry_t) == 16);
+
+/**
+ * @brief Reads the index of a tile extract (or traffic extract) built by
+ * valhalla_build_extract. Only the index is read, not the tiles.
+ *
+ * @param path  path to the tar
+ * @throws std::runtime_error if the file can't be read or doesn't start
+ *         with an index
+ */
+std::vector<tile_index_entry_t> read_tile_index(const std::string& path);
+
+/**
+ * @brief The relative path of a tile in a tile directory and in the tar,
+ * e.g. 2/000/818/660.gph
+ */
+std::string tile_file_path(uint32_t tile_id);
+
+/**
+ * @brief The tile id of a path relative to a tile dir, e.g.
+ * 2/000/818/660.gph, false if it doesn't look like a tile.
+ */
+bool tile_id_from_path(const std::string& relative, uint32_t& tile_id);
+
+/**
+ * @brief Parses a tile id as printed by valhalla_get_tile_ids
+ * (level/tile_id/0) into the id used by the extract index.
+ *
+ * @throws std::runtime_error if it's not a valid tile id
+ */
+uint32_t parse_tile_id(const std::string& s);
+
+/**
+ * @brief Lays out a new tile extract: the index comes first, followed by
+ * one tar member per tile, in the order given. Sets the offset of every
+ * entry to where its bytes go and returns the size of the whole tar.
+ *
+ * @param entries  tile ids and sizes, offsets are set here
+ */
+uint64_t layout_extract(std::vector<tile_index_entry_t>& entries);
+
+/**
+ * @brief Writes everything of a laid out extract except for the tile
+ * bytes: the index, the tar header of every tile and the end of archive.
+ * The file is sized (sparse) to its final size first, so tiles can be
+ * written concurrently at their offsets afterwards.
+ *
+ * @param fd          the output file, opened for writing
+ * @param entries     the laid out entries
+ * @param total_size  the size returned by layout_extract
+ * @throws std::runtime_error on write errors
+ */
+void write_extract_skeleton(int fd,
+                            const std::vector<tile_index_entry_t>& entries,
+                            uint64_t total_size);
+
+/**
+ * @brief pwrite that retries until everything is written
+ *
+ * @throws std::runtime_error on write errors
+ */
+void write_at(int fd, const void* data, size_t size, uint64_t offset);
+
+/**
+ * @brief pread that retries until everything is read
+ *
+ * @throws std::runtime_error on read errors or early end of file
+ */
+void read_at(int fd, void* data, size_t size, uint64_t offset);
+
+/**
+ * @brief Copies bytes between two files at the given offsets without
+ * changing their file positions. Uses copy_file_range, so the bytes stay
+ * in the kernel (or are reflinked), and falls back to pread/pwrite where
+ * that's not supported, e.g. across file systems on older kernels.
+ *
+ * @throws std::runtime_error on read/write errors or early end of file
+ */
+void copy_range(int in_fd,
+                uint64_t in_offset,
+                int out_fd,
+                uint64_t out_offset,
+                uint64_t size);
+
+} // namespace tools
+} // namespace valhalla
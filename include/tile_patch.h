@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "executor.h"
+#include "tile_extract.h"
+
+namespace valhalla {
+
+namespace tools {
+
+enum class patch_op_t : uint8_t { kAdd = 0, kChange = 1, kDelete = 2 };
+
+/**
+ * @brief Header of a tile patch. The compressed tiles follow it, then the
+ * table of entries, sorted by tile id, at table_offset. The set checksums
+ * cover the sorted (tile id, size) pairs of the old and new tile set, so
+ * a patch is only ever applied to the extract it was made for.
+ */
+struct patch_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t entry_count;
+  uint64_t table_offset;
+  uint64_t old_set_checksum;
+  uint64_t new_set_checksum;
+};
+static_assert(sizeof(patch_header_t) == 48);
+
+/**
+ * @brief One added, changed or deleted tile. Changed tiles are stored as
+ * a zstd frame compressed with the old tile as prefix, added tiles as a
+ * plain zstd frame, deleted tiles have no data.
+ */
+struct patch_entry_t {
+  uint32_t tile_id;
+  patch_op_t op;
+  uint8_t reserved[3];
+  uint32_t old_size;
+  uint32_t new_size;
+  uint64_t old_checksum;
+  uint64_t new_checksum;
+  uint64_t data_offset;
+  uint64_t data_size;
+};
+static_assert(sizeof(patch_entry_t) == 48);
+
+struct patch_stats_t {
+  uint64_t unchanged{0};
+  uint64_t changed{0};
+  uint64_t added{0};
+  uint64_t deleted{0};
+  // bytes of the new tile set and of the patch
+  uint64_t new_bytes{0};
+  uint64_t patch_bytes{0};
+};
+
+/**
+ * @brief The tiles of a tile extract or a tile directory, read by offset.
+ * For a directory the offsets are 0 and every tile is its own file.
+ */
+class tile_set_t {
+public:
+  /**
+   * @throws std::runtime_error if path is neither an extract nor a
+   *         directory
+   */
+  explicit tile_set_t(const std::string& path);
+  ~tile_set_t();
+
+  tile_set_t(const tile_set_t&) = delete;
+  tile_set_t& operator=(const tile_set_t&) = delete;
+
+  /**
+   * The tiles, sorted by tile id
+   */
+  const std::vector<tile_index_entry_t>& tiles() const {
+    return tiles_;
+  }
+
+  std::string read(const tile_index_entry_t& tile) const;
+
+  bool is_extract() const {
+    return fd_ >= 0;
+  }
+
+  /**
+   * The extract's file descriptor, only valid if is_extract()
+   */
+  int fd() const {
+    return fd_;
+  }
+
+private:
+  std::string path_;
+  int fd_{-1};
+  std::vector<tile_index_entry_t> tiles_;
+};
+
+/**
+ * @brief Compares two tile sets (extracts or directories) and writes the
+ * tiles that differ to a patch.
+ *
+ * @param old_path  the tile set the patch applies to
+ * @param new_path  the tile set the patch produces
+ * @param patch     the patch file to write
+ * @param level     zstd compression level
+ * @throws std::runtime_error on read, write or compression errors
+ */
+patch_stats_t make_patch(const std::string& old_path,
+                         const std::string& new_path,
+                         const std::string& patch,
+                         int level,
+                         executor_t& executor);
+
+/**
+ * @brief Writes the extract the patch was made from with the patch
+ * applied to output. Every changed and deleted tile is checked against
+ * its old checksum before and every written tile against its new one
+ * after patching. If output is empty, the extract is replaced
+ * atomically once the patched copy is complete.
+ *
+ * @throws std::runtime_error if the patch doesn't belong to the extract
+ *         or a checksum doesn't match
+ */
+patch_stats_t apply_patch(const std::string& extract,
+                          const std::string& patch,
+                          const std::string& output,
+                          executor_t& executor);
+
+} // namespace tools
+} // namespace valhalla
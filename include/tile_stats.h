@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <boost/property_tree/ptree.hpp>
+
+namespace valhalla {
+
+namespace tools {
+
+struct tile_stats_options_t {
+  bool per_tile{false};
+  // only look at the tile headers and collect the section sizes
+  bool sections{false};
+  size_t top_n{10};
+};
+
+/**
+ * @brief Collects counts and histograms over all tiles of a graph and logs
+ * a summary.
+ *
+ * @param config           the valhalla configuration
+ * @param options          what to collect
+ * @param output           file for the per level statistics, - for stdout,
+ *                         empty to skip
+ * @param format           json or csv
+ * @param per_tile_output  file for the per tile CSV, empty to skip
+ */
+void tile_stats(boost::property_tree::ptree& config,
+                const tile_stats_options_t& options,
+                const std::string& output,
+                const std::string& format,
+                const std::string& per_tile_output);
+
+} // namespace tools
+} // namespace valhalla
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace valhalla {
+
+namespace tools {
+
+namespace trace {
+
+namespace detail {
+extern std::atomic<bool> enabled;
+
+uint64_t now();
+
+void record(const char* name,
+            const char* category,
+            uint64_t start,
+            uint64_t end,
+            const char* arg_name,
+            uint64_t arg);
+} // namespace detail
+
+/**
+ * @brief Whether spans are being recorded, a single relaxed load.
+ */
+inline bool enabled() {
+  return detail::enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Starts recording spans. They are kept in memory until stop()
+ * writes them to the path.
+ *
+ * @param path  the file to write the Chrome trace-event JSON to
+ */
+void start(const std::string& path);
+
+/**
+ * @brief Stops recording and writes all spans recorded so far as Chrome
+ * trace-event JSON, which can be opened in Perfetto or chrome://tracing.
+ * Spans that are still open when this is called are dropped.
+ *
+ * @throws std::runtime_error if the file can't be written
+ */
+void stop();
+
+/**
+ * @brief Records the time between its construction and destruction as a
+ * span on the calling thread. Every thread appends to its own buffer, so
+ * recording takes no locks. If tracing is off, the constructor checks a
+ * flag and the destructor a bool, nothing else. Name, category and
+ * argument name have to be string literals, they are stored as pointers.
+ */
+class span_t {
+public:
+  explicit span_t(const char* name, const char* category = "tools")
+      : span_t(name, category, nullptr, 0) {
+  }
+
+  span_t(const char* name,
+         const char* category,
+         const char* arg_name,
+         uint64_t arg)
+      : name_(name), category_(category), arg_name_(arg_name), arg_(arg),
+        active_(enabled()), start_(active_ ? detail::now() : 0) {
+  }
+
+  ~span_t() {
+    if (active_)
+      detail::record(name_, category_, start_, detail::now(), arg_name_,
+                     arg_);
+  }
+
+  span_t(const span_t&) = delete;
+  span_t& operator=(const span_t&) = delete;
+
+private:
+  const char* name_;
+  const char* category_;
+  const char* arg_name_;
+  uint64_t arg_;
+  bool active_;
+  uint64_t start_;
+};
+
+/**
+ * @brief Traces the lifetime of a tool's main: starts tracing if the path
+ * isn't empty and writes the trace on destruction.
+ */
+class session_t {
+public:
+  explicit session_t(const std::string& path);
+  ~session_t();
+
+  session_t(const session_t&) = delete;
+  session_t& operator=(const session_t&) = delete;
+
+private:
+  bool active_;
+};
+
+} // namespace trace
+} // namespace tools
+} // namespace valhalla
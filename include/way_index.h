@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+#include <valhalla/baldr/graphid.h>
+
+namespace valhalla {
+
+namespace tools {
+
+/**
+ * @brief Header of a way index file. It's followed by way_count entries of
+ * (way id, index of its first edge), sorted by way id, and edge_count
+ * directed edge ids (GraphId values), grouped by way and sorted within
+ * every way. All little endian.
+ */
+struct way_index_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t way_count;
+  uint64_t edge_count;
+};
+static_assert(sizeof(way_index_header_t) == 32);
+
+struct way_index_entry_t {
+  uint64_t way_id;
+  uint64_t first_edge;
+};
+static_assert(sizeof(way_index_entry_t) == 16);
+
+/**
+ * @brief Scans the edge info of every directed edge in the tile set
+ * configured in mjolnir and writes the OSM way id -> directed edges index
+ * to path. Shortcuts and edges without a way id are left out.
+ *
+ * @returns the number of ways written
+ * @throws std::runtime_error if the file can't be written
+ */
+uint64_t build_way_index(const boost::property_tree::ptree& config,
+                         const std::string& path);
+
+/**
+ * @brief Read only view of a way index file, it is memory mapped so
+ * opening it is cheap and lookups only touch the pages they need.
+ */
+class way_index_t {
+public:
+  /**
+   * @throws std::runtime_error if the file can't be mapped or is not a
+   *         valid way index
+   */
+  explicit way_index_t(const std::string& path);
+  ~way_index_t();
+
+  way_index_t(const way_index_t&) = delete;
+  way_index_t& operator=(const way_index_t&) = delete;
+
+  /**
+   * @brief The directed edges of an OSM way, empty if it's not in the
+   * graph. Binary search, O(log ways).
+   */
+  std::vector<baldr::GraphId> find(uint64_t way_id) const;
+
+  uint64_t way_count() const {
+    return header_->way_count;
+  }
+
+  uint64_t edge_count() const {
+    return header_->edge_count;
+  }
+
+private:
+  void* data_{nullptr};
+  size_t size_{0};
+  const way_index_header_t* header_{nullptr};
+  const way_index_entry_t* ways_{nullptr};
+  const uint64_t* edges_{nullptr};
+};
+
+} // namespace tools
+} // namespace valhalla
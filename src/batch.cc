@@ -0,0 +1,174 @@
+#include "batch.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+enum class slot_state_t { kEmpty, kFilled, kDone };
+
+struct slot_t {
+  std::string input;
+  std::string output;
+  slot_state_t state = slot_state_t::kEmpty;
+};
+
+/**
+ * Reads about size bytes plus the rest of the last line into chunk, the
+ * part of the last line that was read too far is kept in carry.
+ */
+bool read_chunk(std::istream& in,
+                size_t size,
+                std::string& chunk,
+                std::string& carry) {
+  chunk.swap(carry);
+  carry.clear();
+  auto offset = chunk.size();
+  chunk.resize(offset + size);
+  in.read(chunk.data() + offset, size);
+  chunk.resize(offset + in.gcount());
+  if (!in)
+    return !chunk.empty();
+
+  auto last = chunk.rfind('\n');
+  if (last == std::string::npos) {
+    // no line end yet, the line is longer than a chunk
+    std::string rest;
+    std::getline(in, rest);
+    chunk += rest;
+    chunk += '\n';
+  } else {
+    carry.assign(chunk, last + 1);
+    chunk.resize(last + 1);
+  }
+  return true;
+}
+
+} // namespace
+
+namespace valhalla {
+
+namespace tools {
+
+void process_lines(std::istream& in,
+                   std::ostream& out,
+                   size_t concurrency,
+                   const chunk_processor_t& process,
+                   size_t chunk_size) {
+  concurrency = std::max(concurrency, size_t(1));
+  std::vector<slot_t> slots(concurrency * 2);
+  std::mutex lock;
+  std::condition_variable changed;
+  size_t read = 0;      // chunks read so far
+  size_t taken = 0;     // chunks taken by workers
+  size_t written = 0;   // chunks written
+  bool eof = false;
+  std::exception_ptr error;
+
+  auto fail = [&](std::exception_ptr e) {
+    std::lock_guard l(lock);
+    if (!error)
+      error = e;
+    eof = true;
+    changed.notify_all();
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < concurrency; ++i) {
+    workers.emplace_back([&]() {
+      while (true) {
+        slot_t* slot;
+        {
+          trace::span_t span("dequeue", "queue");
+          std::unique_lock l(lock);
+          changed.wait(l, [&]() { return taken < read || eof; });
+          if (taken == read || error)
+            return;
+          slot = &slots[taken++ % slots.size()];
+        }
+        slot->output.clear();
+        try {
+          trace::span_t span("decode", "chunk", "bytes",
+                             slot->input.size());
+          process(slot->input, slot->output);
+        } catch (...) {
+          fail(std::current_exception());
+          return;
+        }
+        std::lock_guard l(lock);
+        slot->state = slot_state_t::kDone;
+        changed.notify_all();
+      }
+    });
+  }
+
+  std::thread writer([&]() {
+    while (true) {
+      slot_t* slot;
+      {
+        std::unique_lock l(lock);
+        changed.wait(l, [&]() {
+          return error || slots[written % slots.size()].state ==
+                              slot_state_t::kDone ||
+                 (eof && written == read);
+        });
+        if (error || (eof && written == read))
+          return;
+        slot = &slots[written % slots.size()];
+      }
+      {
+        trace::span_t span("write", "io", "bytes", slot->output.size());
+        out.write(slot->output.data(), slot->output.size());
+      }
+      std::lock_guard l(lock);
+      slot->state = slot_state_t::kEmpty;
+      ++written;
+      changed.notify_all();
+    }
+  });
+
+  std::string carry;
+  while (true) {
+    slot_t* slot;
+    {
+      std::unique_lock l(lock);
+      changed.wait(l, [&]() {
+        return error || slots[read % slots.size()].state ==
+                            slot_state_t::kEmpty;
+      });
+      if (error)
+        break;
+      slot = &slots[read % slots.size()];
+    }
+    bool more = false;
+    try {
+      trace::span_t span("read", "io");
+      more = read_chunk(in, chunk_size, slot->input, carry);
+    } catch (...) { fail(std::current_exception()); }
+    std::lock_guard l(lock);
+    if (!more) {
+      eof = true;
+      changed.notify_all();
+      break;
+    }
+    slot->state = slot_state_t::kFilled;
+    ++read;
+    changed.notify_all();
+  }
+
+  for (auto& worker : workers)
+    worker.join();
+  writer.join();
+  out.flush();
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+} // namespace tools
+} // namespace valhalla
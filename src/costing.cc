@@ -0,0 +1,25 @@
+#include "costing.h"
+
+#include <valhalla/proto/options.pb.h>
+#include <valhalla/proto_conversions.h>
+#include <valhalla/sif/costfactory.h>
+
+namespace valhalla {
+
+namespace tools {
+
+sif::cost_ptr_t create_costing(const std::string& costing_str) {
+  Options options;
+  Costing::Type costing;
+  if (Costing_Enum_Parse(costing_str, &costing)) {
+    options.set_costing_type(costing);
+  } else {
+    options.set_costing_type(Costing::none_);
+  }
+  auto& co = (*options.mutable_costings())[options.costing_type()];
+  co.set_type(options.costing_type());
+  return sif::CostFactory{}.Create(options);
+}
+
+} // namespace tools
+} // namespace valhalla
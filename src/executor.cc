@@ -0,0 +1,316 @@
+#include "executor.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <valhalla/midgard/logging.h>
+
+namespace {
+using namespace valhalla;
+
+std::atomic<bool> interrupt_received{false};
+
+void on_interrupt(int) {
+  interrupt_received.store(true);
+  // the next one kills the process
+  std::signal(SIGINT, SIG_DFL);
+  const char msg[] =
+      "Interrupted, waiting for running tasks. Press Ctrl-C again to "
+      "abort.\n";
+  auto written = ::write(STDERR_FILENO, msg, sizeof(msg) - 1);
+  (void)written;
+}
+
+void install_interrupt_handler() {
+  static bool installed = std::signal(SIGINT, on_interrupt) != SIG_ERR;
+  (void)installed;
+}
+
+/**
+ * Parses a CPU list like 0-3,8,10-11 as found in sysfs
+ */
+std::vector<int> parse_cpu_list(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || range == "\n")
+      continue;
+    auto dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos ? first
+                                         : std::stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; ++cpu)
+      cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+std::vector<int> allowed_cpus() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  std::vector<int> cpus;
+  if (sched_getaffinity(0, sizeof(set), &set) != 0)
+    return cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &set))
+      cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+/**
+ * The allowed CPUs of every NUMA node that has some
+ */
+std::vector<std::vector<int>> numa_nodes() {
+  std::vector<std::vector<int>> nodes;
+  const std::filesystem::path sysfs("/sys/devices/system/node");
+  std::error_code ec;
+  if (!std::filesystem::is_directory(sysfs, ec))
+    return nodes;
+
+  auto allowed = allowed_cpus();
+  std::vector<std::filesystem::path> dirs;
+  for (const auto& entry : std::filesystem::directory_iterator(sysfs, ec)) {
+    auto name = entry.path().filename().string();
+    if (name.starts_with("node") &&
+        name.find_first_not_of("0123456789", 4) == std::string::npos)
+      dirs.push_back(entry.path());
+  }
+  std::sort(dirs.begin(), dirs.end());
+
+  for (const auto& dir : dirs) {
+    std::ifstream file(dir / "cpulist");
+    std::string list;
+    std::getline(file, list);
+    std::vector<int> cpus;
+    for (auto cpu : parse_cpu_list(list)) {
+      if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end())
+        cpus.push_back(cpu);
+    }
+    if (!cpus.empty())
+      nodes.push_back(std::move(cpus));
+  }
+  return nodes;
+}
+
+/**
+ * The CPUs every worker is pinned to, empty if they aren't pinned
+ */
+std::vector<std::vector<int>> worker_cpus(tools::pinning_t pinning,
+                                          size_t workers) {
+  std::vector<std::vector<int>> sets;
+  if (pinning == tools::pinning_t::kNuma) {
+    auto nodes = numa_nodes();
+    if (nodes.empty()) {
+      LOG_WARN("No NUMA nodes found, pinning threads to CPUs instead");
+      pinning = tools::pinning_t::kCpu;
+    } else {
+      for (size_t w = 0; w < workers; ++w)
+        sets.push_back(nodes[w % nodes.size()]);
+    }
+  }
+  if (pinning == tools::pinning_t::kCpu) {
+    auto cpus = allowed_cpus();
+    for (size_t w = 0; w < workers && !cpus.empty(); ++w)
+      sets.push_back({cpus[w % cpus.size()]});
+  }
+  return sets;
+}
+
+void pin(std::thread& thread, const std::vector<int>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu : cpus)
+    CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) != 0)
+    LOG_WARN("Unable to pin worker thread");
+}
+
+std::string format_seconds(double seconds) {
+  auto s = static_cast<uint64_t>(seconds + 0.5);
+  std::stringstream ss;
+  if (s >= 3600)
+    ss << s / 3600 << "h" << std::setw(2) << std::setfill('0');
+  if (s >= 60)
+    ss << (s % 3600) / 60 << "m" << std::setw(2) << std::setfill('0');
+  ss << s % 60 << "s";
+  return ss.str();
+}
+
+} // namespace
+
+namespace valhalla {
+
+namespace tools {
+
+struct executor_t::job_t {
+  size_t count;
+  const task_t* fn;
+  std::string label;
+  std::atomic<size_t> next{0};
+  std::atomic<size_t> done{0};
+  std::atomic<bool> failed{false};
+  std::mutex error_lock;
+  std::exception_ptr error;
+};
+
+executor_options_t
+executor_options_t::from_config(const boost::property_tree::ptree& config) {
+  executor_options_t options;
+  options.concurrency =
+      std::max(config.get<size_t>("mjolnir.concurrency",
+                                  std::thread::hardware_concurrency()),
+               size_t(1));
+
+  auto pinning = config.get<std::string>("mjolnir.pin_threads", "none");
+  if (pinning == "none")
+    options.pinning = pinning_t::kNone;
+  else if (pinning == "cpu")
+    options.pinning = pinning_t::kCpu;
+  else if (pinning == "numa")
+    options.pinning = pinning_t::kNuma;
+  else
+    throw std::runtime_error("Unknown mjolnir.pin_threads: " + pinning);
+
+  options.progress_interval = std::chrono::seconds(
+      config.get<unsigned int>("mjolnir.progress_interval",
+                               options.progress_interval.count()));
+  return options;
+}
+
+bool interrupted() {
+  return interrupt_received.load(std::memory_order_relaxed);
+}
+
+executor_t::executor_t(const executor_options_t& options)
+    : progress_interval_(options.progress_interval) {
+  install_interrupt_handler();
+
+  auto concurrency = std::max(options.concurrency, size_t(1));
+  auto cpus = worker_cpus(options.pinning, concurrency);
+  workers_.reserve(concurrency);
+  for (size_t w = 0; w < concurrency; ++w) {
+    workers_.emplace_back(&executor_t::run, this, w);
+    if (w < cpus.size())
+      pin(workers_.back(), cpus[w]);
+  }
+}
+
+executor_t::~executor_t() {
+  {
+    std::lock_guard l(lock_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto& worker : workers_)
+    worker.join();
+}
+
+void executor_t::run(size_t worker) {
+  uint64_t seen = 0;
+  while (true) {
+    job_t* job;
+    {
+      std::unique_lock l(lock_);
+      wake_.wait(l, [&]() { return stop_ || generation_ != seen; });
+      if (stop_)
+        return;
+      seen = generation_;
+      job = job_;
+    }
+
+    size_t i;
+    while (!job->failed.load(std::memory_order_relaxed) && !interrupted() &&
+           (i = job->next.fetch_add(1)) < job->count) {
+      try {
+        (*job->fn)(worker, i);
+      } catch (const std::exception& e) {
+        LOG_ERROR((job->label.empty() ? "Task" : job->label) + " " +
+                  std::to_string(i) + " failed: " + e.what());
+        std::lock_guard l(job->error_lock);
+        if (!job->error)
+          job->error = std::current_exception();
+        job->failed = true;
+      } catch (...) {
+        std::lock_guard l(job->error_lock);
+        if (!job->error)
+          job->error = std::current_exception();
+        job->failed = true;
+      }
+      job->done.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::lock_guard l(lock_);
+    if (++finished_workers_ == workers_.size())
+      finished_.notify_all();
+  }
+}
+
+void executor_t::log_progress(
+    const job_t& job,
+    std::chrono::steady_clock::time_point start) const {
+  auto done = job.done.load(std::memory_order_relaxed);
+  auto seconds = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  auto rate = seconds > 0 ? done / seconds : 0.0;
+  std::stringstream ss;
+  ss << job.label << ": " << done << "/" << job.count << " ("
+     << std::fixed << std::setprecision(1)
+     << (job.count ? 100.0 * done / job.count : 100.0) << "%), " << rate
+     << "/s";
+  if (rate > 0 && done < job.count)
+    ss << ", ETA " << format_seconds((job.count - done) / rate);
+  LOG_INFO(ss.str());
+}
+
+void executor_t::for_each(size_t count,
+                          const task_t& fn,
+                          const std::string& label) {
+  job_t job;
+  job.count = count;
+  job.fn = &fn;
+  job.label = label;
+  auto start = std::chrono::steady_clock::now();
+
+  std::unique_lock l(lock_);
+  job_ = &job;
+  finished_workers_ = 0;
+  ++generation_;
+  wake_.notify_all();
+
+  auto all_finished = [&]() { return finished_workers_ == workers_.size(); };
+  {
+    trace::span_t span("wait", "executor");
+    if (label.empty() || progress_interval_.count() == 0) {
+      finished_.wait(l, all_finished);
+    } else {
+      while (!finished_.wait_for(l, progress_interval_, all_finished))
+        log_progress(job, start);
+    }
+  }
+  job_ = nullptr;
+  l.unlock();
+
+  if (!label.empty() && progress_interval_.count() && count && !job.error)
+    log_progress(job, start);
+
+  if (job.error)
+    std::rethrow_exception(job.error);
+  if (interrupted())
+    throw interrupted_error();
+}
+
+} // namespace tools
+} // namespace valhalla
@@ -0,0 +1,597 @@
+#include <filesystem>
+
+#include <ogrsf_frmts.h>
+#include <valhalla/midgard/logging.h>
+#include <valhalla/midgard/pointll.h>
+
+#include "export.h"
+#include "live_traffic.h"
+#include "pgcopy.h"
+#include "trace.h"
+
+namespace {
+using namespace valhalla;
+
+/**
+ * Whether an edge is left out of the export
+ */
+bool skip_edge(const tools::AttributeFilter& filter,
+               const baldr::DirectedEdge* de,
+               const baldr::graph_tile_ptr& tile,
+               const sif::cost_ptr_t& costing,
+               double tolerance) {
+  // it's a shortcut but we want none or it's not but we only want
+  // shortcuts
+  if ((!filter.shortcuts_only && de->is_shortcut()) ||
+      (filter.shortcuts_only && !de->is_shortcut()))
+    return true;
+
+  if (!costing->Allowed(de, tile, sif::kDisallowNone) ||
+      filter.is_filtered(de, tile, costing))
+    return true;
+
+  return filter.simplify.drop_short_edges && de->length() < tolerance;
+}
+
+/**
+ * The simplify tolerance for a tile's edges, 0 if there's none. Tiles
+ * are small enough for one tolerance per tile.
+ */
+double simplify_tolerance(const tools::AttributeFilter& filter,
+                          const baldr::graph_tile_ptr& tile) {
+  return filter.simplify.enabled()
+             ? filter.simplify.tolerance_at(tile->header()->base_ll().lat())
+             : 0;
+}
+
+/**
+ * The predicted speed of an edge in bucket i, 0 if it has none
+ */
+int predicted_speed(const baldr::DirectedEdge* de,
+                    const baldr::graph_tile_ptr& tile,
+                    unsigned int i,
+                    const sif::cost_ptr_t& costing) {
+  if (!de->has_predicted_speed())
+    return 0;
+  uint8_t sources = 0;
+  auto s = tile->GetSpeed(de, baldr::kPredictedFlowMask,
+                          i * baldr::kSpeedBucketSizeSeconds,
+                          costing->is_hgv(), &sources);
+  return (sources & baldr::kPredictedFlowMask) ? static_cast<int>(s) : 0;
+}
+
+OGRLineString*
+ConvertToOGRLineString(const std::vector<midgard::PointLL>& points) {
+  OGRLineString* line = new OGRLineString();
+  line->setNumPoints(static_cast<int>(points.size()), FALSE);
+  for (size_t i = 0; i < points.size(); ++i) {
+    line->setPoint(static_cast<int>(i), points[i].lng(), points[i].lat());
+  }
+  return line;
+}
+
+} // namespace
+
+namespace valhalla {
+
+namespace tools {
+
+size_t export_tile(baldr::GraphReader& reader,
+                   const baldr::GraphId tile_id,
+                   const std::string& output_dir,
+                   const std::string& file_suffix,
+                   sif::cost_ptr_t costing,
+                   GDALDriver* gdal_driver,
+                   char** dataset_options,
+                   const AttributeFilter& filter) {
+  trace::span_t span("export_tile", "tile", "tile_id", tile_id.value);
+
+  // get the file path
+  auto edge_suffix =
+      baldr::GraphTile::FileSuffix(tile_id.Tile_Base(),
+                                   "_edges" + file_suffix + ".fgb");
+  auto node_suffix =
+      baldr::GraphTile::FileSuffix(tile_id.Tile_Base(),
+                                   "_nodes" + file_suffix + ".fgb");
+  auto edge_location =
+      output_dir + std::filesystem::path::preferred_separator + edge_suffix;
+  auto node_location =
+      output_dir + std::filesystem::path::preferred_separator + node_suffix;
+
+  // make sure all the subdirectories exist
+  auto dir = std::filesystem::path(edge_location);
+  dir.replace_filename("");
+  std::filesystem::create_directories(dir);
+  GDALDataset* edge_data = nullptr;
+  GDALDataset* node_data = nullptr;
+
+  if (filter.edges) {
+    LOG_INFO("Writing edges to disk at " + edge_location);
+    edge_data = gdal_driver->Create(edge_location.c_str(), 0, 0, 0,
+                                    GDT_Unknown, nullptr);
+  } else {
+    LOG_INFO("No edges will be written");
+  }
+
+  if (filter.nodes) {
+    LOG_INFO("Writing edges to disk at " + node_location);
+    node_data = gdal_driver->Create(node_location.c_str(), 0, 0, 0,
+                                    GDT_Unknown, nullptr);
+  } else {
+    LOG_INFO("No nodes will be written");
+  }
+
+  if (!edge_data && !node_data) {
+    LOG_INFO("No attributes specified, skipping export");
+    return 0;
+  }
+
+  // now go through the tile and convert the features
+  if (!reader.DoesTileExist(tile_id)) {
+    LOG_ERROR("Tile " + std::to_string(tile_id) +
+              " does not exist. Skipping...");
+    if (edge_data)
+      GDALClose(edge_data);
+    if (node_data)
+      GDALClose(node_data);
+    return 0;
+  }
+  // Trim reader if over-committed
+  if (reader.OverCommitted()) {
+    reader.Trim();
+  }
+
+  OGRSpatialReference spatialRef;
+  spatialRef.SetWellKnownGeogCS("WGS84");
+
+  OGRLayer* edges_layer;
+  OGRLayer* nodes_layer;
+  if (edge_data)
+    edges_layer = edge_data->CreateLayer("edges", &spatialRef,
+                                         wkbLineString, dataset_options);
+
+  if (node_data)
+    nodes_layer = node_data->CreateLayer("nodes", &spatialRef, wkbPoint,
+                                         dataset_options);
+
+  // create fields
+  if (filter.localidx) {
+    OGRFieldDefn field_name("edgeid", OFTInteger);
+    edges_layer->CreateField(&field_name);
+  }
+  if (filter.road_class) {
+    OGRFieldDefn field_name("road_class", OFTString);
+    edges_layer->CreateField(&field_name);
+  }
+
+  if (filter.density) {
+    OGRFieldDefn field_name("density", OFTInteger);
+    edges_layer->CreateField(&field_name);
+  }
+
+  if (filter.urban) {
+    OGRFieldDefn field_name("urban", OFTInteger);
+    edges_layer->CreateField(&field_name);
+  }
+
+  if (filter.country_crossing) {
+    OGRFieldDefn field_name("country_crossing", OFTInteger);
+    edges_layer->CreateField(&field_name);
+  }
+
+  if (filter.predicted_speeds) {
+    for (const auto& i : filter.pred_speed_indices) {
+      std::string name = "predspeed_" + std::to_string(i);
+      OGRFieldDefn field_name(name.c_str(), OFTInteger);
+      edges_layer->CreateField(&field_name);
+    }
+  }
+
+  if (filter.live_traffic) {
+    const auto& columns = live_speed_columns();
+    for (size_t i = 0; i < columns.size(); ++i) {
+      OGRFieldDefn field_name(columns[i].c_str(),
+                              i < kLiveSpeedIntColumns ? OFTInteger
+                                                       : OFTReal);
+      edges_layer->CreateField(&field_name);
+    }
+  }
+
+  if (filter.type) {
+    OGRFieldDefn field_name("type", OFTString);
+    nodes_layer->CreateField(&field_name);
+  }
+
+  baldr::graph_tile_ptr tile;
+  {
+    trace::span_t load("load", "io", "tile_id", tile_id.value);
+    tile = reader.GetGraphTile(tile_id);
+  }
+
+  baldr::GraphId nodeid = tile_id;
+  size_t features = 0;
+
+  if (filter.nodes) {
+    // export nodes
+    trace::span_t convert("convert_nodes", "gdal");
+    for (size_t idx = 0; idx < tile->header()->nodecount();
+         ++idx, nodeid++) {
+      auto ni = tile->node(idx);
+      if (!costing->Allowed(ni))
+        continue;
+      auto ll = tile->get_node_ll(nodeid);
+      OGRFeature* feature =
+          OGRFeature::CreateFeature(nodes_layer->GetLayerDefn());
+      auto point = new OGRPoint();
+      point->setX(ll.lng());
+      point->setY(ll.lat());
+      feature->SetGeometryDirectly(point);
+
+      if (filter.type) {
+        feature->SetField("type",
+                          baldr::to_string(ni->type()).c_str());
+      }
+      if (nodes_layer->CreateFeature(feature) != OGRERR_NONE) {
+        LOG_ERROR("Failed to create feature");
+      } else {
+        features++;
+      }
+
+      OGRFeature::DestroyFeature(feature);
+    }
+  }
+
+  if (!filter.edges) {
+    trace::span_t write("write", "io");
+    if (node_data)
+      GDALClose(node_data);
+    return features;
+  }
+
+  // export edges
+  {
+    trace::span_t convert("convert_edges", "gdal");
+    double tolerance = simplify_tolerance(filter, tile);
+    for (size_t idx = 0; idx < tile->header()->directededgecount(); ++idx) {
+      auto de = tile->directededge(idx);
+      if (skip_edge(filter, de, tile, costing, tolerance))
+        continue;
+
+      auto ei = tile->edgeinfo(de);
+
+      auto shape = ei.shape();
+      if (tolerance > 0)
+        simplify(shape, tolerance, filter.simplify.method);
+      OGRLineString* line = ConvertToOGRLineString(shape);
+      OGRFeature* feature =
+          OGRFeature::CreateFeature(edges_layer->GetLayerDefn());
+      feature->SetGeometryDirectly(line);
+
+      if (filter.localidx) {
+        feature->SetField("edgeid", static_cast<int>(idx));
+      }
+      if (filter.road_class) {
+        feature->SetField("road_class",
+                          baldr::to_string(de->classification())
+                              .c_str());
+      }
+      if (filter.density) {
+        feature->SetField("density", static_cast<int>(de->density()));
+      }
+      if (filter.urban) {
+        feature->SetField("urban", static_cast<int>(de->density() > 8));
+      }
+      if (filter.country_crossing) {
+        feature->SetField("country_crossing",
+                          static_cast<int>(de->ctry_crossing()));
+      }
+      if (filter.predicted_speeds) {
+        for (const auto& i : filter.pred_speed_indices) {
+          std::string field_name = "predspeed_" + std::to_string(i);
+          feature->SetField(field_name.c_str(),
+                            predicted_speed(de, tile, i, costing));
+        }
+      }
+      if (filter.live_traffic) {
+        // unknown values stay null
+        auto live = decode_live_speed(tile->trafficspeed(de));
+        const auto& columns = live_speed_columns();
+        for (size_t i = 0; i < columns.size(); ++i) {
+          auto value = live_speed_value(live, i);
+          if (value < 0)
+            continue;
+          if (i < kLiveSpeedIntColumns)
+            feature->SetField(columns[i].c_str(), static_cast<int>(value));
+          else
+            feature->SetField(columns[i].c_str(), value);
+        }
+      }
+      if (edges_layer->CreateFeature(feature) != OGRERR_NONE) {
+        LOG_ERROR("Failed to create feature");
+      } else {
+        features++;
+      }
+
+      OGRFeature::DestroyFeature(feature);
+    }
+  }
+
+  // the FlatGeobuf driver builds the index and writes the file on close
+  trace::span_t write("write", "io");
+  if (edge_data)
+    GDALClose(edge_data);
+
+  if (node_data)
+    GDALClose(node_data);
+
+  return features;
+}
+
+std::string pgcopy_schema(const AttributeFilter& filter,
+                          const std::string& edges_table,
+                          const std::string& nodes_table) {
+  std::string schema;
+  if (filter.edges) {
+    schema += "CREATE TABLE " + edges_table + " (\n  id bigint,\n";
+    if (filter.localidx)
+      schema += "  edgeid integer,\n";
+    if (filter.road_class)
+      schema += "  road_class text,\n";
+    if (filter.density)
+      schema += "  density smallint,\n";
+    if (filter.urban)
+      schema += "  urban boolean,\n";
+    if (filter.country_crossing)
+      schema += "  country_crossing boolean,\n";
+    if (filter.predicted_speeds) {
+      for (const auto& i : filter.pred_speed_indices)
+        schema += "  predspeed_" + std::to_string(i) + " smallint,\n";
+    }
+    if (filter.live_traffic) {
+      const auto& columns = live_speed_columns();
+      for (size_t i = 0; i < columns.size(); ++i)
+        schema += "  " + columns[i] +
+                  (i < kLiveSpeedIntColumns ? " smallint,\n"
+                                            : " double precision,\n");
+    }
+    schema += "  geom geometry(LineString, 4326)\n);\n";
+  }
+  if (filter.nodes) {
+    schema += "CREATE TABLE " + nodes_table + " (\n  id bigint,\n";
+    if (filter.type)
+      schema += "  type text,\n";
+    schema += "  geom geometry(Point, 4326)\n);\n";
+  }
+  return schema;
+}
+
+size_t export_tile_pgcopy(baldr::GraphReader& reader,
+                          const baldr::GraphId tile_id,
+                          sif::cost_ptr_t costing,
+                          const AttributeFilter& filter,
+                          std::string* edge_rows,
+                          std::string* node_rows) {
+  trace::span_t span("export_tile", "tile", "tile_id", tile_id.value);
+  if (reader.OverCommitted())
+    reader.Trim();
+
+  baldr::graph_tile_ptr tile;
+  {
+    trace::span_t load("load", "io", "tile_id", tile_id.value);
+    tile = reader.GetGraphTile(tile_id);
+  }
+  if (!tile) {
+    LOG_ERROR("Tile " + std::to_string(tile_id) +
+              " does not exist. Skipping...");
+    return 0;
+  }
+
+  size_t features = 0;
+  if (node_rows && filter.nodes) {
+    trace::span_t convert("convert_nodes", "pgcopy");
+    pgcopy_encoder_t encoder(*node_rows);
+    uint16_t fields = 2 + filter.type;
+    baldr::GraphId nodeid = tile_id;
+    for (size_t idx = 0; idx < tile->header()->nodecount();
+         ++idx, nodeid++) {
+      auto ni = tile->node(idx);
+      if (!costing->Allowed(ni))
+        continue;
+      encoder.begin_row(fields);
+      encoder.add_int64(static_cast<int64_t>(nodeid.value));
+      if (filter.type)
+        encoder.add_text(baldr::to_string(ni->type()));
+      encoder.add_point(tile->get_node_ll(nodeid));
+      features++;
+    }
+  }
+
+  if (!edge_rows || !filter.edges)
+    return features;
+
+  trace::span_t convert("convert_edges", "pgcopy");
+  pgcopy_encoder_t encoder(*edge_rows);
+  uint16_t fields = 2 + filter.localidx + filter.road_class +
+                    filter.density + filter.urban + filter.country_crossing;
+  if (filter.predicted_speeds)
+    fields += filter.pred_speed_indices.size();
+  if (filter.live_traffic)
+    fields += live_speed_columns().size();
+  double tolerance = simplify_tolerance(filter, tile);
+  for (size_t idx = 0; idx < tile->header()->directededgecount(); ++idx) {
+    auto de = tile->directededge(idx);
+    if (skip_edge(filter, de, tile, costing, tolerance))
+      continue;
+
+    encoder.begin_row(fields);
+    encoder.add_int64(static_cast<int64_t>(
+        baldr::GraphId(tile_id.tileid(), tile_id.level(), idx).value));
+    if (filter.localidx)
+      encoder.add_int32(static_cast<int32_t>(idx));
+    if (filter.road_class)
+      encoder.add_text(baldr::to_string(de->classification()));
+    if (filter.density)
+      encoder.add_int16(static_cast<int16_t>(de->density()));
+    if (filter.urban)
+      encoder.add_bool(de->density() > 8);
+    if (filter.country_crossing)
+      encoder.add_bool(de->ctry_crossing());
+    if (filter.predicted_speeds) {
+      for (const auto& i : filter.pred_speed_indices)
+        encoder.add_int16(
+            static_cast<int16_t>(predicted_speed(de, tile, i, costing)));
+    }
+    if (filter.live_traffic) {
+      auto live = decode_live_speed(tile->trafficspeed(de));
+      for (size_t i = 0; i < live_speed_columns().size(); ++i) {
+        auto value = live_speed_value(live, i);
+        if (value < 0)
+          encoder.add_null();
+        else if (i < kLiveSpeedIntColumns)
+          encoder.add_int16(static_cast<int16_t>(value));
+        else
+          encoder.add_float8(value);
+      }
+    }
+    auto shape = tile->edgeinfo(de).shape();
+    if (tolerance > 0)
+      simplify(shape, tolerance, filter.simplify.method);
+    encoder.add_linestring(shape);
+    features++;
+  }
+  return features;
+}
+
+std::vector<fgb_column_t> fgb_edge_columns(const AttributeFilter& filter) {
+  std::vector<fgb_column_t> columns{{"id", fgb_column_type_t::kLong}};
+  if (filter.localidx)
+    columns.push_back({"edgeid", fgb_column_type_t::kInt});
+  if (filter.road_class)
+    columns.push_back({"road_class", fgb_column_type_t::kString});
+  if (filter.density)
+    columns.push_back({"density", fgb_column_type_t::kInt});
+  if (filter.urban)
+    columns.push_back({"urban", fgb_column_type_t::kInt});
+  if (filter.country_crossing)
+    columns.push_back({"country_crossing", fgb_column_type_t::kInt});
+  if (filter.predicted_speeds) {
+    for (const auto& i : filter.pred_speed_indices)
+      columns.push_back(
+          {"predspeed_" + std::to_string(i), fgb_column_type_t::kInt});
+  }
+  if (filter.live_traffic) {
+    const auto& live = live_speed_columns();
+    for (size_t i = 0; i < live.size(); ++i)
+      columns.push_back({live[i], i < kLiveSpeedIntColumns
+                                      ? fgb_column_type_t::kInt
+                                      : fgb_column_type_t::kDouble});
+  }
+  return columns;
+}
+
+std::vector<fgb_column_t> fgb_node_columns(const AttributeFilter& filter) {
+  std::vector<fgb_column_t> columns{{"id", fgb_column_type_t::kLong}};
+  if (filter.type)
+    columns.push_back({"type", fgb_column_type_t::kString});
+  return columns;
+}
+
+size_t export_tile_fgb(baldr::GraphReader& reader,
+                       const baldr::GraphId tile_id,
+                       sif::cost_ptr_t costing,
+                       const AttributeFilter& filter,
+                       fgb_writer_t* edges,
+                       fgb_writer_t* nodes,
+                       size_t worker) {
+  trace::span_t span("export_tile", "tile", "tile_id", tile_id.value);
+  if (reader.OverCommitted())
+    reader.Trim();
+
+  baldr::graph_tile_ptr tile;
+  {
+    trace::span_t load("load", "io", "tile_id", tile_id.value);
+    tile = reader.GetGraphTile(tile_id);
+  }
+  if (!tile) {
+    LOG_ERROR("Tile " + std::to_string(tile_id) +
+              " does not exist. Skipping...");
+    return 0;
+  }
+
+  size_t features = 0;
+  fgb_properties_t properties;
+  if (nodes && filter.nodes) {
+    trace::span_t convert("convert_nodes", "fgb");
+    std::vector<midgard::PointLL> point(1);
+    baldr::GraphId nodeid = tile_id;
+    for (size_t idx = 0; idx < tile->header()->nodecount();
+         ++idx, nodeid++) {
+      auto ni = tile->node(idx);
+      if (!costing->Allowed(ni))
+        continue;
+      properties.clear();
+      properties.add_long(0, static_cast<int64_t>(nodeid.value));
+      if (filter.type)
+        properties.add_string(1, baldr::to_string(ni->type()));
+      point[0] = tile->get_node_ll(nodeid);
+      nodes->add(worker, point, properties);
+      features++;
+    }
+  }
+
+  if (!edges || !filter.edges)
+    return features;
+
+  trace::span_t convert("convert_edges", "fgb");
+  double tolerance = simplify_tolerance(filter, tile);
+  for (size_t idx = 0; idx < tile->header()->directededgecount(); ++idx) {
+    auto de = tile->directededge(idx);
+    if (skip_edge(filter, de, tile, costing, tolerance))
+      continue;
+
+    properties.clear();
+    uint16_t column = 0;
+    properties.add_long(column++,
+                        static_cast<int64_t>(
+                            baldr::GraphId(tile_id.tileid(),
+                                           tile_id.level(), idx)
+                                .value));
+    if (filter.localidx)
+      properties.add_int(column++, static_cast<int32_t>(idx));
+    if (filter.road_class)
+      properties.add_string(column++,
+                            baldr::to_string(de->classification()));
+    if (filter.density)
+      properties.add_int(column++, static_cast<int32_t>(de->density()));
+    if (filter.urban)
+      properties.add_int(column++, de->density() > 8);
+    if (filter.country_crossing)
+      properties.add_int(column++, de->ctry_crossing());
+    if (filter.predicted_speeds) {
+      for (const auto& i : filter.pred_speed_indices)
+        properties.add_int(column++, predicted_speed(de, tile, i, costing));
+    }
+    if (filter.live_traffic) {
+      // unknown values are left out, which reads as null
+      auto live = decode_live_speed(tile->trafficspeed(de));
+      for (size_t i = 0; i < live_speed_columns().size(); ++i, ++column) {
+        auto value = live_speed_value(live, i);
+        if (value < 0)
+          continue;
+        if (i < kLiveSpeedIntColumns)
+          properties.add_int(column, static_cast<int32_t>(value));
+        else
+          properties.add_double(column, value);
+      }
+    }
+    auto shape = tile->edgeinfo(de).shape();
+    if (tolerance > 0)
+      simplify(shape, tolerance, filter.simplify.method);
+    edges->add(worker, shape, properties);
+    features++;
+  }
+  return features;
+}
+
+} // namespace tools
+} // namespace valhalla
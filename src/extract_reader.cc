@@ -0,0 +1,36 @@
+#include "extract_reader.h"
+
+namespace {
+
+boost::property_tree::ptree
+without_extracts(boost::property_tree::ptree mjolnir) {
+  mjolnir.erase("tile_extract");
+  mjolnir.erase("traffic_extract");
+  return mjolnir;
+}
+
+} // namespace
+
+namespace valhalla {
+
+namespace tools {
+
+extract_reader_t::extract_ptr_t
+extract_reader_t::map_extract(const boost::property_tree::ptree& mjolnir) {
+  return std::make_shared<const tile_extract_t>(mjolnir);
+}
+
+extract_reader_t::extract_reader_t(
+    const boost::property_tree::ptree& mjolnir)
+    : extract_reader_t(mjolnir, map_extract(mjolnir)) {
+}
+
+extract_reader_t::extract_reader_t(
+    const boost::property_tree::ptree& mjolnir,
+    extract_ptr_t extract)
+    : GraphReader(without_extracts(mjolnir)) {
+  tile_extract_ = std::move(extract);
+}
+
+} // namespace tools
+} // namespace valhalla
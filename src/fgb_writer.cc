@@ -0,0 +1,771 @@
+#include "fgb_writer.h"
+#include "tile_extract.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <valhalla/midgard/logging.h>
+
+namespace {
+using namespace valhalla;
+using tools::fgb_column_t;
+using tools::fgb_geometry_type_t;
+namespace trace = valhalla::tools::trace;
+
+constexpr uint8_t kMagic[8] = {'f', 'g', 'b', 3, 'f', 'g', 'b', 0};
+constexpr uint16_t kNodeSize = 16;
+constexpr size_t kNodeItemSize = 40;
+constexpr size_t kMinReadBuffer = 64 << 10;
+// runs merged at once, more go through intermediate runs so open files
+// and read buffers stay bounded however many runs were spilled
+constexpr size_t kMaxMergeWidth = 128;
+constexpr size_t kWriteBuffer = 1 << 20;
+
+using bbox_t = std::array<double, 4>;
+
+bbox_t empty_bbox() {
+  constexpr auto max = std::numeric_limits<double>::max();
+  return {max, max, -max, -max};
+}
+
+void expand(bbox_t& bbox, const bbox_t& other) {
+  bbox[0] = std::min(bbox[0], other[0]);
+  bbox[1] = std::min(bbox[1], other[1]);
+  bbox[2] = std::max(bbox[2], other[2]);
+  bbox[3] = std::max(bbox[3], other[3]);
+}
+
+template <typename T> void put(std::string& out, T value) {
+  char bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  out.append(bytes, sizeof(T));
+}
+
+/**
+ * Distance of a point along the Hilbert curve through a 2^32 x 2^32 grid
+ */
+uint64_t hilbert(uint32_t x, uint32_t y) {
+  uint64_t d = 0;
+  for (uint64_t s = uint64_t(1) << 31; s > 0; s >>= 1) {
+    uint32_t rx = (x & s) > 0;
+    uint32_t ry = (y & s) > 0;
+    d += s * s * ((3 * rx) ^ ry);
+    if (ry == 0) {
+      if (rx == 1) {
+        x = ~x;
+        y = ~y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return d;
+}
+
+/**
+ * The Hilbert key of a bounding box's center, over the whole world so
+ * it's known before the extent of the layer is
+ */
+uint64_t hilbert_key(const bbox_t& bbox) {
+  constexpr double kMax = std::numeric_limits<uint32_t>::max();
+  auto scale = [&](double v, double min, double range) {
+    return static_cast<uint32_t>(std::clamp((v - min) / range, 0.0, 1.0) *
+                                 kMax);
+  };
+  return hilbert(scale((bbox[0] + bbox[2]) / 2, -180, 360),
+                 scale((bbox[1] + bbox[3]) / 2, -90, 180));
+}
+
+/**
+ * Builds a flatbuffer front to back: every table's vtable is written
+ * right before it and everything a table points to after it, so all
+ * offsets point forward like flatbuffers requires.
+ */
+class fb_builder_t {
+public:
+  struct field_t {
+    uint16_t id;
+    uint8_t size;
+  };
+
+  explicit fb_builder_t(std::string& buf) : buf_(buf) {
+  }
+
+  /**
+   * Writes a table with zeroed fields and returns its position, the
+   * position of every field goes to positions, in the order given
+   */
+  size_t table(std::initializer_list<field_t> fields, size_t* positions) {
+    uint16_t slots = 0;
+    size_t inline_size = 4;
+    uint8_t max_size = 4;
+    for (const auto& field : fields) {
+      slots = std::max<uint16_t>(slots, field.id + 1);
+      inline_size += field.size;
+      max_size = std::max(max_size, field.size);
+    }
+
+    // the largest fields go first so all of them are aligned
+    std::vector<field_t> order(fields);
+    std::stable_sort(order.begin(), order.end(),
+                     [](const auto& a, const auto& b) {
+                       return a.size > b.size;
+                     });
+    std::vector<uint16_t> vtable(slots, 0);
+    uint16_t offset = 4;
+    for (const auto& field : order) {
+      vtable[field.id] = offset;
+      offset += field.size;
+    }
+
+    pad(2);
+    auto vtable_pos = buf_.size();
+    put<uint16_t>(buf_, static_cast<uint16_t>(4 + 2 * slots));
+    put<uint16_t>(buf_, static_cast<uint16_t>(inline_size));
+    for (auto slot : vtable)
+      put<uint16_t>(buf_, slot);
+
+    // the soffset is followed by the 8 byte fields, if any
+    pad(max_size, 4);
+    auto table_pos = buf_.size();
+    put<int32_t>(buf_, static_cast<int32_t>(table_pos - vtable_pos));
+    buf_.append(inline_size - 4, '\0');
+    size_t i = 0;
+    for (const auto& field : fields)
+      positions[i++] = table_pos + vtable[field.id];
+    return table_pos;
+  }
+
+  size_t string(std::string_view value) {
+    pad(4);
+    auto pos = buf_.size();
+    put<uint32_t>(buf_, static_cast<uint32_t>(value.size()));
+    buf_.append(value);
+    buf_.push_back('\0');
+    return pos;
+  }
+
+  size_t vector(const void* data, size_t count, size_t element_size) {
+    pad(std::max<size_t>(element_size, 4), 4);
+    auto pos = buf_.size();
+    put<uint32_t>(buf_, static_cast<uint32_t>(count));
+    buf_.append(static_cast<const char*>(data), count * element_size);
+    return pos;
+  }
+
+  /**
+   * A vector of offsets to tables that are written afterwards, returns
+   * its position, element i is at pos + 4 + 4 * i
+   */
+  size_t offsets(size_t count) {
+    pad(4);
+    auto pos = buf_.size();
+    put<uint32_t>(buf_, static_cast<uint32_t>(count));
+    buf_.append(count * 4, '\0');
+    return pos;
+  }
+
+  template <typename T> void set(size_t pos, T value) {
+    std::memcpy(&buf_[pos], &value, sizeof(T));
+  }
+
+  void point(size_t pos, size_t target) {
+    set<uint32_t>(pos, static_cast<uint32_t>(target - pos));
+  }
+
+  void pad(size_t alignment, size_t extra = 0) {
+    while ((buf_.size() + extra) % alignment)
+      buf_.push_back('\0');
+  }
+
+  size_t size() const {
+    return buf_.size();
+  }
+
+private:
+  std::string& buf_;
+};
+
+/**
+ * Appends a size prefixed Feature with the geometry and properties
+ */
+void encode_feature(std::string& out,
+                    const std::vector<midgard::PointLL>& points,
+                    const std::string& properties) {
+  auto size_pos = out.size();
+  out.append(4, '\0');
+  std::string buf;
+  fb_builder_t fb(buf);
+  buf.append(4, '\0');
+  size_t feature_fields[2];
+  auto feature = fb.table({{0, 4}, {1, 4}}, feature_fields);
+  size_t xy_field;
+  auto geometry = fb.table({{1, 4}}, &xy_field);
+  fb.point(feature_fields[0], geometry);
+
+  std::vector<double> xy;
+  xy.reserve(points.size() * 2);
+  for (const auto& p : points) {
+    xy.push_back(p.lng());
+    xy.push_back(p.lat());
+  }
+  fb.point(xy_field,
+           fb.vector(xy.data(), points.size() * 2, sizeof(double)));
+  fb.point(feature_fields[1],
+           fb.vector(properties.data(), properties.size(), 1));
+  fb.set<uint32_t>(0, static_cast<uint32_t>(feature));
+
+  out.append(buf);
+  uint32_t size = static_cast<uint32_t>(buf.size());
+  std::memcpy(&out[size_pos], &size, 4);
+}
+
+std::string encode_header(const std::string& layer,
+                          fgb_geometry_type_t geometry_type,
+                          const std::vector<fgb_column_t>& columns,
+                          uint64_t count,
+                          const bbox_t& envelope) {
+  std::string buf;
+  fb_builder_t fb(buf);
+  buf.append(4, '\0');
+  // name, envelope, geometry_type, columns, features_count,
+  // index_node_size, crs
+  size_t f[7];
+  auto header = fb.table(
+      {{0, 4}, {1, 4}, {2, 1}, {7, 4}, {8, 8}, {9, 2}, {10, 4}}, f);
+  fb.set<uint32_t>(0, static_cast<uint32_t>(header));
+  fb.set<uint8_t>(f[2], static_cast<uint8_t>(geometry_type));
+  fb.set<uint64_t>(f[4], count);
+  fb.set<uint16_t>(f[5], count ? kNodeSize : 0);
+  fb.point(f[0], fb.string(layer));
+  if (count)
+    fb.point(f[1], fb.vector(envelope.data(), 4, sizeof(double)));
+  else
+    fb.point(f[1], fb.vector(nullptr, 0, sizeof(double)));
+
+  auto vector = fb.offsets(columns.size());
+  fb.point(f[3], vector);
+  for (size_t i = 0; i < columns.size(); ++i) {
+    size_t c[2];
+    auto column = fb.table({{0, 4}, {1, 1}}, c);
+    fb.point(vector + 4 + 4 * i, column);
+    fb.set<uint8_t>(c[1], static_cast<uint8_t>(columns[i].type));
+    fb.point(c[0], fb.string(columns[i].name));
+  }
+
+  size_t c[2];
+  auto crs = fb.table({{0, 4}, {1, 4}}, c);
+  fb.point(f[6], crs);
+  fb.set<int32_t>(c[1], 4326);
+  fb.point(c[0], fb.string("EPSG"));
+  fb.pad(8);
+  return buf;
+}
+
+/**
+ * Node counts of the packed R-tree's levels as [begin, end) node
+ * indices, leaves first, root last. The root is the first node.
+ */
+std::vector<std::pair<uint64_t, uint64_t>> level_bounds(uint64_t items) {
+  std::vector<uint64_t> counts{items};
+  uint64_t n = items, nodes = items;
+  do {
+    n = (n + kNodeSize - 1) / kNodeSize;
+    nodes += n;
+    counts.push_back(n);
+  } while (n != 1);
+
+  std::vector<std::pair<uint64_t, uint64_t>> bounds;
+  for (auto count : counts) {
+    bounds.emplace_back(nodes - count, nodes);
+    nodes -= count;
+  }
+  return bounds;
+}
+
+void put_node(std::string& out, const bbox_t& bbox, uint64_t offset) {
+  for (auto v : bbox)
+    put<double>(out, v);
+  put<uint64_t>(out, offset);
+}
+
+/**
+ * Sequential writes through a buffer, at an offset of the file
+ */
+struct file_writer_t {
+  file_writer_t(int fd, uint64_t offset) : fd(fd), offset(offset) {
+    buffer.reserve(kWriteBuffer);
+  }
+
+  void write(const std::string& data) {
+    buffer.append(data);
+    if (buffer.size() >= kWriteBuffer)
+      flush();
+  }
+
+  void flush() {
+    tools::write_at(fd, buffer.data(), buffer.size(), offset);
+    offset += buffer.size();
+    buffer.clear();
+  }
+
+  int fd;
+  uint64_t offset;
+  std::string buffer;
+};
+
+struct entry_t {
+  uint64_t key;
+  bbox_t bbox;
+  uint64_t offset;
+  uint32_t size;
+};
+
+// key, bbox and size of a record in a run file
+constexpr size_t kRecordHeader = 8 + 32 + 4;
+
+void put_record(std::string& out,
+                uint64_t key,
+                const bbox_t& bbox,
+                std::string_view bytes) {
+  put<uint64_t>(out, key);
+  for (auto v : bbox)
+    put<double>(out, v);
+  put<uint32_t>(out, static_cast<uint32_t>(bytes.size()));
+  out.append(bytes);
+}
+
+/**
+ * Closes the file descriptor it owns
+ */
+struct file_t {
+  file_t() = default;
+  file_t(file_t&& other) noexcept : fd(std::exchange(other.fd, -1)) {
+  }
+  file_t& operator=(file_t&&) = delete;
+  ~file_t() {
+    if (fd >= 0)
+      ::close(fd);
+  }
+
+  int fd{-1};
+};
+
+} // namespace
+
+namespace valhalla {
+
+namespace tools {
+
+void fgb_properties_t::add_int(uint16_t column, int32_t value) {
+  put<uint16_t>(bytes_, column);
+  put<int32_t>(bytes_, value);
+}
+
+void fgb_properties_t::add_long(uint16_t column, int64_t value) {
+  put<uint16_t>(bytes_, column);
+  put<int64_t>(bytes_, value);
+}
+
+void fgb_properties_t::add_double(uint16_t column, double value) {
+  put<uint16_t>(bytes_, column);
+  put<double>(bytes_, value);
+}
+
+void fgb_properties_t::add_string(uint16_t column,
+                                  std::string_view value) {
+  put<uint16_t>(bytes_, column);
+  put<uint32_t>(bytes_, static_cast<uint32_t>(value.size()));
+  bytes_.append(value);
+}
+
+struct fgb_writer_t::impl_t {
+  /**
+   * What one worker added since its last spill, the encoded features
+   * back to back and an entry per feature
+   */
+  struct buffer_t {
+    std::string data;
+    std::vector<entry_t> entries;
+    std::vector<std::string> runs;
+    uint64_t count{0};
+    bbox_t envelope{empty_bbox()};
+
+    size_t bytes() const {
+      return data.size() + entries.size() * sizeof(entry_t);
+    }
+
+    void sort() {
+      std::sort(entries.begin(), entries.end(),
+                [](const auto& a, const auto& b) {
+                  return a.key < b.key ||
+                         (a.key == b.key && a.offset < b.offset);
+                });
+    }
+  };
+
+  /**
+   * A sorted source of features for the merge, a spilled run or a
+   * buffer that's still in memory
+   */
+  struct run_t {
+    bool next() {
+      if (memory) {
+        if (index == memory->entries.size())
+          return false;
+        const auto& entry = memory->entries[index++];
+        key = entry.key;
+        bbox = entry.bbox;
+        bytes.assign(memory->data, entry.offset, entry.size);
+        return true;
+      }
+      char header[kRecordHeader];
+      if (!read(header, kRecordHeader))
+        return false;
+      uint32_t size;
+      std::memcpy(&key, header, 8);
+      std::memcpy(bbox.data(), header + 8, 32);
+      std::memcpy(&size, header + 40, 4);
+      bytes.resize(size);
+      if (!read(bytes.data(), size))
+        throw std::runtime_error("Truncated run " + path);
+      return true;
+    }
+
+    bool read(char* out, size_t size) {
+      while (size > 0) {
+        if (pos == len) {
+          if (file_offset == file_size)
+            return false;
+          len = std::min<uint64_t>(buffer.size(), file_size - file_offset);
+          read_at(file.fd, buffer.data(), len, file_offset);
+          file_offset += len;
+          pos = 0;
+        }
+        auto n = std::min(size, len - pos);
+        std::memcpy(out, buffer.data() + pos, n);
+        out += n;
+        pos += n;
+        size -= n;
+      }
+      return true;
+    }
+
+    std::string path;
+    file_t file;
+    uint64_t file_offset{0};
+    uint64_t file_size{0};
+    std::vector<char> buffer;
+    size_t pos{0};
+    size_t len{0};
+
+    const buffer_t* memory{nullptr};
+    size_t index{0};
+
+    uint64_t key{0};
+    bbox_t bbox{};
+    std::string bytes;
+  };
+
+  void spill(size_t worker) {
+    auto& buffer = buffers[worker];
+    trace::span_t span("spill", "io", "features", buffer.entries.size());
+    buffer.sort();
+    auto run = path + ".run-" + std::to_string(worker) + "-" +
+               std::to_string(buffer.runs.size());
+    int fd = ::open(run.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+    if (fd < 0)
+      throw std::runtime_error("Unable to open " + run);
+    buffer.runs.push_back(run);
+    try {
+      file_writer_t out(fd, 0);
+      std::string record;
+      for (const auto& entry : buffer.entries) {
+        record.clear();
+        put_record(record, entry.key, entry.bbox,
+                   std::string_view(buffer.data)
+                       .substr(entry.offset, entry.size));
+        out.write(record);
+      }
+      out.flush();
+    } catch (...) {
+      ::close(fd);
+      throw;
+    }
+    ::close(fd);
+    buffer.data.clear();
+    buffer.entries.clear();
+  }
+
+  /**
+   * Opens spilled runs for a merge, they share the memory budget for
+   * their read buffers
+   */
+  std::vector<run_t> open_runs(const std::vector<std::string>& paths) {
+    size_t read_buffer = std::max(
+        kMinReadBuffer, memory_budget / std::max<size_t>(paths.size(), 1));
+    std::vector<run_t> runs;
+    runs.reserve(paths.size());
+    for (const auto& path : paths) {
+      // the ones opened so far are closed if this throws
+      auto& run = runs.emplace_back();
+      run.path = path;
+      run.file.fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (run.file.fd < 0)
+        throw std::runtime_error("Unable to open " + path);
+      run.file_size = std::filesystem::file_size(path);
+      run.buffer.resize(read_buffer);
+    }
+    return runs;
+  }
+
+  /**
+   * Calls emit(run) for the current record of the run with the lowest
+   * key until all runs are exhausted
+   */
+  template <typename Fn>
+  static void merge(std::vector<run_t>& runs, Fn emit) {
+    using item_t = std::pair<uint64_t, size_t>;
+    std::priority_queue<item_t, std::vector<item_t>, std::greater<item_t>>
+        heap;
+    for (size_t i = 0; i < runs.size(); ++i) {
+      if (runs[i].next())
+        heap.emplace(runs[i].key, i);
+    }
+    while (!heap.empty()) {
+      auto i = heap.top().second;
+      heap.pop();
+      emit(runs[i]);
+      if (runs[i].next())
+        heap.emplace(runs[i].key, i);
+    }
+  }
+
+  /**
+   * Merges spilled runs into a new one and removes them
+   */
+  std::string merge_runs(const std::vector<std::string>& paths) {
+    trace::span_t span("merge_runs", "io", "runs", paths.size());
+    auto run = path + ".run-merged-" + std::to_string(merged.size());
+    merged.push_back(run);
+    auto runs = open_runs(paths);
+    int fd = ::open(run.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+    if (fd < 0)
+      throw std::runtime_error("Unable to open " + run);
+    try {
+      file_writer_t out(fd, 0);
+      std::string record;
+      merge(runs, [&](const run_t& source) {
+        record.clear();
+        put_record(record, source.key, source.bbox, source.bytes);
+        out.write(record);
+      });
+      out.flush();
+    } catch (...) {
+      ::close(fd);
+      throw;
+    }
+    if (::close(fd) != 0)
+      throw std::runtime_error("Unable to write " + run);
+    runs.clear();
+    for (const auto& path : paths)
+      std::filesystem::remove(path);
+    return run;
+  }
+
+  uint64_t finish();
+
+  std::string path;
+  std::string layer;
+  fgb_geometry_type_t geometry_type;
+  std::vector<fgb_column_t> columns;
+  size_t memory_budget;
+  size_t worker_budget;
+  std::vector<buffer_t> buffers;
+  // runs written by merge_runs
+  std::vector<std::string> merged;
+  bool finished{false};
+};
+
+uint64_t fgb_writer_t::impl_t::finish() {
+  uint64_t count = 0;
+  auto envelope = empty_bbox();
+  std::deque<std::string> spilled;
+  for (auto& buffer : buffers) {
+    count += buffer.count;
+    expand(envelope, buffer.envelope);
+    spilled.insert(spilled.end(), buffer.runs.begin(), buffer.runs.end());
+  }
+
+  // oldest first, so every feature is merged about the same number of
+  // times
+  while (spilled.size() > kMaxMergeWidth) {
+    std::vector<std::string> group(spilled.begin(),
+                                   spilled.begin() + kMaxMergeWidth);
+    spilled.erase(spilled.begin(), spilled.begin() + kMaxMergeWidth);
+    spilled.push_back(merge_runs(group));
+  }
+
+  std::vector<std::string> paths(spilled.begin(), spilled.end());
+  auto runs = open_runs(paths);
+  for (auto& buffer : buffers) {
+    if (!buffer.entries.empty()) {
+      buffer.sort();
+      auto& run = runs.emplace_back();
+      run.memory = &buffer;
+    }
+  }
+
+  auto header =
+      encode_header(layer, geometry_type, columns, count, envelope);
+  auto levels = count ? level_bounds(count) : decltype(level_bounds(0)){};
+  uint64_t node_count = levels.empty() ? 0 : levels.front().second;
+  uint64_t index_offset = sizeof(kMagic) + 4 + header.size();
+  uint64_t features_offset = index_offset + node_count * kNodeItemSize;
+
+  int fd =
+      ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    throw std::runtime_error("Unable to open " + path);
+  try {
+    std::string start(reinterpret_cast<const char*>(kMagic),
+                      sizeof(kMagic));
+    put<uint32_t>(start, static_cast<uint32_t>(header.size()));
+    start += header;
+    write_at(fd, start.data(), start.size(), 0);
+
+    // merge the runs, features go to the feature section and their nodes
+    // to the tree's leaves, both in Hilbert order
+    {
+      trace::span_t span("merge", "io", "runs", runs.size());
+      file_writer_t features(fd, features_offset);
+      uint64_t leaves_begin = levels.empty() ? 0 : levels.front().first;
+      file_writer_t leaves(fd,
+                           index_offset + leaves_begin * kNodeItemSize);
+      uint64_t offset = 0;
+      std::string node;
+      merge(runs, [&](const run_t& run) {
+        node.clear();
+        put_node(node, run.bbox, offset);
+        leaves.write(node);
+        features.write(run.bytes);
+        offset += run.bytes.size();
+      });
+      features.flush();
+      leaves.flush();
+    }
+
+    // every level of the tree from the one below, front to back
+    trace::span_t span("index", "io");
+    std::vector<char> children(kNodeSize * 4096 * kNodeItemSize);
+    for (size_t l = 0; l + 1 < levels.size(); ++l) {
+      file_writer_t parents(fd, index_offset +
+                                    levels[l + 1].first * kNodeItemSize);
+      std::string node;
+      for (auto pos = levels[l].first; pos < levels[l].second;) {
+        auto n = std::min<uint64_t>(children.size() / kNodeItemSize,
+                                    levels[l].second - pos);
+        read_at(fd, children.data(), n * kNodeItemSize,
+                index_offset + pos * kNodeItemSize);
+        for (uint64_t c = 0; c < n; c += kNodeSize) {
+          auto bbox = empty_bbox();
+          for (uint64_t k = c; k < std::min<uint64_t>(c + kNodeSize, n);
+               ++k) {
+            bbox_t child;
+            std::memcpy(child.data(), children.data() + k * kNodeItemSize,
+                        32);
+            expand(bbox, child);
+          }
+          node.clear();
+          put_node(node, bbox, pos + c);
+          parents.write(node);
+        }
+        pos += n;
+      }
+      parents.flush();
+    }
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  runs.clear();
+  for (const auto& path : paths)
+    std::filesystem::remove(path);
+  if (::close(fd) != 0)
+    throw std::runtime_error("Unable to write " + path);
+  finished = true;
+  return count;
+}
+
+fgb_writer_t::fgb_writer_t(const std::string& path,
+                           const std::string& layer,
+                           fgb_geometry_type_t geometry_type,
+                           std::vector<fgb_column_t> columns,
+                           size_t workers,
+                           size_t memory_budget)
+    : impl_(new impl_t) {
+  impl_->path = path;
+  impl_->layer = layer;
+  impl_->geometry_type = geometry_type;
+  impl_->columns = std::move(columns);
+  impl_->memory_budget = memory_budget;
+  impl_->worker_budget = memory_budget / std::max<size_t>(workers, 1);
+  impl_->buffers.resize(std::max<size_t>(workers, 1));
+}
+
+fgb_writer_t::~fgb_writer_t() {
+  if (impl_->finished)
+    return;
+  // whatever was spilled or merged before it failed
+  std::error_code ec;
+  for (const auto& buffer : impl_->buffers) {
+    for (const auto& run : buffer.runs)
+      std::filesystem::remove(run, ec);
+  }
+  for (const auto& run : impl_->merged)
+    std::filesystem::remove(run, ec);
+}
+
+void fgb_writer_t::add(size_t worker,
+                       const std::vector<midgard::PointLL>& points,
+                       const fgb_properties_t& properties) {
+  if (points.empty())
+    return;
+  auto& buffer = impl_->buffers[worker];
+  auto bbox = empty_bbox();
+  for (const auto& p : points)
+    expand(bbox, {p.lng(), p.lat(), p.lng(), p.lat()});
+  expand(buffer.envelope, bbox);
+
+  entry_t entry{hilbert_key(bbox), bbox, buffer.data.size(), 0};
+  encode_feature(buffer.data, points, properties.bytes());
+  entry.size = static_cast<uint32_t>(buffer.data.size() - entry.offset);
+  buffer.entries.push_back(entry);
+  buffer.count++;
+
+  if (buffer.bytes() >= impl_->worker_budget)
+    impl_->spill(worker);
+}
+
+uint64_t fgb_writer_t::finish() {
+  trace::span_t span("finish", "fgb");
+  auto count = impl_->finish();
+  LOG_INFO("Wrote " + std::to_string(count) + " features to " +
+           impl_->path);
+  return count;
+}
+
+} // namespace tools
+} // namespace valhalla
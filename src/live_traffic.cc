@@ -0,0 +1,192 @@
+#include "live_traffic.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <valhalla/midgard/logging.h>
+
+namespace {
+using namespace valhalla;
+
+// the bits above the tile id and level in a GraphId
+constexpr int kEdgeIdShift = 25;
+
+} // namespace
+
+namespace valhalla {
+
+namespace tools {
+
+live_speed_t decode_live_speed(const volatile baldr::TrafficSpeed& speed) {
+  live_speed_t live;
+  if (!speed.speed_valid())
+    return live;
+
+  live.valid = true;
+  live.overall_speed = speed.get_overall_speed();
+  const uint32_t congestion[3] = {speed.congestion1, speed.congestion2,
+                                  speed.congestion3};
+  for (size_t i = 0; i < 3; ++i) {
+    auto kph = speed.get_speed(i);
+    live.speeds[i] = kph == baldr::UNKNOWN_TRAFFIC_SPEED_KPH ? -1 : kph;
+    // 0 is unknown, 1 to 63 maps to 0 to 1
+    live.congestion[i] = congestion[i] ? (congestion[i] - 1) / 62.0 : -1;
+  }
+  live.breakpoints[0] = speed.breakpoint1 / 255.0;
+  live.breakpoints[1] = speed.breakpoint2 / 255.0;
+  return live;
+}
+
+live_speed_t decode_live_speed(uint64_t word) {
+  baldr::TrafficSpeed speed{};
+  static_assert(sizeof(speed) == sizeof(word));
+  std::memcpy(&speed, &word, sizeof(word));
+  return decode_live_speed(speed);
+}
+
+const std::vector<std::string>& live_speed_columns() {
+  static const std::vector<std::string> columns{
+      "live_speed",        "live_speed_0",      "live_speed_1",
+      "live_speed_2",      "live_congestion_0", "live_congestion_1",
+      "live_congestion_2", "live_breakpoint_0", "live_breakpoint_1"};
+  return columns;
+}
+
+double live_speed_value(const live_speed_t& speed, size_t column) {
+  if (column == 0)
+    return speed.overall_speed;
+  if (column < 4)
+    return speed.speeds[column - 1];
+  if (column < 7)
+    return speed.congestion[column - 4];
+  return speed.breakpoints[column - 7];
+}
+
+void append_live_speed_csv(std::string& row, const live_speed_t& speed) {
+  for (size_t i = 0; i < live_speed_columns().size(); ++i) {
+    row += ',';
+    auto value = live_speed_value(speed, i);
+    if (value < 0)
+      continue;
+    char buffer[32];
+    auto end = std::to_chars(buffer, buffer + sizeof(buffer), value,
+                             std::chars_format::fixed,
+                             i < kLiveSpeedIntColumns ? 0 : 3)
+                   .ptr;
+    row.append(buffer, end);
+  }
+}
+
+traffic_delta_t::traffic_delta_t(std::string path)
+    : path_(std::move(path)) {
+  map();
+}
+
+traffic_delta_t::~traffic_delta_t() {
+  unmap();
+}
+
+void traffic_delta_t::map() {
+  trace::span_t span("map", "io");
+  tiles_ = read_tile_index(path_);
+
+  int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("Unable to open traffic extract " + path_);
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Unable to stat traffic extract " + path_);
+  }
+  inode_ = st.st_ino;
+  size_ = st.st_size;
+  auto* data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    throw std::runtime_error("Unable to map traffic extract " + path_);
+  data_ = static_cast<const char*>(data);
+
+  starts_.assign(1, 0);
+  for (const auto& tile : tiles_) {
+    if (tile.size < sizeof(baldr::TrafficTileHeader) ||
+        tile.offset + tile.size > size_) {
+      unmap();
+      throw std::runtime_error("Traffic tile " +
+                               tile_file_path(tile.tile_id) +
+                               " is out of bounds in " + path_);
+    }
+    baldr::TrafficTileHeader header;
+    std::memcpy(&header, data_ + tile.offset, sizeof(header));
+    uint64_t words = (tile.size - sizeof(header)) / sizeof(uint64_t);
+    uint64_t count = std::min<uint64_t>(header.directed_edge_count, words);
+    starts_.push_back(starts_.back() + count);
+  }
+  // everything is new to the first poll
+  previous_.assign(starts_.back(), 0);
+  LOG_INFO("Mapped " + path_ + " with " + std::to_string(tiles_.size()) +
+           " tiles and " + std::to_string(previous_.size()) + " edges");
+}
+
+void traffic_delta_t::unmap() {
+  if (data_)
+    ::munmap(const_cast<char*>(data_), size_);
+  data_ = nullptr;
+}
+
+size_t traffic_delta_t::poll(executor_t& executor, std::string& rows) {
+  // a new extract is renamed over the old one, the feed updates the words
+  // in place
+  struct stat st;
+  if (::stat(path_.c_str(), &st) == 0 &&
+      (static_cast<uint64_t>(st.st_ino) != inode_ ||
+       static_cast<uint64_t>(st.st_size) != size_)) {
+    LOG_INFO(path_ + " was replaced, the next rows are a full snapshot");
+    unmap();
+    map();
+  }
+
+  trace::span_t span("poll", "traffic");
+  std::vector<std::string> tile_rows(tiles_.size());
+  std::atomic<size_t> changed{0};
+  executor.for_each(tiles_.size(), [&](size_t, size_t i) {
+    const auto& tile = tiles_[i];
+    auto count = starts_[i + 1] - starts_[i];
+    const auto* words = reinterpret_cast<const uint64_t*>(
+        data_ + tile.offset + sizeof(baldr::TrafficTileHeader));
+    auto* previous = previous_.data() + starts_[i];
+    // most tiles don't change from one poll to the next
+    if (std::memcmp(words, previous, count * sizeof(uint64_t)) == 0)
+      return;
+
+    auto& out = tile_rows[i];
+    size_t tile_changed = 0;
+    for (uint64_t e = 0; e < count; ++e) {
+      // the feed writes every word as a whole
+      auto word = __atomic_load_n(words + e, __ATOMIC_RELAXED);
+      if (word == previous[e])
+        continue;
+      previous[e] = word;
+      out += std::to_string(tile.tile_id | (e << kEdgeIdShift));
+      append_live_speed_csv(out, decode_live_speed(word));
+      out += '\n';
+      tile_changed++;
+    }
+    changed += tile_changed;
+  });
+
+  for (const auto& tile : tile_rows)
+    rows += tile;
+  return changed;
+}
+
+} // namespace tools
+} // namespace valhalla
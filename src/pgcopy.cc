@@ -0,0 +1,202 @@
+#include "pgcopy.h"
+
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// the 11 byte signature includes the terminating \0
+constexpr char kSignature[] = "PGCOPY\n\377\r\n";
+constexpr uint32_t kSrid = 4326;
+constexpr uint32_t kEwkbSridFlag = 0x20000000;
+constexpr uint32_t kWkbPoint = 1;
+constexpr uint32_t kWkbLineString = 2;
+
+template <typename T> void put_be(std::string& out, T value) {
+  auto bits = static_cast<std::make_unsigned_t<T>>(value);
+  for (int shift = (sizeof(T) - 1) * 8; shift >= 0; shift -= 8)
+    out.push_back(static_cast<char>(bits >> shift));
+}
+
+// WKB is written little endian, it says so in its first byte
+template <typename T> void put_le(std::string& out, T value) {
+  uint64_t bits;
+  if constexpr (std::is_floating_point_v<T>)
+    bits = std::bit_cast<uint64_t>(value);
+  else
+    bits = value;
+  for (size_t i = 0; i < sizeof(T); ++i)
+    out.push_back(static_cast<char>(bits >> (i * 8)));
+}
+
+void put_ewkb_header(std::string& out, uint32_t type) {
+  out.push_back(1);
+  put_le<uint32_t>(out, type | kEwkbSridFlag);
+  put_le<uint32_t>(out, kSrid);
+}
+
+} // namespace
+
+namespace valhalla {
+
+namespace tools {
+
+void pgcopy_encoder_t::begin_row(uint16_t fields) {
+  put_be<int16_t>(out_, fields);
+}
+
+void pgcopy_encoder_t::add_null() {
+  put_be<int32_t>(out_, -1);
+}
+
+void pgcopy_encoder_t::add_bool(bool value) {
+  put_be<int32_t>(out_, 1);
+  out_.push_back(value ? 1 : 0);
+}
+
+void pgcopy_encoder_t::add_int16(int16_t value) {
+  put_be<int32_t>(out_, sizeof(value));
+  put_be(out_, value);
+}
+
+void pgcopy_encoder_t::add_int32(int32_t value) {
+  put_be<int32_t>(out_, sizeof(value));
+  put_be(out_, value);
+}
+
+void pgcopy_encoder_t::add_int64(int64_t value) {
+  put_be<int32_t>(out_, sizeof(value));
+  put_be(out_, value);
+}
+
+void pgcopy_encoder_t::add_float8(double value) {
+  put_be<int32_t>(out_, sizeof(value));
+  put_be(out_, std::bit_cast<uint64_t>(value));
+}
+
+void pgcopy_encoder_t::add_text(std::string_view value) {
+  put_be<int32_t>(out_, static_cast<int32_t>(value.size()));
+  out_.append(value);
+}
+
+void pgcopy_encoder_t::add_point(const midgard::PointLL& point) {
+  put_be<int32_t>(out_, 1 + 4 + 4 + 16);
+  put_ewkb_header(out_, kWkbPoint);
+  put_le<double>(out_, point.lng());
+  put_le<double>(out_, point.lat());
+}
+
+void pgcopy_encoder_t::add_linestring(
+    const std::vector<midgard::PointLL>& points) {
+  put_be<int32_t>(out_,
+                  static_cast<int32_t>(1 + 4 + 4 + 4 + 16 * points.size()));
+  put_ewkb_header(out_, kWkbLineString);
+  put_le<uint32_t>(out_, static_cast<uint32_t>(points.size()));
+  for (const auto& point : points) {
+    put_le<double>(out_, point.lng());
+    put_le<double>(out_, point.lat());
+  }
+}
+
+pgcopy_sink_t::pgcopy_sink_t(const std::string& path, size_t max_queued)
+    : path_(path), max_queued_(max_queued) {
+  // O_TRUNC is ignored for named pipes, opening one blocks until the
+  // reader is there
+  fd_ = path == "-" ? ::dup(STDOUT_FILENO)
+                    : ::open(path.c_str(),
+                             O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0)
+    throw std::runtime_error("Unable to open " + path);
+
+  // no flags, no header extension
+  std::string header(kSignature, sizeof(kSignature));
+  put_be<int32_t>(header, 0);
+  put_be<int32_t>(header, 0);
+  write_all(header);
+}
+
+pgcopy_sink_t::~pgcopy_sink_t() {
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+void pgcopy_sink_t::write_all(const std::string& data) {
+  const char* p = data.data();
+  size_t left = data.size();
+  while (left > 0) {
+    auto written = ::write(fd_, p, left);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      throw std::runtime_error("Unable to write to " + path_ + ": " +
+                               std::strerror(errno));
+    p += written;
+    left -= written;
+  }
+  bytes_ += data.size();
+}
+
+void pgcopy_sink_t::write(size_t sequence, std::string&& rows) {
+  std::unique_lock l(lock_);
+  written_.wait(l, [&]() {
+    return aborted_ || sequence == next_ || queued_bytes_ < max_queued_;
+  });
+  if (aborted_)
+    throw std::runtime_error("Writing to " + path_ + " was aborted");
+  queued_bytes_ += rows.size();
+  queued_.emplace(sequence, std::move(rows));
+  // somebody else is writing and picks this up when done
+  if (writing_)
+    return;
+
+  writing_ = true;
+  while (!queued_.empty() && queued_.begin()->first == next_ && !aborted_) {
+    auto chunk = std::move(queued_.begin()->second);
+    queued_.erase(queued_.begin());
+    l.unlock();
+    try {
+      write_all(chunk);
+    } catch (...) {
+      l.lock();
+      writing_ = false;
+      aborted_ = true;
+      written_.notify_all();
+      throw;
+    }
+    l.lock();
+    queued_bytes_ -= chunk.size();
+    next_++;
+    written_.notify_all();
+  }
+  writing_ = false;
+}
+
+void pgcopy_sink_t::abort() {
+  std::lock_guard l(lock_);
+  aborted_ = true;
+  written_.notify_all();
+}
+
+void pgcopy_sink_t::finish() {
+  std::lock_guard l(lock_);
+  if (!queued_.empty())
+    throw std::runtime_error("Chunks missing before " +
+                             std::to_string(queued_.begin()->first) +
+                             " in " + path_);
+  std::string trailer;
+  put_be<int16_t>(trailer, -1);
+  write_all(trailer);
+  if (::close(fd_) != 0) {
+    fd_ = -1;
+    throw std::runtime_error("Unable to close " + path_);
+  }
+  fd_ = -1;
+}
+
+} // namespace tools
+} // namespace valhalla
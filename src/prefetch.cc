@@ -0,0 +1,332 @@
+#include "prefetch.h"
+#include "tile_extract.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef VALHALLA_TOOLS_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include <valhalla/midgard/logging.h>
+
+namespace {
+using namespace valhalla;
+
+constexpr size_t kDefaultDepth = 4;
+#ifdef VALHALLA_TOOLS_HAVE_LIBURING
+// reads are split into pieces of at most this size which all land in the
+// same scratch buffer, nobody ever looks at what's in there
+constexpr size_t kChunkSize = 1 << 20;
+constexpr unsigned kRingEntries = 256;
+#endif
+
+enum class state_t : uint8_t { kPending, kLoading, kLoaded };
+
+struct location_t {
+  int fd;
+  uint64_t offset;
+  uint64_t size;
+  // tiles of a tile dir have their own file, the extract is shared
+  bool owned;
+};
+
+void release(const location_t& location) {
+  if (location.owned)
+    ::close(location.fd);
+}
+
+} // namespace
+
+namespace valhalla {
+
+namespace tools {
+
+struct tile_prefetcher_t::impl_t {
+  std::mutex lock;
+  std::vector<uint32_t> tiles;
+  std::vector<state_t> states;
+  size_t depth{0};
+  size_t window{0};
+  // the next tile to prefetch
+  size_t next{0};
+
+  std::string tile_dir;
+  int extract_fd{-1};
+  std::unordered_map<uint32_t, tile_index_entry_t> index;
+
+  uint64_t processed{0};
+  uint64_t hits{0};
+  // whether the residency of fadvised tiles can be checked
+  bool probe{true};
+
+#ifdef VALHALLA_TOOLS_HAVE_LIBURING
+  bool uring{false};
+  io_uring ring;
+  std::unique_ptr<char[]> scratch;
+  // reads submitted and not reaped yet
+  size_t inflight{0};
+  std::vector<uint16_t> pending_reads;
+  std::unordered_map<size_t, location_t> open_tiles;
+#endif
+
+  bool locate(size_t i, location_t& location) const {
+    if (extract_fd >= 0) {
+      auto found = index.find(tiles[i]);
+      if (found == index.end())
+        return false;
+      location = {extract_fd, found->second.offset, found->second.size,
+                  false};
+      return true;
+    }
+
+    auto path = std::filesystem::path(tile_dir) / tile_file_path(tiles[i]);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      return false;
+    }
+    location = {fd, 0, static_cast<uint64_t>(st.st_size), true};
+    return true;
+  }
+
+  /**
+   * Starts loading tile i, false if there's no room for it right now
+   */
+  bool prefetch(size_t i) {
+    location_t location;
+    if (!locate(i, location)) {
+      // missing tiles are the reader's problem
+      states[i] = state_t::kLoaded;
+      return true;
+    }
+
+#ifdef VALHALLA_TOOLS_HAVE_LIBURING
+    size_t chunks =
+        std::max<size_t>(1, (location.size + kChunkSize - 1) / kChunkSize);
+    // a tile too big for the whole ring gets the readahead instead
+    if (uring && chunks <= kRingEntries) {
+      if (io_uring_sq_space_left(&ring) < chunks)
+        io_uring_submit(&ring);
+      if (inflight + chunks > kRingEntries ||
+          io_uring_sq_space_left(&ring) < chunks) {
+        release(location);
+        return false;
+      }
+      for (size_t c = 0; c < chunks; ++c) {
+        auto offset = c * kChunkSize;
+        auto* sqe = io_uring_get_sqe(&ring);
+        io_uring_prep_read(sqe, location.fd, scratch.get(),
+                           std::min<uint64_t>(kChunkSize,
+                                              location.size - offset),
+                           location.offset + offset);
+        io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(i));
+      }
+      inflight += chunks;
+      pending_reads[i] = static_cast<uint16_t>(chunks);
+      open_tiles.emplace(i, location);
+      states[i] = state_t::kLoading;
+      return true;
+    }
+#endif
+
+    ::posix_fadvise(location.fd, location.offset, location.size,
+                    POSIX_FADV_WILLNEED);
+    release(location);
+    states[i] = state_t::kLoading;
+    return true;
+  }
+
+  /**
+   * Prefetches the tiles of the window starting at begin
+   */
+  void fill(size_t begin) {
+    trace::span_t span("prefetch", "io");
+    auto end = std::min(tiles.size(), begin + window);
+    // the workers overtook us, no point in loading those anymore
+    next = std::max(next, begin);
+    while (next < end && prefetch(next))
+      ++next;
+#ifdef VALHALLA_TOOLS_HAVE_LIBURING
+    if (uring)
+      io_uring_submit(&ring);
+#endif
+  }
+
+#ifdef VALHALLA_TOOLS_HAVE_LIBURING
+  void complete(io_uring_cqe* cqe) {
+    auto i = reinterpret_cast<size_t>(io_uring_cqe_get_data(cqe));
+    io_uring_cqe_seen(&ring, cqe);
+    --inflight;
+    if (--pending_reads[i] == 0) {
+      states[i] = state_t::kLoaded;
+      auto found = open_tiles.find(i);
+      release(found->second);
+      open_tiles.erase(found);
+    }
+  }
+
+  void reap() {
+    io_uring_cqe* cqe;
+    while (io_uring_peek_cqe(&ring, &cqe) == 0)
+      complete(cqe);
+  }
+#endif
+
+  /**
+   * Whether the last byte of an fadvised tile is in the page cache, the
+   * readahead goes front to back
+   */
+  bool resident(size_t i) {
+#ifdef RWF_NOWAIT
+    location_t location;
+    if (!probe || !locate(i, location))
+      return false;
+    char byte;
+    iovec iov{&byte, 1};
+    auto last = location.offset + std::max<uint64_t>(location.size, 1) - 1;
+    auto read = ::preadv2(location.fd, &iov, 1, last, RWF_NOWAIT);
+    auto error = errno;
+    release(location);
+    if (read < 0 && error != EAGAIN)
+      probe = false;
+    return read == 1;
+#else
+    probe = false;
+    (void)i;
+    return false;
+#endif
+  }
+
+  bool loaded(size_t i) {
+#ifdef VALHALLA_TOOLS_HAVE_LIBURING
+    if (uring) {
+      reap();
+      // fadvised tiles are probed like without the ring
+      if (states[i] != state_t::kLoading || open_tiles.count(i))
+        return states[i] == state_t::kLoaded;
+    }
+#endif
+    if (states[i] == state_t::kLoading && !resident(i))
+      return false;
+    return states[i] != state_t::kPending;
+  }
+};
+
+tile_prefetcher_t::tile_prefetcher_t(
+    const boost::property_tree::ptree& config,
+    const std::vector<baldr::GraphId>& tiles)
+    : impl_(std::make_unique<impl_t>()) {
+  auto& p = *impl_;
+  p.depth = config.get<size_t>("mjolnir.prefetch_depth", kDefaultDepth);
+  p.window = p.depth * std::max(config.get<size_t>("mjolnir.concurrency", 1),
+                                size_t(1));
+  if (!p.window || tiles.empty())
+    return;
+
+  p.tiles.reserve(tiles.size());
+  for (const auto& tile : tiles)
+    p.tiles.push_back(static_cast<uint32_t>(tile.Tile_Base().value));
+  p.states.assign(tiles.size(), state_t::kPending);
+
+  // the reader prefers the extract, so do we
+  auto extract = config.get<std::string>("mjolnir.tile_extract", "");
+  if (!extract.empty() && std::filesystem::exists(extract)) {
+    try {
+      for (const auto& entry : read_tile_index(extract))
+        p.index.emplace(entry.tile_id, entry);
+      p.extract_fd = ::open(extract.c_str(), O_RDONLY | O_CLOEXEC);
+    } catch (const std::exception& e) {
+      LOG_WARN("Not prefetching from " + extract + ": " + e.what());
+      p.index.clear();
+    }
+  }
+  p.tile_dir = config.get<std::string>("mjolnir.tile_dir", "");
+
+#ifdef VALHALLA_TOOLS_HAVE_LIBURING
+  int ret = io_uring_queue_init(kRingEntries, &p.ring, 0);
+  if (ret == 0) {
+    p.uring = true;
+    p.scratch = std::make_unique<char[]>(kChunkSize);
+    p.pending_reads.assign(tiles.size(), 0);
+  } else {
+    LOG_WARN("io_uring not available (" + std::string(strerror(-ret)) +
+             "), prefetching with posix_fadvise");
+  }
+#endif
+
+  std::lock_guard l(p.lock);
+  p.fill(0);
+}
+
+tile_prefetcher_t::~tile_prefetcher_t() {
+  auto& p = *impl_;
+#ifdef VALHALLA_TOOLS_HAVE_LIBURING
+  if (p.uring) {
+    // the kernel might still be writing into the scratch buffer
+    io_uring_cqe* cqe;
+    while (p.inflight && io_uring_wait_cqe(&p.ring, &cqe) == 0)
+      p.complete(cqe);
+    io_uring_queue_exit(&p.ring);
+    for (const auto& tile : p.open_tiles)
+      release(tile.second);
+  }
+#endif
+  if (p.extract_fd >= 0)
+    ::close(p.extract_fd);
+}
+
+void tile_prefetcher_t::advance(size_t index) {
+  auto& p = *impl_;
+  if (!p.window)
+    return;
+
+  std::lock_guard l(p.lock);
+  p.processed++;
+  p.hits += p.loaded(index);
+  p.fill(index + 1);
+}
+
+void tile_prefetcher_t::log_stats() const {
+  const auto& p = *impl_;
+  if (!p.window)
+    return;
+
+  std::string method = "posix_fadvise";
+  bool known = p.probe;
+#ifdef VALHALLA_TOOLS_HAVE_LIBURING
+  if (p.uring) {
+    method = "io_uring";
+    known = true;
+  }
+#endif
+  std::stringstream ss;
+  ss << "Prefetched with " << method << ", depth " << p.depth << ": ";
+  if (!known) {
+    ss << "hit rate unknown, the file system doesn't support RWF_NOWAIT";
+  } else {
+    ss << p.hits << " of " << p.processed << " tiles loaded in time ("
+       << std::fixed << std::setprecision(1)
+       << (p.processed ? 100.0 * p.hits / p.processed : 0.0) << "%)";
+  }
+  LOG_INFO(ss.str());
+}
+
+} // namespace tools
+} // namespace valhalla
@@ -1,13 +1,22 @@
 #include "rest.h"
+#include "checksum.h"
+#include "extract_reader.h"
+#include "trace.h"
+#include "way_index.h"
+#include <boost/algorithm/string.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <csignal>
 #include <prime_server/http_protocol.hpp>
+#include <pthread.h>
 #include <string>
 #include <valhalla/baldr/rapidjson_utils.h>
 
 namespace {
 
 using namespace valhalla::baldr;
+namespace trace = valhalla::tools::trace;
 
-enum class ObjectType : uint8_t { EDGE = 0, NODE = 1 };
+enum class ObjectType : uint8_t { EDGE = 0, NODE = 1, WAY = 2 };
 
 bool object_type_from_string(const std::string& object_type_str,
                              ObjectType* object_type) {
@@ -17,6 +26,7 @@ bool object_type_from_string(const std::string& object_type_str,
   static std::unordered_map<std::string, ObjectType> types{
       {"edge", ObjectType::EDGE},
       {"node", ObjectType::NODE},
+      {"way", ObjectType::WAY},
   };
 
   auto it = types.find(object_type_str);
@@ -86,13 +96,23 @@ void serialize_traffic_speed(
     writer.set_precision(3);
   }
 }
+
+} // namespace
+
+namespace tools {
+
 std::string serialize_edge(valhalla::baldr::GraphReader& reader,
                            const valhalla::baldr::GraphId id) {
   rapidjson::writer_wrapper_t writer;
   writer.start_object();
   try {
     // get the osm way id
-    auto tile = reader.GetGraphTile(id);
+    graph_tile_ptr tile;
+    {
+      trace::span_t span("load", "io", "tile_id", id.Tile_Base().value);
+      tile = reader.GetGraphTile(id);
+    }
+    trace::span_t span("serialize", "rest", "edge_id", id.value);
     auto* directed_edge = tile->directededge(id.id());
     auto edge_info = tile->edgeinfo(directed_edge);
     // they want MOAR!
@@ -150,8 +170,44 @@ std::string serialize_edge(valhalla::baldr::GraphReader& reader,
   return writer.get_buffer();
 }
 
-std::string answer(const prime_server::http_request_t& request,
-                   valhalla::baldr::GraphReader& reader) {
+} // namespace tools
+
+namespace {
+
+/**
+ * All directed edges of an OSM way, looked up in the way index
+ */
+std::string serialize_way(valhalla::baldr::GraphReader& reader,
+                          const valhalla::tools::way_index_t* way_index,
+                          uint64_t way_id) {
+  if (!way_index)
+    throw std::runtime_error("No way index configured");
+
+  std::vector<GraphId> edges;
+  {
+    trace::span_t span("lookup", "rest", "way_id", way_id);
+    edges = way_index->find(way_id);
+  }
+  std::string json = "{\"way_id\":" + std::to_string(way_id) + ",\"edges\":[";
+  for (size_t i = 0; i < edges.size(); ++i) {
+    if (i)
+      json += ',';
+    json += tools::serialize_edge(reader, edges[i]);
+  }
+  json += "]}";
+  return json;
+}
+
+/**
+ * The object a request asks for, from its path /<type>/<id>
+ */
+struct object_t {
+  ObjectType type;
+  std::string type_str;
+  uint64_t id;
+};
+
+object_t parse_path(const prime_server::http_request_t& request) {
   if (request.path.empty() || request.path.size() <= 1)
     throw std::runtime_error("Path cannot be empty");
 
@@ -163,28 +219,57 @@ std::string answer(const prime_server::http_request_t& request,
   if (idx == std::string::npos)
     throw std::runtime_error("Invalid path: " + request.path);
 
-  std::string obj_type = request.path.substr(1, idx - 1);
+  object_t object;
+  object.type_str = request.path.substr(1, idx - 1);
 
-  ObjectType type;
-  if (!object_type_from_string(obj_type, &type))
-    std::runtime_error("Invalid object type: " + obj_type);
+  if (!object_type_from_string(object.type_str, &object.type))
+    throw std::runtime_error("Invalid object type: " + object.type_str);
 
   std::string id_str =
       request.path.substr(idx + 1, request.path.size() - 1);
-  uint64_t id = 0;
   try {
-    id = stoull(id_str);
+    object.id = stoull(id_str);
   } catch (std::exception& e) {
     throw std::runtime_error("Invalid ID: " + id_str + "; " + e.what());
   }
+  return object;
+}
 
-  switch (type) {
+std::string answer(const object_t& object,
+                   valhalla::baldr::GraphReader& reader,
+                   const valhalla::tools::way_index_t* way_index) {
+  switch (object.type) {
     case ObjectType::EDGE:
-      return serialize_edge(reader, valhalla::baldr::GraphId(id));
+      return tools::serialize_edge(reader,
+                                   valhalla::baldr::GraphId(object.id));
+    case ObjectType::WAY:
+      return serialize_way(reader, way_index, object.id);
     default:
-      return "Not yet implemented: " + obj_type;
+      return "Not yet implemented: " + object.type_str;
   }
 }
+
+/**
+ * Whether the request's If-None-Match lists the etag, weak or not
+ */
+bool if_none_match(const prime_server::http_request_t& request,
+                   const std::string& etag) {
+  for (const auto& header : request.headers) {
+    if (!boost::iequals(header.first, "If-None-Match"))
+      continue;
+    std::vector<std::string> tags;
+    boost::split(tags, header.second, boost::is_any_of(","));
+    for (auto& tag : tags) {
+      boost::trim(tag);
+      if (tag.starts_with("W/"))
+        tag.erase(0, 2);
+      if (tag == "*" || tag == etag)
+        return true;
+    }
+  }
+  return false;
+}
+
 using namespace prime_server;
 using namespace tools;
 worker_t::result_t
@@ -209,11 +294,181 @@ serialize_error(const std::exception& exception,
   return result;
 }
 
+worker_t::result_t
+not_modified(prime_server::http_request_info_t& request_info,
+             headers_t headers) {
+  headers.insert(CORS);
+  worker_t::result_t result{false, std::list<std::string>(), ""};
+  http_response_t response(304, "Not Modified", "", headers);
+  response.from_info(request_info);
+  result.messages.emplace_back(response.to_string());
+  return result;
+}
+
+worker_t::result_t
+accepted(prime_server::http_request_info_t& request_info,
+         uint64_t generation) {
+  worker_t::result_t result{false, std::list<std::string>(), ""};
+  http_response_t response(202, "Accepted",
+                           "{\"generation\":" +
+                               std::to_string(generation) + "}",
+                           headers_t{CORS, prime_server::http::JSON_MIME});
+  response.from_info(request_info);
+  result.messages.emplace_back(response.to_string());
+  return result;
+}
+
 } // namespace
 
 namespace tools {
-rest_worker_t::rest_worker_t(const boost::property_tree::ptree& pt)
-    : reader(pt.get_child("mjolnir")) {
+std::string edge_etag_t::operator()(valhalla::baldr::GraphReader& reader,
+                                    const valhalla::baldr::GraphId id) {
+  auto tile = reader.GetGraphTile(id);
+  if (!tile)
+    throw std::runtime_error("Unable to serialize edge: no tile for " +
+                             std::to_string(id));
+
+  auto it = tile_checksums_.find(id.Tile_Base().value);
+  if (it == tile_checksums_.end()) {
+    trace::span_t span("checksum", "rest", "tile_id",
+                       id.Tile_Base().value);
+    auto sum = valhalla::tools::checksum(tile->header(),
+                                         tile->header()->end_offset());
+    it = tile_checksums_.emplace(id.Tile_Base().value, sum).first;
+  }
+
+  // the traffic speed is a single 64 bit word the traffic publisher
+  // overwrites in place, one read sees either the old or the new value
+  const volatile auto& traffic =
+      tile->trafficspeed(tile->directededge(id.id()));
+  uint64_t live = *reinterpret_cast<const volatile uint64_t*>(&traffic);
+
+  return absl::StrFormat("\"%x-%x-%x\"", tile->header()->dataset_id(),
+                         it->second, live);
+}
+
+graph_t::graph_t(const boost::property_tree::ptree& pt,
+                 uint64_t generation)
+    : reader(
+          std::make_unique<valhalla::tools::extract_reader_t>(
+              pt.get_child("mjolnir"))),
+      generation(generation) {
+  if (reader->GetTileSet().empty())
+    throw std::runtime_error("No tiles in the graph");
+
+  auto way_index_path = pt.get<std::string>("mjolnir.way_index", "");
+  if (!way_index_path.empty()) {
+    try {
+      way_index =
+          std::make_unique<valhalla::tools::way_index_t>(way_index_path);
+      LOG_INFO("Loaded way index with " +
+               std::to_string(way_index->way_count()) + " ways");
+    } catch (const std::exception& e) {
+      LOG_WARN(std::string(e.what()) + ", /way is disabled");
+    }
+  }
+}
+
+graph_handle_t::graph_handle_t(const boost::property_tree::ptree& pt,
+                               std::string config_path)
+    : pt_(pt), config_path_(std::move(config_path)),
+      graph_(std::make_shared<graph_t>(pt, 0)) {
+  thread_ = std::thread(&graph_handle_t::run, this);
+}
+
+graph_handle_t::~graph_handle_t() {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  thread_.join();
+  // wakes the sigwait up to see stop_
+  if (hangup_thread_.joinable()) {
+    pthread_kill(hangup_thread_.native_handle(), SIGHUP);
+    hangup_thread_.join();
+  }
+}
+
+uint64_t graph_handle_t::reload() {
+  uint64_t generation;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    // requests while one is pending are answered by that one
+    if (!pending_) {
+      pending_ = true;
+      ++requested_;
+    }
+    generation = requested_;
+  }
+  wake_.notify_one();
+  return generation;
+}
+
+void graph_handle_t::reload_on_hangup() {
+  hangup_thread_ = std::thread([this]() {
+    sigset_t hangup;
+    sigemptyset(&hangup);
+    sigaddset(&hangup, SIGHUP);
+    int signal;
+    while (sigwait(&hangup, &signal) == 0) {
+      {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (stop_)
+          return;
+      }
+      LOG_INFO("Got SIGHUP, reloading the graph");
+      reload();
+    }
+  });
+}
+
+void graph_handle_t::run() {
+  std::unique_lock<std::mutex> lock(lock_);
+  while (true) {
+    wake_.wait(lock, [&] { return pending_ || stop_; });
+    if (stop_)
+      return;
+    pending_ = false;
+    auto generation = requested_;
+    lock.unlock();
+
+    // requests keep using the current graph while the new one opens
+    std::shared_ptr<graph_t> graph;
+    try {
+      trace::span_t span("reload", "rest", "generation", generation);
+      auto pt = pt_;
+      if (!config_path_.empty()) {
+        pt.clear();
+        boost::property_tree::read_json(config_path_, pt);
+      }
+      graph = std::make_shared<graph_t>(pt, generation);
+    } catch (const std::exception& e) {
+      // only this thread swaps graph_
+      LOG_ERROR("Failed to reload the graph, keeping generation " +
+                std::to_string(graph_->generation) + ": " + e.what());
+    }
+
+    lock.lock();
+    if (graph) {
+      graph_.swap(graph);
+      LOG_INFO("Reloaded the graph, now at generation " +
+               std::to_string(generation));
+    }
+    // the old graph goes now or with the last request that holds it
+    lock.unlock();
+    graph.reset();
+    lock.lock();
+  }
+}
+
+rest_worker_t::rest_worker_t(const boost::property_tree::ptree& pt,
+                             graph_handle_t& graph)
+    : graph(graph) {
+  auto max_age = pt.get<unsigned int>("httpd.service.edge_max_age", 0U);
+  edge_cache_control = "public, max-age=" + std::to_string(max_age) +
+                       (max_age ? "" : ", must-revalidate");
+  admin_reload = pt.get<bool>("httpd.service.admin_reload", false);
 
   started();
 }
@@ -231,20 +486,52 @@ rest_worker_t::work(const std::list<zmq::message_t>& job,
   auto& info =
       *static_cast<prime_server::http_request_info_t*>(request_info);
   LOG_INFO("Got Rest Request " + std::to_string(info.id));
+  trace::span_t span("request", "rest", "request_id", info.id);
   prime_server::worker_t::result_t result{false, {}, {}};
   try {
 
     // request parsing
-    auto http_request =
-        prime_server::http_request_t::from_string(static_cast<const char*>(
-                                                      job.front().data()),
-                                                  job.front().size());
+    prime_server::http_request_t http_request;
+    {
+      trace::span_t parse("parse", "rest");
+      http_request = prime_server::http_request_t::
+          from_string(static_cast<const char*>(job.front().data()),
+                      job.front().size());
+    }
 
-    result = to_response(answer(http_request, reader), info);
+    if (http_request.path == "/admin/reload") {
+      if (!admin_reload)
+        throw std::runtime_error("Reloading is disabled, see "
+                                 "httpd.service.admin_reload");
+      if (http_request.method != prime_server::method_t::POST)
+        throw std::runtime_error("Only POST requests are allowed");
+      return accepted(info, graph.reload());
+    }
 
     if (http_request.method != prime_server::method_t::GET) {
       throw std::runtime_error("Only GET requests are allowed");
     }
+
+    // the graph stays open until this request is done, even if a reload
+    // swaps in a new one meanwhile
+    auto current = graph.get();
+    auto& reader = *current->reader;
+    auto* way_index = current->way_index.get();
+    auto object = parse_path(http_request);
+    if (object.type == ObjectType::EDGE) {
+      // answering a poll for an unchanged edge takes a header comparison
+      prime_server::headers_t headers{
+          {"ETag", current->edge_etag(
+                       reader, valhalla::baldr::GraphId(object.id))},
+          {"Cache-Control", edge_cache_control}};
+      if (if_none_match(http_request, headers["ETag"]))
+        result = not_modified(info, std::move(headers));
+      else
+        result = to_response(answer(object, reader, way_index), info,
+                             std::move(headers));
+    } else {
+      result = to_response(answer(object, reader, way_index), info);
+    }
   } catch (const std::exception& e) {
     LOG_WARN("400::" + std::string(e.what()) +
              " request_id=" + std::to_string(info.id));
@@ -257,7 +544,8 @@ rest_worker_t::work(const std::list<zmq::message_t>& job,
 void rest_worker_t::cleanup() {
 }
 
-void run_service(const boost::property_tree::ptree& pt) {
+void run_service(const boost::property_tree::ptree& pt,
+                 graph_handle_t& graph) {
   // gracefully shutdown when asked via SIGTERM
   quiesce(pt.get<unsigned int>("httpd.service.drain_seconds", 28U),
           pt.get<unsigned int>("httpd.service.shutting_seconds", 1U));
@@ -268,7 +556,7 @@ void run_service(const boost::property_tree::ptree& pt) {
 
   // listen for requests
   zmq::context_t context;
-  rest_worker_t rest_worker(pt);
+  rest_worker_t rest_worker(pt, graph);
   worker_t worker(context, "ipc:///tmp/rest_out", "ipc:///dev/null",
                   loopback, interrupt,
                   std::bind(&rest_worker_t::work, std::ref(rest_worker),
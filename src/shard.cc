@@ -0,0 +1,157 @@
+#include "shard.h"
+#include "tile_extract.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <valhalla/midgard/logging.h>
+
+namespace {
+using namespace valhalla;
+namespace trace = valhalla::tools::trace;
+
+/**
+ * The size of every tile in bytes, tiles that can't be found weigh 1 so
+ * they are still spread out
+ */
+std::vector<uint64_t> tile_sizes(const boost::property_tree::ptree& config,
+                                 const std::vector<baldr::GraphId>& tiles) {
+  trace::span_t span("tile_sizes", "phase");
+  std::unordered_map<uint32_t, uint64_t> index;
+  auto extract = config.get<std::string>("mjolnir.tile_extract", "");
+  if (!extract.empty() && std::filesystem::exists(extract)) {
+    try {
+      for (const auto& entry : tools::read_tile_index(extract))
+        index.emplace(entry.tile_id, entry.size);
+    } catch (const std::exception& e) {
+      LOG_WARN("Not using the index of " + extract + ": " + e.what());
+      index.clear();
+    }
+  }
+  auto tile_dir = config.get<std::string>("mjolnir.tile_dir", "");
+
+  std::vector<uint64_t> sizes;
+  sizes.reserve(tiles.size());
+  for (const auto& tile : tiles) {
+    auto tile_id = static_cast<uint32_t>(tile.Tile_Base().value);
+    uint64_t size = 0;
+    if (!index.empty()) {
+      auto found = index.find(tile_id);
+      size = found == index.end() ? 0 : found->second;
+    } else if (!tile_dir.empty()) {
+      std::error_code ec;
+      auto file_size = std::filesystem::file_size(
+          std::filesystem::path(tile_dir) / tools::tile_file_path(tile_id),
+          ec);
+      size = ec ? 0 : file_size;
+    }
+    sizes.push_back(std::max(size, uint64_t(1)));
+  }
+  return sizes;
+}
+
+} // namespace
+
+namespace valhalla {
+
+namespace tools {
+
+shard_t::shard_t(uint32_t index, uint32_t count, std::string marker_dir)
+    : index_(index), count_(count), marker_dir_(std::move(marker_dir)) {
+  if (count == 0 || index >= count)
+    throw std::runtime_error("Invalid shard " + str() +
+                             ", expected i/n with 0 <= i < n");
+}
+
+shard_t shard_t::from_config(const boost::property_tree::ptree& config) {
+  auto marker_dir = config.get<std::string>("mjolnir.shard_marker_dir", ".");
+  auto value = config.get<std::string>("mjolnir.shard", "");
+  if (value.empty())
+    return shard_t(0, 1, marker_dir);
+
+  auto slash = value.find('/');
+  try {
+    if (slash == std::string::npos)
+      throw std::invalid_argument(value);
+    size_t index_end = 0, count_end = 0;
+    auto index = std::stoul(value.substr(0, slash), &index_end);
+    auto count = std::stoul(value.substr(slash + 1), &count_end);
+    if (index_end != slash || count_end != value.size() - slash - 1 ||
+        count > UINT32_MAX || index >= count)
+      throw std::invalid_argument(value);
+    return shard_t(static_cast<uint32_t>(index),
+                   static_cast<uint32_t>(count), marker_dir);
+  } catch (const std::logic_error&) {
+    throw std::runtime_error("Invalid shard " + value +
+                             ", expected i/n with 0 <= i < n");
+  }
+}
+
+void shard_t::select(const boost::property_tree::ptree& config,
+                     std::vector<baldr::GraphId>& tiles) {
+  std::sort(tiles.begin(), tiles.end());
+  if (!enabled()) {
+    tiles_ = tiles.size();
+    return;
+  }
+
+  auto sizes = tile_sizes(config, tiles);
+  uint64_t total = 0;
+  for (auto size : sizes)
+    total += size;
+
+  // a tile belongs to the shard its middle byte falls into
+  std::vector<baldr::GraphId> selected;
+  uint64_t before = 0;
+  bytes_ = 0;
+  for (size_t i = 0; i < tiles.size(); ++i) {
+    auto middle = static_cast<unsigned __int128>(before + sizes[i] / 2);
+    auto shard = static_cast<uint32_t>(middle * count_ / total);
+    before += sizes[i];
+    if (shard < index_)
+      continue;
+    if (shard > index_)
+      break;
+    selected.push_back(tiles[i]);
+    bytes_ += sizes[i];
+  }
+  LOG_INFO("Shard " + str() + ": " + std::to_string(selected.size()) +
+           " of " + std::to_string(tiles.size()) + " tiles, " +
+           std::to_string(bytes_) + " of " + std::to_string(total) +
+           " bytes");
+  tiles.swap(selected);
+  tiles_ = tiles.size();
+}
+
+void shard_t::mark_done() const {
+  if (!enabled())
+    return;
+
+  auto name = "shard-" + std::to_string(index_) + "-of-" +
+              std::to_string(count_) + ".done";
+  auto path = std::filesystem::path(marker_dir_) / name;
+  auto tmp = path;
+  tmp += ".tmp";
+  std::filesystem::create_directories(marker_dir_);
+  {
+    auto finished = std::chrono::duration_cast<std::chrono::seconds>(
+                        std::chrono::system_clock::now().time_since_epoch())
+                        .count();
+    std::ofstream out(tmp);
+    out << "{\"shard\":" << index_ << ",\"shards\":" << count_
+        << ",\"tiles\":" << tiles_ << ",\"bytes\":" << bytes_
+        << ",\"finished\":" << finished << "}\n";
+    if (!out)
+      throw std::runtime_error("Unable to write " + tmp.string());
+  }
+  std::filesystem::rename(tmp, path);
+  LOG_INFO("Shard " + str() + " done, wrote " + path.string());
+}
+
+} // namespace tools
+} // namespace valhalla
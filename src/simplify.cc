@@ -0,0 +1,191 @@
+#include "simplify.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+using namespace valhalla;
+
+// equatorial circumference over 256 px
+constexpr double kMetersPerPixelAtZoom0 = 156543.03392804097;
+constexpr double kMetersPerDegree = 111319.49079327357;
+constexpr double kRadPerDegree = M_PI / 180.0;
+constexpr int kMaxZoom = 24;
+
+struct point_t {
+  double x, y;
+};
+
+/**
+ * Projects the shape to meters around its first point, close enough for
+ * anything the size of an edge
+ */
+void project(const std::vector<midgard::PointLL>& shape,
+             std::vector<point_t>& points) {
+  const auto& origin = shape.front();
+  double x_scale = kMetersPerDegree * std::cos(origin.lat() * kRadPerDegree);
+  points.resize(shape.size());
+  for (size_t i = 0; i < shape.size(); ++i)
+    points[i] = {(shape[i].lng() - origin.lng()) * x_scale,
+                 (shape[i].lat() - origin.lat()) * kMetersPerDegree};
+}
+
+double segment_distance_sq(const point_t& p, const point_t& a,
+                           const point_t& b) {
+  double dx = b.x - a.x, dy = b.y - a.y;
+  double length_sq = dx * dx + dy * dy;
+  double t = length_sq > 0
+                 ? std::clamp(((p.x - a.x) * dx + (p.y - a.y) * dy) /
+                                  length_sq,
+                              0.0, 1.0)
+                 : 0.0;
+  double ex = a.x + t * dx - p.x, ey = a.y + t * dy - p.y;
+  return ex * ex + ey * ey;
+}
+
+double triangle_area(const point_t& a, const point_t& b, const point_t& c) {
+  return std::abs((b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y)) /
+         2;
+}
+
+void douglas_peucker(const std::vector<point_t>& points,
+                     double tolerance,
+                     std::vector<uint8_t>& keep) {
+  double tolerance_sq = tolerance * tolerance;
+  // no recursion, long shapes would go deep
+  std::vector<std::pair<size_t, size_t>> ranges{{0, points.size() - 1}};
+  while (!ranges.empty()) {
+    auto [first, last] = ranges.back();
+    ranges.pop_back();
+    double max_sq = 0;
+    size_t farthest = first;
+    for (size_t i = first + 1; i < last; ++i) {
+      auto d = segment_distance_sq(points[i], points[first], points[last]);
+      if (d > max_sq) {
+        max_sq = d;
+        farthest = i;
+      }
+    }
+    if (max_sq <= tolerance_sq)
+      continue;
+    keep[farthest] = 1;
+    ranges.emplace_back(first, farthest);
+    ranges.emplace_back(farthest, last);
+  }
+}
+
+void visvalingam(const std::vector<point_t>& points,
+                 double tolerance,
+                 std::vector<uint8_t>& keep) {
+  double threshold = tolerance * tolerance;
+  size_t n = points.size();
+  std::vector<size_t> prev(n), next(n);
+  std::vector<double> area(n);
+  // smallest area on top, stale entries are skipped when popped
+  using item_t = std::pair<double, size_t>;
+  std::priority_queue<item_t, std::vector<item_t>, std::greater<item_t>> heap;
+  for (size_t i = 1; i + 1 < n; ++i) {
+    prev[i] = i - 1;
+    next[i] = i + 1;
+    area[i] = triangle_area(points[i - 1], points[i], points[i + 1]);
+    heap.emplace(area[i], i);
+    keep[i] = 1;
+  }
+
+  while (!heap.empty()) {
+    auto [a, i] = heap.top();
+    heap.pop();
+    if (!keep[i] || a != area[i])
+      continue;
+    if (a >= threshold)
+      break;
+    keep[i] = 0;
+    auto p = prev[i], q = next[i];
+    next[p] = q;
+    prev[q] = p;
+    // a neighbour's area never drops below the one just removed, so the
+    // removal order stays monotonic
+    for (auto j : {p, q}) {
+      if (j == 0 || j == n - 1)
+        continue;
+      area[j] = std::max(
+          a, triangle_area(points[prev[j]], points[j], points[next[j]]));
+      heap.emplace(area[j], j);
+    }
+  }
+}
+
+} // namespace
+
+namespace valhalla {
+
+namespace tools {
+
+double simplify_options_t::tolerance_at(double lat) const {
+  if (zoom < 0)
+    return tolerance;
+  return kMetersPerPixelAtZoom0 * std::cos(lat * kRadPerDegree) /
+         std::ldexp(1.0, zoom);
+}
+
+simplify_options_t parse_simplify_options(const std::string& value,
+                                          const std::string& method) {
+  simplify_options_t options;
+  try {
+    size_t parsed = 0;
+    if (!value.empty() && (value.front() == 'z' || value.front() == 'Z')) {
+      options.zoom = std::stoi(value.substr(1), &parsed);
+      parsed++;
+      if (options.zoom < 0 || options.zoom > kMaxZoom)
+        throw std::out_of_range(value);
+    } else {
+      options.tolerance = std::stod(value, &parsed);
+      if (!(options.tolerance > 0))
+        throw std::out_of_range(value);
+    }
+    if (parsed != value.size())
+      throw std::invalid_argument(value);
+  } catch (std::exception&) {
+    throw std::runtime_error("Invalid simplify tolerance: " + value +
+                             ", expected meters or z<zoom>");
+  }
+
+  if (method == "douglas-peucker")
+    options.method = simplify_method_t::kDouglasPeucker;
+  else if (method == "visvalingam")
+    options.method = simplify_method_t::kVisvalingam;
+  else
+    throw std::runtime_error("Unknown simplify method: " + method);
+  return options;
+}
+
+void simplify(std::vector<midgard::PointLL>& shape,
+              double tolerance,
+              simplify_method_t method) {
+  if (shape.size() < 3 || tolerance <= 0)
+    return;
+
+  // edges are simplified one after the other, reuse the buffers
+  thread_local std::vector<point_t> points;
+  thread_local std::vector<uint8_t> keep;
+  project(shape, points);
+  keep.assign(shape.size(), 0);
+  keep.front() = keep.back() = 1;
+  if (method == simplify_method_t::kDouglasPeucker)
+    douglas_peucker(points, tolerance, keep);
+  else
+    visvalingam(points, tolerance, keep);
+
+  size_t kept = 0;
+  for (size_t i = 0; i < shape.size(); ++i)
+    if (keep[i])
+      shape[kept++] = shape[i];
+  shape.resize(kept);
+}
+
+} // namespace tools
+} // namespace valhalla
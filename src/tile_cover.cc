@@ -0,0 +1,551 @@
+#include "tile_cover.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include <valhalla/baldr/rapidjson_utils.h>
+#include <valhalla/baldr/tilehierarchy.h>
+#include <valhalla/midgard/constants.h>
+#include <valhalla/midgard/encoded.h>
+#include <valhalla/midgard/tiles.h>
+
+namespace {
+using namespace valhalla;
+
+const midgard::Tiles<midgard::PointLL>& level_tiles(uint32_t level) {
+  const auto& transit = baldr::TileHierarchy::GetTransitLevel();
+  if (level == transit.level)
+    return transit.tiles;
+  for (const auto& l : baldr::TileHierarchy::levels()) {
+    if (l.level == level)
+      return l.tiles;
+  }
+  throw std::runtime_error("Invalid hierarchy level: " +
+                           std::to_string(level));
+}
+
+/**
+ * The tile grid of one level in plain numbers
+ */
+struct grid_t {
+  explicit grid_t(uint32_t level) {
+    const auto& tiles = level_tiles(level);
+    minx = tiles.TileBounds().minx();
+    miny = tiles.TileBounds().miny();
+    size = tiles.TileSize();
+    nrows = tiles.nrows();
+    ncols = tiles.ncolumns();
+  }
+
+  int32_t col(double x) const {
+    return std::clamp(static_cast<int32_t>(std::floor((x - minx) / size)),
+                      0, ncols - 1);
+  }
+
+  int32_t row(double y) const {
+    return std::clamp(static_cast<int32_t>(std::floor((y - miny) / size)),
+                      0, nrows - 1);
+  }
+
+  double row_min(int32_t row) const {
+    return miny + row * size;
+  }
+
+  double minx;
+  double miny;
+  double size;
+  int32_t nrows;
+  int32_t ncols;
+};
+
+/**
+ * Longitude degrees covered by some meters at the given latitude
+ */
+double lng_degrees(double meters, double lat) {
+  auto cos_lat = std::cos(std::min(std::abs(lat), 89.9) * midgard::kRadPerDeg);
+  return std::min(360., meters / (midgard::kMetersPerDegreeLat * cos_lat));
+}
+
+/**
+ * Sets all tiles that intersect the box around two points, grown by
+ * the buffer in meters
+ */
+void set_box(const grid_t& grid,
+             const midgard::PointLL& a,
+             const midgard::PointLL& b,
+             double buffer,
+             uint32_t level,
+             tools::tile_cover_t& cover) {
+  auto dy = buffer / midgard::kMetersPerDegreeLat;
+  auto miny = std::min(a.lat(), b.lat()) - dy;
+  auto maxy = std::max(a.lat(), b.lat()) + dy;
+  auto dx = lng_degrees(buffer, std::max(std::abs(miny), std::abs(maxy)));
+  auto c0 = grid.col(std::min(a.lng(), b.lng()) - dx);
+  auto c1 = grid.col(std::max(a.lng(), b.lng()) + dx);
+  for (auto row = grid.row(miny); row <= grid.row(maxy); ++row)
+    cover.set_range(level, row * grid.ncols + c0, row * grid.ncols + c1);
+}
+
+/**
+ * Walks the cells a segment passes through (Amanatides & Woo) and sets
+ * the tiles around the piece of the segment inside each of them
+ */
+void cover_segment(const grid_t& grid,
+                   const midgard::PointLL& a,
+                   const midgard::PointLL& b,
+                   double buffer,
+                   uint32_t level,
+                   tools::tile_cover_t& cover) {
+  auto col = grid.col(a.lng());
+  auto row = grid.row(a.lat());
+  auto vx = b.lng() - a.lng();
+  auto vy = b.lat() - a.lat();
+
+  // parameter t along the segment at which the next column/row starts
+  auto inf = std::numeric_limits<double>::infinity();
+  auto next_x = grid.minx + (col + (vx > 0 ? 1 : 0)) * grid.size;
+  auto next_y = grid.row_min(row) + (vy > 0 ? grid.size : 0);
+  auto t_col = vx != 0 ? (next_x - a.lng()) / vx : inf;
+  auto t_row = vy != 0 ? (next_y - a.lat()) / vy : inf;
+  auto dt_col = vx != 0 ? grid.size / std::abs(vx) : inf;
+  auto dt_row = vy != 0 ? grid.size / std::abs(vy) : inf;
+
+  auto at = [&](double t) {
+    return midgard::PointLL(a.lng() + t * vx, a.lat() + t * vy);
+  };
+
+  double t_enter = 0;
+  // every step crosses one column or row boundary
+  auto steps = std::abs(grid.col(b.lng()) - col) +
+               std::abs(grid.row(b.lat()) - row);
+  for (int32_t i = 0; i <= steps; ++i) {
+    // the last cell always runs to the end, whatever rounding did
+    auto t_exit = i == steps ? 1. : std::min({t_col, t_row, 1.});
+    set_box(grid, at(t_enter), at(t_exit), buffer, level, cover);
+    if (t_exit >= 1)
+      break;
+    if (t_col < t_row)
+      t_col += dt_col;
+    else
+      t_row += dt_row;
+    t_enter = t_exit;
+  }
+}
+
+void cover_polygon(const tools::polygon_t& polygon,
+                   double buffer,
+                   uint32_t level,
+                   tools::tile_cover_t& cover) {
+  grid_t grid(level);
+  auto dy = buffer / midgard::kMetersPerDegreeLat;
+  auto set_cols = [&](int32_t row, int32_t c0, int32_t c1) {
+    cover.set_range(level, row * grid.ncols + c0, row * grid.ncols + c1);
+  };
+
+  // crossings of each row's center line with the boundary
+  std::vector<std::vector<double>> crossings(grid.nrows);
+
+  for (const auto& ring : polygon) {
+    for (size_t i = 0; i < ring.size(); ++i) {
+      const auto& a = ring[i];
+      const auto& b = ring[(i + 1) % ring.size()];
+      auto ymin = std::min(a.lat(), b.lat());
+      auto ymax = std::max(a.lat(), b.lat());
+
+      // boundary: every row band the (buffered) segment passes through
+      for (auto row = grid.row(ymin - dy); row <= grid.row(ymax + dy);
+           ++row) {
+        auto lo = grid.row_min(row) - dy;
+        auto hi = grid.row_min(row) + grid.size + dy;
+        double x0 = a.lng(), x1 = b.lng();
+        if (a.lat() != b.lat()) {
+          auto t0 = std::clamp((lo - a.lat()) / (b.lat() - a.lat()), 0., 1.);
+          auto t1 = std::clamp((hi - a.lat()) / (b.lat() - a.lat()), 0., 1.);
+          x0 = a.lng() + t0 * (b.lng() - a.lng());
+          x1 = a.lng() + t1 * (b.lng() - a.lng());
+        }
+        auto dx = lng_degrees(buffer, std::max(std::abs(lo), std::abs(hi)));
+        set_cols(row, grid.col(std::min(x0, x1) - dx),
+                 grid.col(std::max(x0, x1) + dx));
+      }
+
+      // interior: remember where the segment crosses row center lines,
+      // half open so that vertices on a center line count once
+      if (a.lat() == b.lat())
+        continue;
+      for (auto row = grid.row(ymin); row <= grid.row(ymax); ++row) {
+        auto y = grid.row_min(row) + grid.size / 2;
+        if ((a.lat() <= y) == (b.lat() <= y))
+          continue;
+        crossings[row].push_back(a.lng() + (y - a.lat()) *
+                                               (b.lng() - a.lng()) /
+                                               (b.lat() - a.lat()));
+      }
+    }
+  }
+
+  // fill the tiles whose centers lie between pairs of crossings
+  for (int32_t row = 0; row < grid.nrows; ++row) {
+    auto& xs = crossings[row];
+    std::sort(xs.begin(), xs.end());
+    for (size_t i = 0; i + 1 < xs.size(); i += 2) {
+      auto c0 = static_cast<int32_t>(
+          std::ceil((xs[i] - grid.minx) / grid.size - 0.5));
+      auto c1 = static_cast<int32_t>(
+          std::floor((xs[i + 1] - grid.minx) / grid.size - 0.5));
+      c0 = std::max(c0, 0);
+      c1 = std::min(c1, grid.ncols - 1);
+      if (c0 <= c1)
+        set_cols(row, c0, c1);
+    }
+  }
+}
+
+/**
+ * A GeoJSON object's member, throws if it's missing or not an array
+ */
+const rapidjson::Value& array_member(const rapidjson::Value& object,
+                                     const char* member) {
+  if (!object.HasMember(member) || !object[member].IsArray())
+    throw std::runtime_error(std::string("Invalid GeoJSON, ") + member +
+                             " must be an array");
+  return object[member];
+}
+
+rapidjson::Value::ConstArray as_array(const rapidjson::Value& value) {
+  if (!value.IsArray())
+    throw std::runtime_error("Invalid GeoJSON coordinates");
+  return value.GetArray();
+}
+
+tools::ring_t parse_ring(const rapidjson::Value& coordinates) {
+  tools::ring_t ring;
+  auto coords = as_array(coordinates);
+  ring.reserve(coords.Size());
+  for (const auto& coord : coords) {
+    if (!coord.IsArray() || coord.Size() < 2 || !coord[0].IsNumber() ||
+        !coord[1].IsNumber())
+      throw std::runtime_error("Invalid GeoJSON coordinate");
+    ring.emplace_back(coord[0].GetDouble(), coord[1].GetDouble());
+  }
+  return ring;
+}
+
+tools::polygon_t parse_polygon(const rapidjson::Value& coordinates) {
+  tools::polygon_t polygon;
+  for (const auto& coords : as_array(coordinates)) {
+    auto ring = parse_ring(coords);
+    // the closing point is implied
+    if (ring.size() > 1 && ring.front() == ring.back())
+      ring.pop_back();
+    polygon.push_back(std::move(ring));
+  }
+  return polygon;
+}
+
+struct geometries_t {
+  tools::multipolygon_t polygons;
+  std::vector<tools::linestring_t> lines;
+};
+
+void parse_geometry(const rapidjson::Value& geojson,
+                    geometries_t& geometries) {
+  if (!geojson.IsObject() || !geojson.HasMember("type") ||
+      !geojson["type"].IsString())
+    throw std::runtime_error("Invalid GeoJSON object");
+
+  std::string type = geojson["type"].GetString();
+  if (type == "FeatureCollection") {
+    const auto& features = array_member(geojson, "features");
+    for (const auto& feature : features.GetArray())
+      parse_geometry(feature, geometries);
+  } else if (type == "Feature") {
+    if (geojson.HasMember("geometry") && !geojson["geometry"].IsNull())
+      parse_geometry(geojson["geometry"], geometries);
+  } else if (type == "GeometryCollection") {
+    const auto& collection = array_member(geojson, "geometries");
+    for (const auto& geometry : collection.GetArray())
+      parse_geometry(geometry, geometries);
+  } else if (type == "Polygon") {
+    geometries.polygons.push_back(
+        parse_polygon(array_member(geojson, "coordinates")));
+  } else if (type == "MultiPolygon") {
+    const auto& polygons = array_member(geojson, "coordinates");
+    for (const auto& polygon : polygons.GetArray())
+      geometries.polygons.push_back(parse_polygon(polygon));
+  } else if (type == "LineString") {
+    geometries.lines.push_back(
+        parse_ring(array_member(geojson, "coordinates")));
+  } else if (type == "MultiLineString") {
+    const auto& lines = array_member(geojson, "coordinates");
+    for (const auto& line : lines.GetArray())
+      geometries.lines.push_back(parse_ring(line));
+  }
+}
+
+geometries_t parse_geojson(const std::string& json) {
+  rapidjson::Document doc;
+  doc.Parse(json.c_str());
+  if (doc.HasParseError())
+    throw std::runtime_error("Unable to parse GeoJSON");
+
+  geometries_t geometries;
+  parse_geometry(doc, geometries);
+  return geometries;
+}
+
+std::vector<tools::region_t> parse_geojson_regions(const std::string& json) {
+  rapidjson::Document doc;
+  doc.Parse(json.c_str());
+  if (doc.HasParseError())
+    throw std::runtime_error("Unable to parse GeoJSON");
+
+  std::vector<tools::region_t> regions;
+  auto add_feature = [&](const rapidjson::Value& feature) {
+    if (!feature.IsObject())
+      throw std::runtime_error("Invalid GeoJSON feature");
+    tools::region_t region;
+    region.name = "region_" + std::to_string(regions.size());
+    if (feature.HasMember("properties") && feature["properties"].IsObject() &&
+        feature["properties"].HasMember("name") &&
+        feature["properties"]["name"].IsString()) {
+      region.name = feature["properties"]["name"].GetString();
+    }
+    geometries_t geometries;
+    parse_geometry(feature, geometries);
+    region.polygons = std::move(geometries.polygons);
+    if (!region.polygons.empty())
+      regions.push_back(std::move(region));
+  };
+
+  if (doc.IsObject() && doc.HasMember("features") &&
+      doc["features"].IsArray()) {
+    for (const auto& feature : doc["features"].GetArray())
+      add_feature(feature);
+  } else {
+    add_feature(doc);
+  }
+  return regions;
+}
+
+std::vector<tools::region_t> parse_csv_regions(const std::string& csv) {
+  std::vector<tools::region_t> regions;
+  std::istringstream ss(csv);
+  std::string row;
+  size_t row_number = 0;
+  while (std::getline(ss, row)) {
+    ++row_number;
+    if (!row.empty() && row.back() == '\r')
+      row.pop_back();
+    if (row.empty() || row.front() == '#')
+      continue;
+
+    auto comma = row.find(',');
+    std::array<double, 4> pts;
+    const char* pos = comma == std::string::npos ? nullptr : &row[comma];
+    for (size_t i = 0; pos && i < pts.size(); ++i) {
+      char* end = nullptr;
+      pts[i] = std::strtod(pos + 1, &end);
+      pos = end != pos + 1 && (*end == ',' || (*end == '\0' && i == 3))
+                ? end
+                : nullptr;
+    }
+    if (!pos)
+      throw std::runtime_error("Invalid region in row " +
+                               std::to_string(row_number) +
+                               ", expected name,minx,miny,maxx,maxy");
+
+    regions.push_back({row.substr(0, comma),
+                       {tools::to_polygon(midgard::AABB2<midgard::PointLL>(
+                           pts[0], pts[1], pts[2], pts[3]))}});
+  }
+  return regions;
+}
+
+tools::linestring_t parse_csv(const std::string& csv) {
+  tools::linestring_t line;
+  std::istringstream ss(csv);
+  std::string row;
+  while (std::getline(ss, row)) {
+    char* end = nullptr;
+    auto lng = std::strtod(row.c_str(), &end);
+    if (end == row.c_str() || *end != ',')
+      continue;
+    const char* lat_str = end + 1;
+    auto lat = std::strtod(lat_str, &end);
+    if (end == lat_str)
+      continue;
+    line.emplace_back(lng, lat);
+  }
+  return line;
+}
+
+} // namespace
+
+namespace valhalla {
+
+namespace tools {
+
+tile_cover_t::tile_cover_t() {
+  auto transit_level = baldr::TileHierarchy::GetTransitLevel().level;
+  bits_.resize(transit_level + 1);
+  for (uint32_t level = 0; level <= transit_level; ++level) {
+    bits_[level].resize((level_tiles(level).TileCount() + 63) / 64, 0);
+  }
+}
+
+void tile_cover_t::set(uint32_t level, uint32_t tile_id) {
+  bits_[level][tile_id / 64] |= 1ULL << (tile_id % 64);
+}
+
+void tile_cover_t::set_range(uint32_t level, uint32_t first, uint32_t last) {
+  auto& words = bits_[level];
+  auto first_word = first / 64;
+  auto last_word = last / 64;
+  auto first_mask = ~0ULL << (first % 64);
+  auto last_mask = ~0ULL >> (63 - last % 64);
+  if (first_word == last_word) {
+    words[first_word] |= first_mask & last_mask;
+    return;
+  }
+  words[first_word] |= first_mask;
+  for (auto w = first_word + 1; w < last_word; ++w)
+    words[w] = ~0ULL;
+  words[last_word] |= last_mask;
+}
+
+bool tile_cover_t::test(uint32_t level, uint32_t tile_id) const {
+  return bits_[level][tile_id / 64] & (1ULL << (tile_id % 64));
+}
+
+tile_cover_t& tile_cover_t::operator|=(const tile_cover_t& other) {
+  for (size_t level = 0; level < bits_.size(); ++level) {
+    for (size_t w = 0; w < bits_[level].size(); ++w)
+      bits_[level][w] |= other.bits_[level][w];
+  }
+  return *this;
+}
+
+tile_cover_t& tile_cover_t::operator&=(const tile_cover_t& other) {
+  for (size_t level = 0; level < bits_.size(); ++level) {
+    for (size_t w = 0; w < bits_[level].size(); ++w)
+      bits_[level][w] &= other.bits_[level][w];
+  }
+  return *this;
+}
+
+size_t tile_cover_t::count() const {
+  size_t count = 0;
+  for (const auto& words : bits_) {
+    for (auto word : words)
+      count += std::popcount(word);
+  }
+  return count;
+}
+
+size_t tile_cover_t::count_shared(const tile_cover_t& other) const {
+  size_t count = 0;
+  for (size_t level = 0; level < bits_.size(); ++level) {
+    for (size_t w = 0; w < bits_[level].size(); ++w)
+      count += std::popcount(bits_[level][w] & other.bits_[level][w]);
+  }
+  return count;
+}
+
+std::vector<baldr::GraphId> tile_cover_t::graph_ids() const {
+  std::vector<baldr::GraphId> ids;
+  ids.reserve(count());
+  for (uint32_t level = 0; level < bits_.size(); ++level) {
+    for (size_t w = 0; w < bits_[level].size(); ++w) {
+      auto word = bits_[level][w];
+      while (word) {
+        auto bit = std::countr_zero(word);
+        ids.emplace_back(static_cast<uint32_t>(w * 64 + bit), level, 0);
+        word &= word - 1;
+      }
+    }
+  }
+  return ids;
+}
+
+multipolygon_t parse_geojson_polygons(const std::string& json) {
+  return parse_geojson(json).polygons;
+}
+
+std::vector<region_t> parse_regions(const std::string& input) {
+  auto begin = input.find_first_not_of(" \t\r\n");
+  if (begin != std::string::npos && input[begin] == '{')
+    return parse_geojson_regions(input);
+  return parse_csv_regions(input);
+}
+
+std::vector<linestring_t> parse_linestrings(const std::string& input,
+                                            double precision) {
+  auto begin = input.find_first_not_of(" \t\r\n");
+  if (begin == std::string::npos)
+    throw std::runtime_error("Empty line input");
+
+  // '{' also starts many encoded polylines, but a valid polyline always
+  // ends in a character below '_' so it can't be a JSON object as well
+  if (input[begin] == '{') {
+    rapidjson::Document doc;
+    doc.Parse(input.c_str());
+    if (!doc.HasParseError() && doc.IsObject()) {
+      geometries_t geometries;
+      parse_geometry(doc, geometries);
+      return std::move(geometries.lines);
+    }
+  }
+
+  // an encoded polyline never contains a comma, CSV always does
+  if (input.find(',') != std::string::npos)
+    return {parse_csv(input)};
+
+  auto end = input.find_last_not_of(" \t\r\n");
+  return {midgard::decode<linestring_t>(input.substr(begin, end - begin + 1),
+                                        precision)};
+}
+
+void cover_linestring(const linestring_t& line,
+                      double buffer,
+                      const std::vector<uint32_t>& levels,
+                      tile_cover_t& cover) {
+  if (line.empty())
+    return;
+
+  for (auto level : levels) {
+    grid_t grid(level);
+    if (line.size() == 1)
+      set_box(grid, line.front(), line.front(), buffer, level, cover);
+    for (size_t i = 1; i < line.size(); ++i)
+      cover_segment(grid, line[i - 1], line[i], buffer, level, cover);
+  }
+}
+
+void cover_polygons(const multipolygon_t& polygons,
+                    double buffer,
+                    const std::vector<uint32_t>& levels,
+                    tile_cover_t& cover) {
+  for (auto level : levels) {
+    for (const auto& polygon : polygons)
+      cover_polygon(polygon, buffer, level, cover);
+  }
+}
+
+polygon_t to_polygon(const midgard::AABB2<midgard::PointLL>& bbox) {
+  return {{
+      {bbox.minx(), bbox.miny()},
+      {bbox.maxx(), bbox.miny()},
+      {bbox.maxx(), bbox.maxy()},
+      {bbox.minx(), bbox.maxy()},
+  }};
+}
+
+} // namespace tools
+} // namespace valhalla
@@ -0,0 +1,247 @@
+#include "tile_extract.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <valhalla/baldr/graphid.h>
+#include <valhalla/baldr/graphtile.h>
+#include <valhalla/baldr/tilehierarchy.h>
+
+namespace {
+using namespace valhalla;
+
+constexpr const char* kIndexName = "index.bin";
+
+/**
+ * Numeric fields in tar headers are NUL or space terminated octal
+ */
+uint64_t parse_octal(const char* field, size_t length) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < length && field[i] >= '0' && field[i] <= '7'; ++i)
+    value = value * 8 + (field[i] - '0');
+  return value;
+}
+
+void write_octal(char* field, size_t length, uint64_t value) {
+  // zero padded, NUL terminated
+  field[length - 1] = '\0';
+  for (size_t i = length - 1; i-- > 0; value /= 8)
+    field[i] = static_cast<char>('0' + value % 8);
+}
+
+uint64_t padded(uint64_t size) {
+  return (size + tools::kTarBlockSize - 1) / tools::kTarBlockSize *
+         tools::kTarBlockSize;
+}
+
+/**
+ * A ustar header for a regular file
+ */
+std::array<char, tools::kTarBlockSize> tar_header(const std::string& name,
+                                                  uint64_t size,
+                                                  uint64_t mtime) {
+  if (name.size() >= 100)
+    throw std::runtime_error("Tar member name too long: " + name);
+
+  std::array<char, tools::kTarBlockSize> header{};
+  std::memcpy(header.data(), name.data(), name.size());
+  write_octal(&header[100], 8, 0644);
+  write_octal(&header[108], 8, 0);
+  write_octal(&header[116], 8, 0);
+  write_octal(&header[124], 12, size);
+  write_octal(&header[136], 12, mtime);
+  header[156] = '0';
+  std::memcpy(&header[257], "ustar", 6);
+  std::memcpy(&header[263], "00", 2);
+
+  // the checksum is computed with the checksum field set to spaces
+  std::memset(&header[148], ' ', 8);
+  uint32_t checksum = 0;
+  for (auto c : header)
+    checksum += static_cast<unsigned char>(c);
+  write_octal(&header[148], 7, checksum);
+  return header;
+}
+
+} // namespace
+
+namespace valhalla {
+
+namespace tools {
+
+std::vector<tile_index_entry_t> read_tile_index(const std::string& path) {
+  trace::span_t span("read_index", "io");
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file.is_open())
+    throw std::runtime_error("Unable to open " + path);
+
+  char header[kTarBlockSize];
+  if (!file.read(header, kTarBlockSize))
+    throw std::runtime_error("Unable to read tar header of " + path);
+  if (std::strncmp(header, kIndexName, std::strlen(kIndexName) + 1) != 0)
+    throw std::runtime_error(path + " doesn't start with an " + kIndexName);
+
+  auto size = parse_octal(header + 124, 12);
+  if (size % sizeof(tile_index_entry_t))
+    throw std::runtime_error("Invalid index size in " + path);
+
+  std::vector<tile_index_entry_t> entries(size / sizeof(tile_index_entry_t));
+  if (!file.read(reinterpret_cast<char*>(entries.data()), size))
+    throw std::runtime_error("Unable to read index of " + path);
+
+  return entries;
+}
+
+std::string tile_file_path(uint32_t tile_id) {
+  return baldr::GraphTile::FileSuffix(baldr::GraphId(tile_id));
+}
+
+bool tile_id_from_path(const std::string& relative, uint32_t& tile_id) {
+  if (!relative.ends_with(".gph"))
+    return false;
+  auto s = relative.substr(0, relative.size() - 4);
+  auto slash = s.find('/');
+  if (slash == 0 || slash == std::string::npos ||
+      s.find_first_not_of("0123456789/") != std::string::npos)
+    return false;
+  uint32_t level = std::stoul(s.substr(0, slash));
+  std::string digits;
+  for (auto c : s.substr(slash + 1)) {
+    if (c != '/')
+      digits.push_back(c);
+  }
+  if (digits.empty())
+    return false;
+  tile_id = static_cast<uint32_t>(
+      baldr::GraphId(std::stoul(digits), level, 0).value);
+  return true;
+}
+
+uint32_t parse_tile_id(const std::string& s) {
+  uint32_t level, tile_id;
+  char slash;
+  std::istringstream ss(s);
+  if (!(ss >> level >> slash >> tile_id) || slash != '/' ||
+      level > baldr::TileHierarchy::GetTransitLevel().level)
+    throw std::runtime_error("Invalid tile id: " + s);
+  return static_cast<uint32_t>(baldr::GraphId(tile_id, level, 0).value);
+}
+
+void write_at(int fd, const void* data, size_t size, uint64_t offset) {
+  const auto* bytes = static_cast<const char*>(data);
+  while (size) {
+    auto written = ::pwrite(fd, bytes, size, offset);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error(std::string("Failed to write: ") +
+                               std::strerror(errno));
+    }
+    bytes += written;
+    offset += written;
+    size -= written;
+  }
+}
+
+void read_at(int fd, void* data, size_t size, uint64_t offset) {
+  auto* bytes = static_cast<char*>(data);
+  while (size) {
+    auto read = ::pread(fd, bytes, size, offset);
+    if (read < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error(std::string("Failed to read: ") +
+                               std::strerror(errno));
+    }
+    if (read == 0)
+      throw std::runtime_error("Unexpected end of file while reading");
+    bytes += read;
+    offset += read;
+    size -= read;
+  }
+}
+
+uint64_t layout_extract(std::vector<tile_index_entry_t>& entries) {
+  uint64_t offset = kTarBlockSize + padded(entries.size() *
+                                           sizeof(tile_index_entry_t));
+  for (auto& entry : entries) {
+    entry.offset = offset + kTarBlockSize;
+    offset = entry.offset + padded(entry.size);
+  }
+  // two empty blocks mark the end of the archive
+  return offset + 2 * kTarBlockSize;
+}
+
+void write_extract_skeleton(int fd,
+                            const std::vector<tile_index_entry_t>& entries,
+                            uint64_t total_size) {
+  trace::span_t span("write_skeleton", "io");
+  if (::ftruncate(fd, total_size) != 0)
+    throw std::runtime_error(std::string("Failed to size extract: ") +
+                             std::strerror(errno));
+
+  auto mtime = static_cast<uint64_t>(std::time(nullptr));
+  auto index_size = entries.size() * sizeof(tile_index_entry_t);
+  auto header = tar_header(kIndexName, index_size, mtime);
+  write_at(fd, header.data(), header.size(), 0);
+  write_at(fd, entries.data(), index_size, kTarBlockSize);
+
+  for (const auto& entry : entries) {
+    header = tar_header(tile_file_path(entry.tile_id), entry.size, mtime);
+    write_at(fd, header.data(), header.size(),
+               entry.offset - kTarBlockSize);
+  }
+}
+
+void copy_range(int in_fd,
+                uint64_t in_offset,
+                int out_fd,
+                uint64_t out_offset,
+                uint64_t size) {
+  trace::span_t span("copy", "io", "bytes", size);
+  bool kernel_copy = true;
+  std::vector<char> buffer;
+  while (size) {
+    ssize_t copied;
+    if (kernel_copy) {
+      auto in = static_cast<loff_t>(in_offset);
+      auto out = static_cast<loff_t>(out_offset);
+      copied = ::copy_file_range(in_fd, &in, out_fd, &out, size, 0);
+      if (copied < 0 && (errno == EXDEV || errno == ENOSYS ||
+                         errno == EINVAL || errno == EOPNOTSUPP)) {
+        kernel_copy = false;
+        continue;
+      }
+    } else {
+      buffer.resize(std::min<uint64_t>(size, 1 << 20));
+      copied = ::pread(in_fd, buffer.data(), buffer.size(), in_offset);
+      if (copied > 0)
+        write_at(out_fd, buffer.data(), copied, out_offset);
+    }
+
+    if (copied < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error(std::string("Failed to copy: ") +
+                               std::strerror(errno));
+    }
+    if (copied == 0)
+      throw std::runtime_error("Unexpected end of file while copying");
+    in_offset += copied;
+    out_offset += copied;
+    size -= copied;
+  }
+}
+
+} // namespace tools
+} // namespace valhalla
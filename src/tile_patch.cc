@@ -0,0 +1,451 @@
+#include "tile_patch.h"
+#include "checksum.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <zstd.h>
+
+
+namespace {
+using namespace valhalla;
+using tools::patch_entry_t;
+using tools::patch_header_t;
+using tools::patch_op_t;
+using tools::tile_index_entry_t;
+namespace trace = valhalla::tools::trace;
+
+constexpr char kMagic[8] = {'V', 'T', 'P', 'A', 'T', 'C', 'H', '\0'};
+constexpr uint32_t kVersion = 1;
+// the window has to reach back over the whole old tile for the prefix to
+// be of any use, zstd's decoder refuses more than 1 GB by default anyway
+constexpr int kMinWindowLog = 10;
+constexpr int kMaxWindowLog = 30;
+
+struct compressor_t {
+  compressor_t() : ctx(ZSTD_createCCtx()) {
+  }
+  ~compressor_t() {
+    ZSTD_freeCCtx(ctx);
+  }
+  ZSTD_CCtx* ctx;
+};
+
+struct decompressor_t {
+  decompressor_t() : ctx(ZSTD_createDCtx()) {
+  }
+  ~decompressor_t() {
+    ZSTD_freeDCtx(ctx);
+  }
+  ZSTD_DCtx* ctx;
+};
+
+size_t check_zstd(size_t code) {
+  if (ZSTD_isError(code))
+    throw std::runtime_error(std::string("zstd: ") +
+                             ZSTD_getErrorName(code));
+  return code;
+}
+
+int window_log(size_t size) {
+  return std::clamp(static_cast<int>(std::bit_width(size)), kMinWindowLog,
+                    kMaxWindowLog);
+}
+
+/**
+ * Compresses data, with prefix as a dictionary of raw content if given
+ */
+std::string compress(ZSTD_CCtx* ctx,
+                     const std::string& data,
+                     const std::string* prefix,
+                     int level) {
+  check_zstd(ZSTD_CCtx_reset(ctx, ZSTD_reset_session_and_parameters));
+  check_zstd(ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, level));
+  check_zstd(ZSTD_CCtx_setParameter(ctx, ZSTD_c_checksumFlag, 1));
+  if (prefix) {
+    check_zstd(ZSTD_CCtx_setParameter(
+        ctx, ZSTD_c_windowLog, window_log(prefix->size() + data.size())));
+    check_zstd(
+        ZSTD_CCtx_setParameter(ctx, ZSTD_c_enableLongDistanceMatching, 1));
+    check_zstd(ZSTD_CCtx_refPrefix(ctx, prefix->data(), prefix->size()));
+  }
+  std::string out(ZSTD_compressBound(data.size()), '\0');
+  out.resize(check_zstd(ZSTD_compress2(ctx, out.data(), out.size(),
+                                       data.data(), data.size())));
+  return out;
+}
+
+std::string decompress(ZSTD_DCtx* ctx,
+                       const std::string& data,
+                       const std::string* prefix,
+                       size_t size) {
+  check_zstd(ZSTD_DCtx_reset(ctx, ZSTD_reset_session_and_parameters));
+  check_zstd(ZSTD_DCtx_setParameter(ctx, ZSTD_d_windowLogMax, kMaxWindowLog));
+  if (prefix)
+    check_zstd(ZSTD_DCtx_refPrefix(ctx, prefix->data(), prefix->size()));
+  std::string out(size, '\0');
+  auto written = check_zstd(ZSTD_decompressDCtx(ctx, out.data(), out.size(),
+                                                data.data(), data.size()));
+  if (written != size)
+    throw std::runtime_error("Patched tile has the wrong size");
+  return out;
+}
+
+/**
+ * Checksum of the sorted (tile id, size) pairs of a tile set
+ */
+uint64_t set_checksum(const std::vector<tile_index_entry_t>& tiles) {
+  std::vector<uint64_t> pairs;
+  pairs.reserve(tiles.size());
+  for (const auto& tile : tiles)
+    pairs.push_back(static_cast<uint64_t>(tile.tile_id) << 32 | tile.size);
+  return tools::checksum(pairs.data(), pairs.size() * sizeof(uint64_t));
+}
+
+std::string tile_name(uint32_t tile_id) {
+  return tools::tile_file_path(tile_id);
+}
+
+} // namespace
+
+namespace valhalla {
+
+namespace tools {
+
+tile_set_t::tile_set_t(const std::string& path) : path_(path) {
+  if (std::filesystem::is_directory(path)) {
+    for (const auto& entry :
+         std::filesystem::recursive_directory_iterator(path)) {
+      tile_index_entry_t tile{0, 0, 0};
+      if (!entry.is_regular_file() ||
+          !tile_id_from_path(
+              entry.path().lexically_relative(path).generic_string(),
+              tile.tile_id))
+        continue;
+      tile.size = static_cast<uint32_t>(entry.file_size());
+      tiles_.push_back(tile);
+    }
+  } else {
+    tiles_ = read_tile_index(path);
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0)
+      throw std::runtime_error("Unable to open " + path);
+  }
+  std::sort(tiles_.begin(), tiles_.end(), [](const auto& a, const auto& b) {
+    return a.tile_id < b.tile_id;
+  });
+}
+
+tile_set_t::~tile_set_t() {
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+std::string tile_set_t::read(const tile_index_entry_t& tile) const {
+  trace::span_t span("read", "io", "tile_id", tile.tile_id);
+  std::string bytes(tile.size, '\0');
+  if (fd_ >= 0) {
+    read_at(fd_, bytes.data(), bytes.size(), tile.offset);
+    return bytes;
+  }
+
+  auto path = std::filesystem::path(path_) / tile_file_path(tile.tile_id);
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("Unable to open " + path.string());
+  try {
+    read_at(fd, bytes.data(), bytes.size(), 0);
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+  return bytes;
+}
+
+patch_stats_t make_patch(const std::string& old_path,
+                         const std::string& new_path,
+                         const std::string& patch,
+                         int level,
+                         executor_t& executor) {
+  tile_set_t old_set(old_path);
+  tile_set_t new_set(new_path);
+
+  // pair up the tiles of both sets, both are sorted by tile id
+  struct pair_t {
+    const tile_index_entry_t* old_tile;
+    const tile_index_entry_t* new_tile;
+  };
+  std::vector<pair_t> pairs;
+  const auto& old_tiles = old_set.tiles();
+  const auto& new_tiles = new_set.tiles();
+  for (size_t o = 0, n = 0; o < old_tiles.size() || n < new_tiles.size();) {
+    if (n == new_tiles.size() ||
+        (o < old_tiles.size() && old_tiles[o].tile_id < new_tiles[n].tile_id))
+      pairs.push_back({&old_tiles[o++], nullptr});
+    else if (o == old_tiles.size() ||
+             new_tiles[n].tile_id < old_tiles[o].tile_id)
+      pairs.push_back({nullptr, &new_tiles[n++]});
+    else
+      pairs.push_back({&old_tiles[o++], &new_tiles[n++]});
+  }
+
+  int fd = ::open(patch.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    throw std::runtime_error("Unable to open " + patch);
+
+  std::vector<patch_entry_t> entries(pairs.size());
+  std::vector<uint8_t> differs(pairs.size(), 0);
+  std::mutex lock;
+  uint64_t end = sizeof(patch_header_t);
+  per_worker_t<compressor_t> compressors(executor,
+                                         []() { return new compressor_t; });
+  try {
+    executor.for_each(
+        pairs.size(),
+        [&](size_t worker, size_t i) {
+          const auto& pair = pairs[i];
+          std::string old_bytes, new_bytes;
+          if (pair.old_tile)
+            old_bytes = old_set.read(*pair.old_tile);
+          if (pair.new_tile)
+            new_bytes = new_set.read(*pair.new_tile);
+          if (pair.old_tile && pair.new_tile && old_bytes == new_bytes)
+            return;
+
+          trace::span_t span("diff", "tile", "tile_id",
+                             pair.old_tile ? pair.old_tile->tile_id
+                                           : pair.new_tile->tile_id);
+          patch_entry_t entry{};
+          std::string data;
+          auto* ctx = compressors[worker].ctx;
+          if (!pair.new_tile) {
+            entry.op = patch_op_t::kDelete;
+          } else if (!pair.old_tile) {
+            entry.op = patch_op_t::kAdd;
+            data = compress(ctx, new_bytes, nullptr, level);
+          } else {
+            entry.op = patch_op_t::kChange;
+            data = compress(ctx, new_bytes, &old_bytes, level);
+          }
+          entry.tile_id = pair.old_tile ? pair.old_tile->tile_id
+                                        : pair.new_tile->tile_id;
+          entry.old_size = static_cast<uint32_t>(old_bytes.size());
+          entry.new_size = static_cast<uint32_t>(new_bytes.size());
+          entry.old_checksum = pair.old_tile ? checksum(old_bytes) : 0;
+          entry.new_checksum = pair.new_tile ? checksum(new_bytes) : 0;
+          entry.data_size = data.size();
+          {
+            std::lock_guard l(lock);
+            entry.data_offset = end;
+            end += data.size();
+          }
+          write_at(fd, data.data(), data.size(), entry.data_offset);
+          entries[i] = entry;
+          differs[i] = 1;
+        },
+        "Diffing tiles");
+
+    patch_stats_t stats;
+    std::vector<patch_entry_t> table;
+    for (size_t i = 0; i < pairs.size(); ++i) {
+      if (pairs[i].new_tile)
+        stats.new_bytes += pairs[i].new_tile->size;
+      if (!differs[i]) {
+        stats.unchanged++;
+        continue;
+      }
+      table.push_back(entries[i]);
+      stats.added += entries[i].op == patch_op_t::kAdd;
+      stats.changed += entries[i].op == patch_op_t::kChange;
+      stats.deleted += entries[i].op == patch_op_t::kDelete;
+    }
+
+    patch_header_t header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.entry_count = table.size();
+    header.table_offset = end;
+    header.old_set_checksum = set_checksum(old_tiles);
+    header.new_set_checksum = set_checksum(new_tiles);
+    write_at(fd, table.data(), table.size() * sizeof(patch_entry_t), end);
+    write_at(fd, &header, sizeof(header), 0);
+    stats.patch_bytes = end + table.size() * sizeof(patch_entry_t);
+    ::close(fd);
+    return stats;
+  } catch (...) {
+    ::close(fd);
+    std::filesystem::remove(patch);
+    throw;
+  }
+}
+
+patch_stats_t apply_patch(const std::string& extract,
+                          const std::string& patch,
+                          const std::string& output,
+                          executor_t& executor) {
+  tile_set_t base(extract);
+  if (!base.is_extract())
+    throw std::runtime_error(extract + " is not a tile extract");
+
+  int patch_fd = ::open(patch.c_str(), O_RDONLY | O_CLOEXEC);
+  if (patch_fd < 0)
+    throw std::runtime_error("Unable to open " + patch);
+  patch_header_t header;
+  std::vector<patch_entry_t> entries;
+  try {
+    read_at(patch_fd, &header, sizeof(header), 0);
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.version != kVersion)
+      throw std::runtime_error(patch + " is not a tile patch");
+    entries.resize(header.entry_count);
+    read_at(patch_fd, entries.data(), entries.size() * sizeof(patch_entry_t),
+            header.table_offset);
+  } catch (...) {
+    ::close(patch_fd);
+    throw;
+  }
+  if (set_checksum(base.tiles()) != header.old_set_checksum) {
+    ::close(patch_fd);
+    throw std::runtime_error("The patch was made for a different tile set "
+                             "than " +
+                             extract);
+  }
+
+  // the new tile set: the base minus deleted tiles, plus changed and
+  // added ones, sorted by tile id like the base
+  struct source_t {
+    const tile_index_entry_t* base;
+    const patch_entry_t* patch;
+  };
+  std::vector<source_t> sources;
+  std::vector<source_t> deleted;
+  const auto& tiles = base.tiles();
+  for (size_t b = 0, e = 0; b < tiles.size() || e < entries.size();) {
+    if (e == entries.size() ||
+        (b < tiles.size() && tiles[b].tile_id < entries[e].tile_id)) {
+      sources.push_back({&tiles[b++], nullptr});
+      continue;
+    }
+    const auto& entry = entries[e++];
+    bool in_base = b < tiles.size() && tiles[b].tile_id == entry.tile_id;
+    if (in_base != (entry.op != patch_op_t::kAdd)) {
+      ::close(patch_fd);
+      throw std::runtime_error("The patch doesn't match tile " +
+                               tile_name(entry.tile_id));
+    }
+    const auto* base_tile = in_base ? &tiles[b++] : nullptr;
+    if (entry.op == patch_op_t::kDelete)
+      deleted.push_back({base_tile, &entry});
+    else
+      sources.push_back({base_tile, &entry});
+  }
+
+  patch_stats_t stats;
+  std::vector<tile_index_entry_t> out_tiles;
+  out_tiles.reserve(sources.size());
+  for (const auto& source : sources) {
+    out_tiles.push_back({0,
+                         source.base ? source.base->tile_id
+                                     : source.patch->tile_id,
+                         source.patch ? source.patch->new_size
+                                      : source.base->size});
+    stats.new_bytes += out_tiles.back().size;
+    if (!source.patch)
+      stats.unchanged++;
+    else if (source.patch->op == patch_op_t::kAdd)
+      stats.added++;
+    else
+      stats.changed++;
+  }
+  stats.deleted = deleted.size();
+  stats.patch_bytes = header.table_offset +
+                      entries.size() * sizeof(patch_entry_t);
+  auto total_size = layout_extract(out_tiles);
+
+  // in place means next to it and renamed over it once complete, readers
+  // that still have the old extract open keep seeing the old one
+  auto target = output.empty() ? extract + ".patching" : output;
+  int out_fd = ::open(target.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (out_fd < 0) {
+    ::close(patch_fd);
+    throw std::runtime_error("Unable to open " + target);
+  }
+
+  per_worker_t<decompressor_t> decompressors(
+      executor, []() { return new decompressor_t; });
+  auto verify_old = [&](const source_t& source, const std::string& bytes) {
+    if (checksum(bytes) != source.patch->old_checksum)
+      throw std::runtime_error("Tile " + tile_name(source.base->tile_id) +
+                               " of " + extract +
+                               " doesn't match the patch");
+  };
+  try {
+    executor.for_each(
+        deleted.size(),
+        [&](size_t, size_t i) {
+          verify_old(deleted[i], base.read(*deleted[i].base));
+        },
+        "Checking deleted tiles");
+
+    write_extract_skeleton(out_fd, out_tiles, total_size);
+    executor.for_each(
+        sources.size(),
+        [&](size_t worker, size_t i) {
+          const auto& source = sources[i];
+          const auto& out = out_tiles[i];
+          if (!source.patch) {
+            copy_range(base.fd(), source.base->offset, out_fd, out.offset,
+                       out.size);
+            return;
+          }
+
+          trace::span_t span("patch", "tile", "tile_id", out.tile_id);
+          const auto& entry = *source.patch;
+          std::string data(entry.data_size, '\0');
+          read_at(patch_fd, data.data(), data.size(), entry.data_offset);
+          std::string old_bytes;
+          if (entry.op == patch_op_t::kChange) {
+            old_bytes = base.read(*source.base);
+            verify_old(source, old_bytes);
+          }
+          auto bytes = decompress(decompressors[worker].ctx, data,
+                                  source.base ? &old_bytes : nullptr,
+                                  entry.new_size);
+          if (checksum(bytes) != entry.new_checksum)
+            throw std::runtime_error("Patched tile " +
+                                     tile_name(out.tile_id) +
+                                     " has the wrong checksum");
+          write_at(out_fd, bytes.data(), bytes.size(), out.offset);
+        },
+        "Patching tiles");
+    if (::fsync(out_fd) != 0)
+      throw std::runtime_error("Unable to sync " + target);
+  } catch (...) {
+    ::close(out_fd);
+    ::close(patch_fd);
+    std::filesystem::remove(target);
+    throw;
+  }
+  ::close(out_fd);
+  ::close(patch_fd);
+
+  if (set_checksum(out_tiles) != header.new_set_checksum) {
+    std::filesystem::remove(target);
+    throw std::runtime_error("The patched tile set differs from the one "
+                             "the patch was made for");
+  }
+  if (output.empty())
+    std::filesystem::rename(target, extract);
+  return stats;
+}
+
+} // namespace tools
+} // namespace valhalla
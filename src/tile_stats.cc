@@ -0,0 +1,747 @@
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#include <valhalla/baldr/graphconstants.h>
+#include <valhalla/baldr/graphid.h>
+#include <valhalla/baldr/graphreader.h>
+#include <valhalla/baldr/rapidjson_utils.h>
+#include <valhalla/baldr/sign.h>
+#include <valhalla/baldr/transitdeparture.h>
+#include <valhalla/baldr/transitroute.h>
+#include <valhalla/baldr/transitschedule.h>
+#include <valhalla/baldr/transitstop.h>
+#include <valhalla/baldr/turnlanes.h>
+#include <valhalla/midgard/logging.h>
+
+#include "executor.h"
+#include "prefetch.h"
+#include "shard.h"
+#include "tile_stats.h"
+#include "trace.h"
+
+namespace {
+using namespace valhalla::baldr;
+using options_t = valhalla::tools::tile_stats_options_t;
+using valhalla::tools::executor_t;
+namespace trace = valhalla::tools::trace;
+
+// histogram dimensions
+constexpr size_t kRoadClassCount = 8;
+constexpr size_t kUseCount = 64;
+constexpr size_t kSurfaceCount = 8;
+constexpr size_t kSpeedBinWidth = 10; // kph
+constexpr size_t kSpeedBinCount = 256 / kSpeedBinWidth + 1;
+constexpr size_t kEdgesPerNodeCount = 128;
+constexpr size_t kLengthBinCount = 25; // edge lengths are 24 bits
+
+// tile sections in the order they are laid out in memory
+enum class Section : uint8_t {
+  kHeader = 0,
+  kNodes,
+  kTransitions,
+  kDirectedEdges,
+  kAccessRestrictions,
+  kTransit,
+  kSigns,
+  kTurnLanes,
+  kAdmins,
+  kEdgeBins,
+  kUnaccounted,
+  kComplexRestrictions,
+  kEdgeInfo,
+  kTextList,
+  kLaneConnectivity,
+  kPredictedSpeeds,
+  kCount
+};
+constexpr size_t kSectionCount = static_cast<size_t>(Section::kCount);
+constexpr std::array<const char*, kSectionCount> kSectionNames{
+    "header",
+    "nodes",
+    "transitions",
+    "directed_edges",
+    "access_restrictions",
+    "transit",
+    "signs",
+    "turn_lanes",
+    "admins",
+    "edge_bins",
+    "unaccounted",
+    "complex_restrictions",
+    "edge_info",
+    "text_list",
+    "lane_connectivity",
+    "predicted_speeds",
+};
+
+using sections_t = std::array<int64_t, kSectionCount>;
+
+/**
+ * Computes the byte size of every section of a tile from its header. The
+ * fixed size arrays at the beginning of the tile are derived from their
+ * counts, the variable sized ones after them from their offsets. Whatever
+ * lies in between (e.g. extended directed edges) is unaccounted for.
+ */
+sections_t get_sections(const GraphTileHeader* header) {
+  sections_t s{};
+  auto set = [&s](Section section, int64_t bytes) {
+    s[static_cast<size_t>(section)] = bytes;
+  };
+  set(Section::kHeader, sizeof(GraphTileHeader));
+  set(Section::kNodes, header->nodecount() * sizeof(NodeInfo));
+  set(Section::kTransitions,
+      header->transitioncount() * sizeof(NodeTransition));
+  set(Section::kDirectedEdges,
+      header->directededgecount() * sizeof(DirectedEdge));
+  set(Section::kAccessRestrictions,
+      header->access_restriction_count() * sizeof(AccessRestriction));
+  set(Section::kTransit,
+      header->departurecount() * sizeof(TransitDeparture) +
+          header->stopcount() * sizeof(TransitStop) +
+          header->routecount() * sizeof(TransitRoute) +
+          header->schedulecount() * sizeof(TransitSchedule));
+  set(Section::kSigns, header->signcount() * sizeof(Sign));
+  set(Section::kTurnLanes, header->turnlane_count() * sizeof(TurnLanes));
+  set(Section::kAdmins, header->admincount() * sizeof(Admin));
+  set(Section::kEdgeBins,
+      header->bin_offset(kBinCount - 1).second * sizeof(GraphId));
+
+  int64_t fixed = 0;
+  for (auto bytes : s)
+    fixed += bytes;
+  set(Section::kUnaccounted,
+      static_cast<int64_t>(header->complex_restriction_forward_offset()) -
+          fixed);
+
+  int64_t predicted_offset = header->predictedspeeds_count()
+                                 ? header->predictedspeeds_offset()
+                                 : header->end_offset();
+  set(Section::kComplexRestrictions,
+      static_cast<int64_t>(header->edgeinfo_offset()) -
+          header->complex_restriction_forward_offset());
+  set(Section::kEdgeInfo, static_cast<int64_t>(header->textlist_offset()) -
+                              header->edgeinfo_offset());
+  set(Section::kTextList,
+      static_cast<int64_t>(header->lane_connectivity_offset()) -
+          header->textlist_offset());
+  set(Section::kLaneConnectivity,
+      predicted_offset - header->lane_connectivity_offset());
+  set(Section::kPredictedSpeeds,
+      static_cast<int64_t>(header->end_offset()) - predicted_offset);
+  return s;
+}
+
+int64_t section(const sections_t& s, Section section) {
+  return s[static_cast<size_t>(section)];
+}
+
+/**
+ * Sanity checks on the section sizes of a tile, returns an empty string if
+ * nothing looks off.
+ */
+std::string find_anomaly(const GraphTileHeader* header,
+                         const sections_t& s) {
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s[i] < 0)
+      return std::string("negative_size_") + kSectionNames[i];
+  }
+  if (header->predictedspeeds_count() > header->directededgecount())
+    return "more_predicted_speeds_than_edges";
+  if (section(s, Section::kTextList) >
+      section(s, Section::kDirectedEdges))
+    return "text_list_larger_than_edges";
+  if (section(s, Section::kEdgeInfo) >
+      4 * section(s, Section::kDirectedEdges))
+    return "edge_info_larger_than_4x_edges";
+  if (header->nodecount() == 0 && header->directededgecount() > 0)
+    return "edges_without_nodes";
+  return "";
+}
+
+class PublicGraphtile : public GraphTile {
+public:
+  uint32_t complex_restriction_count() const {
+    return complex_restriction_forward_size_ +
+           complex_restriction_reverse_size_;
+  }
+};
+
+/**
+ * Counters and distributions for all tiles of a single hierarchy level.
+ */
+struct level_stats_t {
+  uint64_t tile_count{0};
+  uint64_t node_count{0};
+  uint64_t directededge_count{0};
+  uint64_t shortcut_count{0};
+  uint64_t acceessrestriction_count{0};
+  uint64_t complexrestriction_count{0};
+
+  // edge lengths in meters
+  uint64_t edge_length{0};
+  uint64_t shortcut_length{0};
+
+  // predicted speed coverage (shortcuts excluded)
+  uint64_t predicted_speed_count{0};
+  uint64_t predicted_speed_length{0};
+  uint64_t free_flow_speed_count{0};
+  uint64_t constrained_flow_speed_count{0};
+
+  std::array<uint64_t, kRoadClassCount * kUseCount> class_use{};
+  std::array<uint64_t, kSpeedBinCount> speed{};
+  std::array<uint64_t, kSurfaceCount> surface{};
+  std::array<uint64_t, kEdgesPerNodeCount> edges_per_node{};
+  std::array<uint64_t, kLengthBinCount> length{};
+
+  // bytes per tile section
+  uint64_t tile_bytes{0};
+  sections_t section_bytes{};
+
+  void operator+=(const level_stats_t& other) {
+    tile_count += other.tile_count;
+    node_count += other.node_count;
+    directededge_count += other.directededge_count;
+    shortcut_count += other.shortcut_count;
+    acceessrestriction_count += other.acceessrestriction_count;
+    complexrestriction_count += other.complexrestriction_count;
+    edge_length += other.edge_length;
+    shortcut_length += other.shortcut_length;
+    predicted_speed_count += other.predicted_speed_count;
+    predicted_speed_length += other.predicted_speed_length;
+    free_flow_speed_count += other.free_flow_speed_count;
+    constrained_flow_speed_count += other.constrained_flow_speed_count;
+
+    auto add = [](auto& a, const auto& b) {
+      for (size_t i = 0; i < a.size(); ++i)
+        a[i] += b[i];
+    };
+    add(class_use, other.class_use);
+    add(speed, other.speed);
+    add(surface, other.surface);
+    add(edges_per_node, other.edges_per_node);
+    add(length, other.length);
+    tile_bytes += other.tile_bytes;
+    add(section_bytes, other.section_bytes);
+  }
+};
+
+/**
+ * Whether only the tile headers were read, i.e. none of the edge derived
+ * counts (shortcuts, lengths, predicted speeds) were collected.
+ */
+bool has_sections(const level_stats_t& s) {
+  return s.section_bytes[static_cast<size_t>(Section::kHeader)] != 0;
+}
+
+struct tile_size_t {
+  GraphId tile_id;
+  uint64_t bytes{0};
+  sections_t sections{};
+
+  bool operator>(const tile_size_t& other) const {
+    return bytes > other.bytes;
+  }
+};
+
+struct anomaly_t {
+  GraphId tile_id;
+  std::string reason;
+};
+
+/**
+ * The CSV rows of a single tile, only collected if requested. They are
+ * rendered right away since a tile's histograms are sparse.
+ */
+struct tile_row_t {
+  GraphId tile_id;
+  std::string csv;
+};
+
+struct stats_t {
+  std::map<uint32_t, level_stats_t> levels;
+  std::vector<tile_row_t> tiles;
+  // min heap of the largest tiles
+  std::vector<tile_size_t> largest;
+  size_t top_n{0};
+  std::vector<anomaly_t> anomalies;
+
+  void add_tile_size(tile_size_t&& tile_size) {
+    if (!top_n)
+      return;
+    if (largest.size() < top_n) {
+      largest.push_back(std::move(tile_size));
+      std::push_heap(largest.begin(), largest.end(),
+                     std::greater<tile_size_t>());
+    } else if (tile_size > largest.front()) {
+      std::pop_heap(largest.begin(), largest.end(),
+                    std::greater<tile_size_t>());
+      largest.back() = std::move(tile_size);
+      std::push_heap(largest.begin(), largest.end(),
+                     std::greater<tile_size_t>());
+    }
+  }
+
+  void operator+=(stats_t& other) {
+    for (const auto& [level, s] : other.levels)
+      levels[level] += s;
+    tiles.insert(tiles.end(), std::make_move_iterator(other.tiles.begin()),
+                 std::make_move_iterator(other.tiles.end()));
+    other.tiles.clear();
+    for (auto& tile_size : other.largest)
+      add_tile_size(std::move(tile_size));
+    other.largest.clear();
+    anomalies.insert(anomalies.end(),
+                     std::make_move_iterator(other.anomalies.begin()),
+                     std::make_move_iterator(other.anomalies.end()));
+    other.anomalies.clear();
+  }
+
+  level_stats_t total() const {
+    level_stats_t t;
+    for (const auto& level : levels)
+      t += level.second;
+    return t;
+  }
+};
+
+/**
+ * Fills the edge and node histograms of a single tile.
+ */
+void collect_histograms(const graph_tile_ptr& tile, level_stats_t& s) {
+  auto header = tile->header();
+  for (size_t i = 0; i < header->nodecount(); ++i) {
+    s.edges_per_node[tile->node(i)->edge_count()]++;
+  }
+
+  for (size_t i = 0; i < header->directededgecount(); ++i) {
+    auto* de = tile->directededge(i);
+    auto length = de->length();
+    s.edge_length += length;
+
+    if (de->is_shortcut()) {
+      s.shortcut_count++;
+      s.shortcut_length += length;
+      continue;
+    }
+
+    auto rc = static_cast<size_t>(de->classification());
+    auto use = std::min(static_cast<size_t>(de->use()), kUseCount - 1);
+    s.class_use[rc * kUseCount + use]++;
+    s.speed[de->speed() / kSpeedBinWidth]++;
+    s.surface[static_cast<size_t>(de->surface())]++;
+    s.length[std::bit_width(length)]++;
+
+    if (de->has_predicted_speed()) {
+      s.predicted_speed_count++;
+      s.predicted_speed_length += length;
+    }
+    s.free_flow_speed_count += de->free_flow_speed() > 0;
+    s.constrained_flow_speed_count += de->constrained_flow_speed() > 0;
+  }
+}
+
+std::string class_use_label(size_t idx) {
+  return to_string(static_cast<RoadClass>(idx / kUseCount)) + "/" +
+         to_string(static_cast<Use>(idx % kUseCount));
+}
+
+std::string speed_label(size_t idx) {
+  return std::to_string(idx * kSpeedBinWidth) + "-" +
+         std::to_string((idx + 1) * kSpeedBinWidth - 1);
+}
+
+std::string length_label(size_t idx) {
+  if (idx == 0)
+    return "0";
+  return std::to_string(1ULL << (idx - 1)) + "-" +
+         std::to_string((1ULL << idx) - 1);
+}
+
+/**
+ * Calls fn(histogram, bucket label, count) for every non-empty bucket.
+ */
+template <typename Fn>
+void for_each_bucket(const level_stats_t& s, Fn fn) {
+  for (size_t i = 0; i < s.class_use.size(); ++i)
+    if (s.class_use[i])
+      fn("class_use", class_use_label(i), s.class_use[i]);
+  for (size_t i = 0; i < s.speed.size(); ++i)
+    if (s.speed[i])
+      fn("speed_kph", speed_label(i), s.speed[i]);
+  for (size_t i = 0; i < s.surface.size(); ++i)
+    if (s.surface[i])
+      fn("surface", to_string(static_cast<Surface>(i)), s.surface[i]);
+  for (size_t i = 0; i < s.edges_per_node.size(); ++i)
+    if (s.edges_per_node[i])
+      fn("edges_per_node", std::to_string(i), s.edges_per_node[i]);
+  for (size_t i = 0; i < s.length.size(); ++i)
+    if (s.length[i])
+      fn("length_m", length_label(i), s.length[i]);
+  if (has_sections(s)) {
+    for (size_t i = 0; i < s.section_bytes.size(); ++i)
+      fn("section_bytes", kSectionNames[i], s.section_bytes[i]);
+  }
+}
+
+/**
+ * Long format CSV rows of a level or a tile, one per bucket.
+ */
+void write_csv_rows(std::ostream& out,
+                    const std::string& key,
+                    const level_stats_t& s) {
+  out << key << ",summary,tile_count," << s.tile_count << "\n"
+      << key << ",summary,node_count," << s.node_count << "\n"
+      << key << ",summary,directededge_count," << s.directededge_count
+      << "\n";
+  if (!has_sections(s)) {
+    out << key << ",summary,shortcut_count," << s.shortcut_count << "\n"
+        << key << ",summary,edge_length_m," << s.edge_length << "\n"
+        << key << ",summary,predicted_speed_count,"
+        << s.predicted_speed_count << "\n";
+  }
+  out << key << ",summary,tile_bytes," << s.tile_bytes << "\n";
+  for_each_bucket(s, [&](const std::string& histogram,
+                         const std::string& label, uint64_t count) {
+    out << key << "," << histogram << "," << label << "," << count
+        << "\n";
+  });
+}
+
+struct worker_t {
+  worker_t(boost::property_tree::ptree& config, const options_t& options)
+      : reader(config.get_child("mjolnir")) {
+    stats.top_n = options.sections ? options.top_n : 0;
+  }
+
+  GraphReader reader;
+  stats_t stats;
+};
+
+/**
+ * Peeks into the tile's header and adds it to the worker's stats
+ */
+void process_tile(worker_t& worker,
+                  const GraphId& tile_id,
+                  const options_t& options) {
+  auto& reader = worker.reader;
+  auto& stats = worker.stats;
+
+  graph_tile_ptr tile;
+  {
+    trace::span_t span("load", "io", "tile_id", tile_id.value);
+    tile = reader.GetGraphTile(tile_id);
+  }
+
+  if (!tile) {
+    return;
+  }
+
+  // Trim reader if over-committed
+  if (reader.OverCommitted()) {
+    reader.Trim();
+  }
+
+  trace::span_t span("decode", "tile", "tile_id", tile_id.value);
+  level_stats_t s;
+
+  auto header = tile->header();
+  s.tile_count = 1;
+  s.node_count = header->nodecount();
+  s.directededge_count = header->directededgecount();
+  s.acceessrestriction_count = header->access_restriction_count();
+  auto public_tile = static_cast<const PublicGraphtile*>(tile.get());
+  s.complexrestriction_count = public_tile->complex_restriction_count();
+  s.tile_bytes = header->end_offset();
+
+  if (options.sections) {
+    auto sections = get_sections(header);
+    for (size_t i = 0; i < sections.size(); ++i)
+      s.section_bytes[i] = sections[i];
+
+    auto anomaly = find_anomaly(header, sections);
+    if (!anomaly.empty())
+      stats.anomalies.push_back({tile_id, std::move(anomaly)});
+
+    stats.add_tile_size({tile_id, header->end_offset(), sections});
+  } else {
+    collect_histograms(tile, s);
+  }
+  stats.levels[tile_id.level()] += s;
+
+  if (options.per_tile) {
+    std::ostringstream csv;
+    write_csv_rows(csv, std::to_string(tile_id), s);
+    stats.tiles.push_back({tile_id, csv.str()});
+  }
+}
+
+/**
+ * Merges the per worker results pairwise, halving the number of partial
+ * results with every round. The result ends up in the first element.
+ */
+void reduce(executor_t& executor, std::vector<stats_t>& partials) {
+  for (size_t stride = 1; stride < partials.size(); stride *= 2) {
+    auto pairs = (partials.size() + stride - 1) / (2 * stride);
+    executor.for_each(pairs, [&](size_t, size_t pair) {
+      auto i = pair * 2 * stride;
+      partials[i] += partials[i + stride];
+    });
+  }
+}
+
+double ratio(uint64_t a, uint64_t b) {
+  return b ? static_cast<double>(a) / static_cast<double>(b) : 0.;
+}
+
+void serialize_level(rapidjson::writer_wrapper_t& writer,
+                     const level_stats_t& s) {
+  writer("tile_count", s.tile_count);
+  writer("node_count", s.node_count);
+  writer("directededge_count", s.directededge_count);
+  writer("access_restriction_count", s.acceessrestriction_count);
+  writer("complex_restriction_count", s.complexrestriction_count);
+
+  if (!has_sections(s)) {
+    writer("shortcut_count", s.shortcut_count);
+    writer("edge_length_km", static_cast<double>(s.edge_length) / 1000.);
+    writer("shortcut_ratio",
+           ratio(s.shortcut_count, s.directededge_count));
+    writer("shortcut_length_ratio",
+           ratio(s.shortcut_length, s.edge_length));
+
+    auto regular_count = s.directededge_count - s.shortcut_count;
+    auto regular_length = s.edge_length - s.shortcut_length;
+    writer.start_object("predicted_speeds");
+    writer("edge_count", s.predicted_speed_count);
+    writer("edge_coverage",
+           ratio(s.predicted_speed_count, regular_count));
+    writer("length_coverage",
+           ratio(s.predicted_speed_length, regular_length));
+    writer("free_flow_coverage",
+           ratio(s.free_flow_speed_count, regular_count));
+    writer("constrained_flow_coverage",
+           ratio(s.constrained_flow_speed_count, regular_count));
+    writer.end_object();
+  }
+
+  writer.start_object("histograms");
+  std::string current;
+  for_each_bucket(s, [&](const std::string& histogram,
+                         const std::string& label, uint64_t count) {
+    if (histogram != current) {
+      if (!current.empty())
+        writer.end_object();
+      writer.start_object(histogram);
+      current = histogram;
+    }
+    writer(label, count);
+  });
+  if (!current.empty())
+    writer.end_object();
+  writer.end_object();
+
+  writer("tile_bytes", s.tile_bytes);
+  writer("mean_tile_bytes", ratio(s.tile_bytes, s.tile_count));
+}
+
+/**
+ * The largest tiles, biggest first.
+ */
+std::vector<tile_size_t> sorted_largest(const stats_t& stats) {
+  auto largest = stats.largest;
+  std::sort(largest.begin(), largest.end(), std::greater<tile_size_t>());
+  return largest;
+}
+
+void write_json(std::ostream& out, const stats_t& stats) {
+  rapidjson::writer_wrapper_t writer(1 << 16);
+  writer.set_precision(6);
+  writer.start_object();
+  writer.start_object("total");
+  serialize_level(writer, stats.total());
+  writer.end_object();
+  writer.start_object("levels");
+  for (const auto& [level, s] : stats.levels) {
+    writer.start_object(std::to_string(level));
+    serialize_level(writer, s);
+    writer.end_object();
+  }
+  writer.end_object();
+
+  if (stats.top_n || !stats.anomalies.empty()) {
+    writer.start_array("largest_tiles");
+    for (const auto& tile_size : sorted_largest(stats)) {
+      writer.start_object();
+      writer("tile_id", std::to_string(tile_size.tile_id));
+      writer("bytes", tile_size.bytes);
+      writer.start_object("section_bytes");
+      for (size_t i = 0; i < tile_size.sections.size(); ++i)
+        writer(kSectionNames[i],
+               static_cast<int64_t>(tile_size.sections[i]));
+      writer.end_object();
+      writer.end_object();
+    }
+    writer.end_array();
+
+    writer.start_array("anomalies");
+    for (const auto& anomaly : stats.anomalies) {
+      writer.start_object();
+      writer("tile_id", std::to_string(anomaly.tile_id));
+      writer("reason", anomaly.reason);
+      writer.end_object();
+    }
+    writer.end_array();
+  }
+  writer.end_object();
+  out << writer.get_buffer() << "\n";
+}
+
+/**
+ * Long format, one row per bucket, which makes diffing two builds a join.
+ */
+void write_csv(std::ostream& out, const stats_t& stats) {
+  out << "level,histogram,bucket,count\n";
+  write_csv_rows(out, "all", stats.total());
+  for (const auto& [level, s] : stats.levels)
+    write_csv_rows(out, std::to_string(level), s);
+
+  for (const auto& tile_size : sorted_largest(stats)) {
+    out << tile_size.tile_id.level() << ",largest_tiles,"
+        << tile_size.tile_id << "," << tile_size.bytes << "\n";
+  }
+  for (const auto& anomaly : stats.anomalies) {
+    out << anomaly.tile_id.level() << ",anomaly_" << anomaly.reason << ","
+        << anomaly.tile_id << ",1\n";
+  }
+}
+
+/**
+ * The same long format as write_csv with a tile id instead of a level.
+ */
+void write_per_tile_csv(std::ostream& out, stats_t& stats) {
+  std::sort(stats.tiles.begin(), stats.tiles.end(),
+            [](const tile_row_t& a, const tile_row_t& b) {
+              return a.tile_id < b.tile_id;
+            });
+  out << "tile_id,histogram,bucket,count\n";
+  for (const auto& row : stats.tiles)
+    out << row.csv;
+}
+
+/**
+ * Opens an output file before the scan, so a bad path fails right away
+ * and not after the whole graph was read.
+ */
+std::ofstream open_output(const std::string& path) {
+  std::ofstream file(path);
+  if (!file)
+    throw std::runtime_error("Unable to open " + path);
+  return file;
+}
+
+} // namespace
+
+namespace valhalla {
+
+namespace tools {
+
+void tile_stats(boost::property_tree::ptree& config,
+                const options_t& options,
+                const std::string& output,
+                const std::string& format,
+                const std::string& per_tile_output) {
+  std::vector<GraphId> tiles;
+
+  std::ofstream output_file;
+  if (!output.empty() && output != "-")
+    output_file = open_output(output);
+  std::ofstream per_tile_file;
+  if (!per_tile_output.empty())
+    per_tile_file = open_output(per_tile_output);
+
+  GraphReader reader(config.get_child("mjolnir"));
+
+  for (const auto& tile : reader.GetTileSet()) {
+    tiles.push_back(tile);
+  }
+  auto shard = shard_t::from_config(config);
+  shard.select(config, tiles);
+
+  std::shuffle(tiles.begin(), tiles.end(), std::mt19937(0));
+
+  executor_t executor(executor_options_t::from_config(config));
+  per_worker_t<worker_t> workers(
+      executor, [&]() { return new worker_t(config, options); });
+  tile_prefetcher_t prefetcher(config, tiles);
+  executor.for_each(
+      tiles.size(),
+      [&](size_t worker, size_t i) {
+        prefetcher.advance(i);
+        process_tile(workers[worker], tiles[i], options);
+      },
+      "Collecting tile stats");
+  prefetcher.log_stats();
+
+  std::vector<stats_t> partials;
+  workers.for_each(
+      [&](worker_t& worker) { partials.push_back(std::move(worker.stats)); });
+  if (partials.empty())
+    partials.emplace_back();
+  reduce(executor, partials);
+  auto& stats = partials.front();
+  auto total = stats.total();
+
+  LOG_INFO("Finished tile stats");
+  LOG_INFO("Node count: " + std::to_string(total.node_count));
+  LOG_INFO("Directededge count: " +
+           std::to_string(total.directededge_count));
+  // shortcuts are only counted when the edges are read
+  if (!options.sections)
+    LOG_INFO("Shortcut count: " + std::to_string(total.shortcut_count));
+  LOG_INFO("Access restriction count: " +
+           std::to_string(total.acceessrestriction_count));
+  LOG_INFO("Complex restriction count: " +
+           std::to_string(total.complexrestriction_count));
+  if (options.sections) {
+    LOG_INFO("Tile bytes: " + std::to_string(total.tile_bytes));
+    for (size_t i = 0; i < total.section_bytes.size(); ++i) {
+      LOG_INFO("  " + std::string(kSectionNames[i]) + ": " +
+               std::to_string(total.section_bytes[i]));
+    }
+    for (const auto& anomaly : stats.anomalies) {
+      LOG_WARN("Tile " + std::to_string(anomaly.tile_id) + ": " +
+               anomaly.reason);
+    }
+  }
+
+  if (!output.empty()) {
+    std::ostream& out = output == "-" ? std::cout : output_file;
+    if (format == "csv")
+      write_csv(out, stats);
+    else
+      write_json(out, stats);
+    out.flush();
+    if (!out)
+      throw std::runtime_error("Unable to write " + output);
+    LOG_INFO("Wrote " + format + " stats to " + output);
+  }
+
+  if (!per_tile_output.empty()) {
+    write_per_tile_csv(per_tile_file, stats);
+    per_tile_file.flush();
+    if (!per_tile_file)
+      throw std::runtime_error("Unable to write " + per_tile_output);
+    LOG_INFO("Wrote per tile stats to " + per_tile_output);
+  }
+  shard.mark_done();
+}
+
+} // namespace tools
+} // namespace valhalla
@@ -0,0 +1,218 @@
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include <unistd.h>
+
+#include <valhalla/midgard/logging.h>
+
+#include "trace.h"
+
+namespace {
+using namespace valhalla::tools::trace;
+
+constexpr size_t kChunkSize = 4096;
+
+struct event_t {
+  const char* name;
+  const char* category;
+  const char* arg_name;
+  uint64_t arg;
+  uint64_t start;
+  uint64_t end;
+};
+
+/**
+ * A fixed block of events. Only the owning thread appends, the writer
+ * only reads up to the published size, so neither needs a lock.
+ */
+struct chunk_t {
+  std::array<event_t, kChunkSize> events;
+  std::atomic<size_t> size{0};
+  std::atomic<chunk_t*> next{nullptr};
+};
+
+struct buffer_t {
+  explicit buffer_t(uint32_t id) : tid(id), tail(&head) {
+  }
+
+  uint32_t tid;
+  chunk_t head;
+  chunk_t* tail;
+};
+
+struct registry_t {
+  std::mutex lock;
+  std::vector<std::unique_ptr<buffer_t>> buffers;
+  std::string path;
+  uint64_t epoch{0};
+};
+
+// never destroyed, threads that outlive main might still record
+registry_t& registry() {
+  static auto* registry = new registry_t;
+  return *registry;
+}
+
+// the lock is only taken once per thread, on its first span
+buffer_t& local_buffer() {
+  thread_local buffer_t* buffer = nullptr;
+  if (!buffer) {
+    auto& r = registry();
+    std::lock_guard l(r.lock);
+    r.buffers.emplace_back(std::make_unique<buffer_t>(r.buffers.size() + 1));
+    buffer = r.buffers.back().get();
+  }
+  return *buffer;
+}
+
+void write_string(std::ostream& out, const char* str) {
+  out << '"';
+  for (; *str; ++str) {
+    if (*str == '"' || *str == '\\')
+      out << '\\';
+    out << *str;
+  }
+  out << '"';
+}
+
+// trace-event timestamps are in microseconds
+void write_micros(std::ostream& out, uint64_t nanos) {
+  out << nanos / 1000 << '.' << std::setw(3) << std::setfill('0')
+      << nanos % 1000;
+}
+
+void write_trace(std::ostream& out, registry_t& r) {
+  auto pid = getpid();
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  for (const auto& buffer : r.buffers) {
+    out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\","
+        << "\"pid\":" << pid << ",\"tid\":" << buffer->tid
+        << ",\"args\":{\"name\":\"thread " << buffer->tid << "\"}}";
+    first = false;
+
+    for (const chunk_t* chunk = &buffer->head; chunk;
+         chunk = chunk->next.load(std::memory_order_acquire)) {
+      auto size = chunk->size.load(std::memory_order_acquire);
+      for (size_t i = 0; i < size; ++i) {
+        const auto& e = chunk->events[i];
+        if (e.start < r.epoch)
+          continue;
+        out << ",\n{\"name\":";
+        write_string(out, e.name);
+        out << ",\"cat\":";
+        write_string(out, e.category);
+        out << ",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << buffer->tid
+            << ",\"ts\":";
+        write_micros(out, e.start - r.epoch);
+        out << ",\"dur\":";
+        write_micros(out, e.end - e.start);
+        if (e.arg_name) {
+          out << ",\"args\":{";
+          write_string(out, e.arg_name);
+          out << ':' << e.arg << '}';
+        }
+        out << '}';
+      }
+    }
+  }
+  out << "\n]}\n";
+}
+
+// tools that call exit() still write their trace, like on a normal
+// return from main. One killed by a signal writes none.
+void stop_at_exit() {
+  try {
+    stop();
+  } catch (const std::exception& e) {
+    LOG_ERROR(e.what());
+  }
+}
+
+} // namespace
+
+namespace valhalla {
+
+namespace tools {
+
+namespace trace {
+
+namespace detail {
+std::atomic<bool> enabled{false};
+
+uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void record(const char* name,
+            const char* category,
+            uint64_t start,
+            uint64_t end,
+            const char* arg_name,
+            uint64_t arg) {
+  auto& buffer = local_buffer();
+  auto* chunk = buffer.tail;
+  auto size = chunk->size.load(std::memory_order_relaxed);
+  if (size == kChunkSize) {
+    auto* next = new chunk_t;
+    chunk->next.store(next, std::memory_order_release);
+    buffer.tail = chunk = next;
+    size = 0;
+  }
+  chunk->events[size] = {name, category, arg_name, arg, start, end};
+  chunk->size.store(size + 1, std::memory_order_release);
+}
+} // namespace detail
+
+void start(const std::string& path) {
+  auto& r = registry();
+  {
+    std::lock_guard l(r.lock);
+    r.path = path;
+    r.epoch = detail::now();
+  }
+  static bool registered = std::atexit(stop_at_exit) == 0;
+  (void)registered;
+  detail::enabled.store(true, std::memory_order_relaxed);
+}
+
+void stop() {
+  if (!detail::enabled.exchange(false))
+    return;
+
+  auto& r = registry();
+  std::lock_guard l(r.lock);
+  std::ofstream out(r.path);
+  if (!out)
+    throw std::runtime_error("Unable to open trace file " + r.path);
+  write_trace(out, r);
+  LOG_INFO("Wrote trace to " + r.path);
+}
+
+session_t::session_t(const std::string& path) : active_(!path.empty()) {
+  if (active_)
+    start(path);
+}
+
+session_t::~session_t() {
+  if (!active_)
+    return;
+  try {
+    stop();
+  } catch (const std::exception& e) {
+    LOG_ERROR(e.what());
+  }
+}
+
+} // namespace trace
+} // namespace tools
+} // namespace valhalla
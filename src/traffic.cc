@@ -1,40 +1,35 @@
 #include <filesystem>
 #include <fstream>
-#include <queue>
-#include <thread>
+#include <memory>
+#include <executor.h>
+#include <prefetch.h>
+#include <shard.h>
+#include <trace.h>
 #include <traffic.h>
 #include <valhalla/baldr/graphreader.h>
 
 namespace {
 using namespace valhalla;
 
-void work(std::queue<baldr::GraphId>& tile_queue,
-          std::mutex& lock,
-          const boost::property_tree::ptree& pt) {
-
-  std::string tile_dir = pt.get<std::string>("mjolnir.tile_dir");
-  baldr::GraphId tile_id;
-  while (true) {
-    {
-      std::lock_guard l(lock);
-      if (tile_queue.empty())
-        break;
-      tile_id = tile_queue.front();
-      tile_queue.pop();
-    }
-
-    auto tile_path = tile_dir +
-                     std::filesystem::path::preferred_separator +
-                     baldr::GraphTile::FileSuffix(tile_id);
-    if (!std::filesystem::exists(tile_path)) {
-      LOG_ERROR("No tile at " + tile_path);
-      continue;
-    }
+void remove_from_tile(const std::string& tile_dir,
+                      const baldr::GraphId& tile_id) {
+  auto tile_path = tile_dir + std::filesystem::path::preferred_separator +
+                   baldr::GraphTile::FileSuffix(tile_id);
+  if (!std::filesystem::exists(tile_path)) {
+    LOG_ERROR("No tile at " + tile_path);
+    return;
+  }
 
-    // Get the tile and remove traffic
-    tools::EnhancedGraphTileBuilder tile_builder(tile_dir, tile_id, false);
-    tile_builder.RemovePredictedTraffic();
+  // Get the tile and remove traffic
+  tools::trace::span_t span("remove_predicted_traffic", "tile", "tile_id",
+                            tile_id.value);
+  std::unique_ptr<tools::EnhancedGraphTileBuilder> tile_builder;
+  {
+    tools::trace::span_t load("load", "io", "tile_id", tile_id.value);
+    tile_builder = std::make_unique<tools::EnhancedGraphTileBuilder>(
+        tile_dir, tile_id, false);
   }
+  tile_builder->RemovePredictedTraffic();
 }
 } // namespace
 namespace valhalla {
@@ -46,25 +41,25 @@ void remove_predicted_traffic(boost::property_tree::ptree& pt) {
   pt.erase("mjolnir.tile_extract"); // ignore the extract
   baldr::GraphReader reader(pt.get_child("mjolnir"));
 
-  std::queue<baldr::GraphId> tile_queue;
-  for (const auto& tile_id : reader.GetTileSet()) {
-    tile_queue.emplace(tile_id);
-  }
-
-  std::vector<std::shared_ptr<std::thread>> threads(
-      pt.get<size_t>("mjolnir.concurrency"));
-  std::mutex lock;
-
-  for (size_t i = 0; i < threads.size(); ++i) {
-    threads[i] =
-        std::make_shared<std::thread>(work, std::ref(tile_queue),
-                                      std::ref(lock), std::cref(pt));
-  }
-
-  for (const auto& thread : threads)
-    thread->join();
+  auto tile_set = reader.GetTileSet();
+  std::vector<baldr::GraphId> tiles(tile_set.begin(), tile_set.end());
+  auto tile_dir = pt.get<std::string>("mjolnir.tile_dir");
+  auto shard = shard_t::from_config(pt);
+  shard.select(pt, tiles);
+
+  executor_t executor(executor_options_t::from_config(pt));
+  tile_prefetcher_t prefetcher(pt, tiles);
+  executor.for_each(
+      tiles.size(),
+      [&](size_t, size_t i) {
+        prefetcher.advance(i);
+        remove_from_tile(tile_dir, tiles[i]);
+      },
+      "Removing predicted traffic");
+  prefetcher.log_stats();
 
   LOG_INFO("Finished removing traffic from tiles");
+  shard.mark_done();
 }
 
 void EnhancedGraphTileBuilder::RemovePredictedTraffic() {
@@ -100,6 +95,7 @@ void EnhancedGraphTileBuilder::RemovePredictedTraffic() {
   header_builder_.set_predictedspeeds_offset(0);
 
   // Open file and truncate
+  trace::span_t span("write", "io");
   std::ofstream file(filename.c_str(),
                      std::ios::out | std::ios::binary | std::ios::trunc);
   if (file.is_open()) {
@@ -0,0 +1,83 @@
+#include "executor.h"
+#include "tile_patch.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cxxopts.hpp>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+#include <valhalla/midgard/logging.h>
+
+using namespace valhalla;
+
+int main(int argc, char** argv) {
+  const auto program = std::filesystem::path(__FILE__).stem().string();
+  std::string extract, patch, output;
+  size_t concurrency = std::thread::hardware_concurrency();
+  std::string trace_path;
+
+  try {
+    cxxopts::Options options(program,
+                             "applies a patch written by "
+                             "valhalla_make_tile_patch to a tile extract "
+                             "and verifies the checksum of every patched "
+                             "tile.");
+
+    // clang-format off
+    options.add_options()
+    ("h,help", "Print this help message.")
+    ("x,extract", "The tile extract to patch.", cxxopts::value<std::string>(extract))
+    ("p,patch", "The patch to apply.", cxxopts::value<std::string>(patch))
+    ("o,output", "The patched extract to write, defaults to replacing the extract.", cxxopts::value<std::string>(output))
+    ("j,concurrency", "Number of threads to use.", cxxopts::value<size_t>())
+    ("trace", "Write a Chrome trace of the run to this file, it can be opened in Perfetto.", cxxopts::value<std::string>(trace_path));
+    // clang-format on
+
+    auto result = options.parse(argc, argv);
+    if (result.count("help")) {
+      std::cout << options.help() << "\n";
+      return EXIT_SUCCESS;
+    }
+    if (extract.empty())
+      throw cxxopts::exceptions::missing_argument("extract");
+    if (patch.empty())
+      throw cxxopts::exceptions::missing_argument("patch");
+    if (result.count("concurrency"))
+      concurrency = std::max(result["concurrency"].as<size_t>(), size_t(1));
+  } catch (cxxopts::exceptions::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  } catch (std::exception& e) {
+    std::cerr << "Unable to parse command line options because: "
+              << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  tools::trace::session_t trace_session(trace_path);
+  try {
+    auto start = std::chrono::steady_clock::now();
+
+    tools::executor_options_t executor_options;
+    executor_options.concurrency = concurrency;
+    tools::executor_t executor(executor_options);
+    auto stats = tools::apply_patch(extract, patch, output, executor);
+
+    auto seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    LOG_INFO(std::to_string(stats.changed) + " changed, " +
+             std::to_string(stats.added) + " added, " +
+             std::to_string(stats.deleted) + " deleted and " +
+             std::to_string(stats.unchanged) + " unchanged tiles");
+    LOG_INFO("Patched " + (output.empty() ? extract : output) + " (" +
+             std::to_string(stats.new_bytes) + " bytes of tiles) in " +
+             std::to_string(seconds) + "s");
+  } catch (std::exception& e) {
+    std::cerr << "Failed to apply tile patch: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <chrono>
+#include <cxxopts.hpp>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <valhalla/baldr/graphid.h>
+#include <valhalla/baldr/graphtileheader.h>
+#include <valhalla/baldr/traffictile.h>
+#include <valhalla/midgard/logging.h>
+
+#include "argparse_utils.h"
+#include "executor.h"
+#include "tile_extract.h"
+#include "trace.h"
+
+namespace {
+using namespace valhalla;
+
+struct tile_file_t {
+  std::filesystem::path path;
+  uint32_t tile_id;
+  uint32_t size;
+  uint32_t edge_count;
+};
+
+uint32_t read_edge_count(const std::filesystem::path& path) {
+  baldr::GraphTileHeader header;
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Unable to open " + path.string());
+  auto read = ::pread(fd, &header, sizeof(header), 0);
+  ::close(fd);
+  if (read != sizeof(header))
+    throw std::runtime_error("Unable to read tile header of " +
+                             path.string());
+  return header.directededgecount();
+}
+
+/**
+ * Finds all tiles in the tile dir. The directories one below the levels
+ * are walked in parallel, that's where the bulk of the files are.
+ */
+std::vector<tile_file_t> find_tiles(const std::filesystem::path& tile_dir,
+                                    bool with_edge_counts,
+                                    tools::executor_t& executor) {
+  std::vector<std::filesystem::path> dirs;
+  for (const auto& level : std::filesystem::directory_iterator(tile_dir)) {
+    auto name = level.path().filename().string();
+    if (!level.is_directory() ||
+        name.find_first_not_of("0123456789") != std::string::npos)
+      continue;
+    for (const auto& dir : std::filesystem::directory_iterator(level))
+      if (dir.is_directory())
+        dirs.push_back(dir.path());
+  }
+
+  std::vector<tile_file_t> tiles;
+  std::mutex lock;
+  executor.for_each(
+      dirs.size(),
+      [&](size_t, size_t i) {
+        std::vector<tile_file_t> found;
+        for (const auto& entry :
+             std::filesystem::recursive_directory_iterator(dirs[i])) {
+          tile_file_t tile{entry.path(), 0, 0, 0};
+          if (!entry.is_regular_file() ||
+              !tools::tile_id_from_path(
+                  entry.path().lexically_relative(tile_dir).generic_string(),
+                  tile.tile_id))
+            continue;
+          tile.size = static_cast<uint32_t>(entry.file_size());
+          if (with_edge_counts)
+            tile.edge_count = read_edge_count(entry.path());
+          found.push_back(std::move(tile));
+        }
+        std::lock_guard l(lock);
+        std::move(found.begin(), found.end(), std::back_inserter(tiles));
+      },
+      "Scanning directories");
+
+  std::sort(tiles.begin(), tiles.end(), [](const auto& a, const auto& b) {
+    return a.tile_id < b.tile_id;
+  });
+  return tiles;
+}
+
+int open_output(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    throw std::runtime_error("Unable to open " + path);
+  return fd;
+}
+
+void write_tile_extract(const std::vector<tile_file_t>& tiles,
+                        const std::string& path,
+                        tools::executor_t& executor) {
+  std::vector<tools::tile_index_entry_t> entries;
+  entries.reserve(tiles.size());
+  for (const auto& tile : tiles)
+    entries.push_back({0, tile.tile_id, tile.size});
+  auto total_size = tools::layout_extract(entries);
+
+  int out_fd = open_output(path);
+  try {
+    tools::write_extract_skeleton(out_fd, entries, total_size);
+    executor.for_each(
+        tiles.size(),
+        [&](size_t, size_t i) {
+          int in_fd = ::open(tiles[i].path.c_str(), O_RDONLY);
+          if (in_fd < 0)
+            throw std::runtime_error("Unable to open " +
+                                     tiles[i].path.string());
+          try {
+            tools::copy_range(in_fd, 0, out_fd, entries[i].offset,
+                              entries[i].size);
+          } catch (...) {
+            ::close(in_fd);
+            throw;
+          }
+          ::close(in_fd);
+        },
+        "Copying tiles");
+  } catch (...) {
+    ::close(out_fd);
+    throw;
+  }
+  ::close(out_fd);
+}
+
+/**
+ * A traffic extract with a header and zeroed speeds for every directed
+ * edge of every tile, ready to be filled by a live traffic feed
+ */
+void write_traffic_extract(const std::vector<tile_file_t>& tiles,
+                           const std::string& path) {
+  std::vector<tools::tile_index_entry_t> entries;
+  entries.reserve(tiles.size());
+  for (const auto& tile : tiles) {
+    entries.push_back({0, tile.tile_id,
+                       static_cast<uint32_t>(
+                           sizeof(baldr::TrafficTileHeader) +
+                           tile.edge_count * sizeof(baldr::TrafficSpeed))});
+  }
+  auto total_size = tools::layout_extract(entries);
+
+  int out_fd = open_output(path);
+  try {
+    // the speeds stay zero, the file is sparse until they're written
+    tools::write_extract_skeleton(out_fd, entries, total_size);
+    for (size_t i = 0; i < tiles.size(); ++i) {
+      baldr::TrafficTileHeader header{};
+      header.tile_id = tiles[i].tile_id;
+      header.traffic_tile_version = baldr::TRAFFIC_TILE_VERSION;
+      header.directed_edge_count = tiles[i].edge_count;
+      tools::write_at(out_fd, &header, sizeof(header), entries[i].offset);
+    }
+  } catch (...) {
+    ::close(out_fd);
+    throw;
+  }
+  ::close(out_fd);
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  const auto program = filesystem::path(__FILE__).stem().string();
+  boost::property_tree::ptree pt;
+  bool with_traffic = false;
+  std::string trace_path;
+
+  try {
+    cxxopts::Options
+        options(program,
+                "packs a tile directory into an indexed tile extract.\n");
+
+    // clang-format off
+    options.add_options()
+    ("h,help", "Print this help message.")
+    ("j,concurrency", "Number of threads to use.", cxxopts::value<unsigned int>())
+    ("c,config", "Path to the json configuration file.", cxxopts::value<std::string>())
+    ("i,inline-config", "Inline json config.",cxxopts::value<std::string>())
+    ("t,with-traffic", "Also write an empty traffic extract to mjolnir.traffic_extract.", cxxopts::value<bool>(with_traffic))
+    ("trace", "Write a Chrome trace of the run to this file, it can be opened in Perfetto.", cxxopts::value<std::string>(trace_path));
+    // clang-format on
+
+    auto result = options.parse(argc, argv);
+    options.custom_help("");
+    if (!parse_common_args(program, options, result, pt, "mjolnir.logging",
+                           true))
+      return EXIT_SUCCESS;
+
+  } catch (cxxopts::exceptions::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  } catch (std::exception& e) {
+    std::cerr << "Unable to parse command line options because: "
+              << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  tools::trace::session_t trace_session(trace_path);
+  try {
+    auto start = std::chrono::steady_clock::now();
+    tools::executor_t executor(tools::executor_options_t::from_config(pt));
+    auto tile_dir = pt.get<std::string>("mjolnir.tile_dir");
+    auto tile_extract = pt.get<std::string>("mjolnir.tile_extract");
+
+    std::vector<tile_file_t> tiles;
+    {
+      tools::trace::span_t span("find_tiles", "phase");
+      tiles = find_tiles(tile_dir, with_traffic, executor);
+    }
+    if (tiles.empty())
+      throw std::runtime_error("No tiles found in " + tile_dir);
+    LOG_INFO("Found " + std::to_string(tiles.size()) + " tiles in " +
+             tile_dir);
+
+    write_tile_extract(tiles, tile_extract, executor);
+    LOG_INFO("Finished tile extract " + tile_extract);
+
+    if (with_traffic) {
+      auto traffic_extract = pt.get<std::string>("mjolnir.traffic_extract");
+      write_traffic_extract(tiles, traffic_extract);
+      LOG_INFO("Finished traffic extract " + traffic_extract);
+    }
+
+    auto seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    LOG_INFO("Took " + std::to_string(seconds) + "s");
+  } catch (std::exception& e) {
+    LOG_ERROR("Failed to build extract: " + std::string(e.what()));
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
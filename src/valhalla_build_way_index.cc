@@ -0,0 +1,69 @@
+#include <chrono>
+#include <cxxopts.hpp>
+#include <filesystem>
+#include <thread>
+
+#include <valhalla/midgard/logging.h>
+
+#include "argparse_utils.h"
+#include "trace.h"
+#include "way_index.h"
+
+using namespace valhalla;
+
+int main(int argc, char** argv) {
+  const auto program = filesystem::path(__FILE__).stem().string();
+  boost::property_tree::ptree pt;
+  std::string output;
+  std::string trace_path;
+
+  try {
+    cxxopts::Options
+        options(program,
+                "writes an index from OSM way ids to the directed edges "
+                "of a valhalla graph.\n");
+
+    // clang-format off
+    options.add_options()
+    ("h,help", "Print this help message.")
+    ("j,concurrency", "Number of threads to use.", cxxopts::value<unsigned int>())
+    ("c,config", "Path to the json configuration file.", cxxopts::value<std::string>())
+    ("i,inline-config", "Inline json config.",cxxopts::value<std::string>())
+    ("o,output", "The index file to write, defaults to mjolnir.way_index.", cxxopts::value<std::string>(output))
+    ("trace", "Write a Chrome trace of the run to this file, it can be opened in Perfetto.", cxxopts::value<std::string>(trace_path));
+    // clang-format on
+
+    auto result = options.parse(argc, argv);
+    options.custom_help("");
+    if (!parse_common_args(program, options, result, pt, "mjolnir.logging",
+                           true))
+      return EXIT_SUCCESS;
+
+    if (output.empty())
+      output = pt.get<std::string>("mjolnir.way_index", "");
+    if (output.empty())
+      throw cxxopts::exceptions::missing_argument("output");
+
+  } catch (cxxopts::exceptions::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  } catch (std::exception& e) {
+    std::cerr << "Unable to parse command line options because: "
+              << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  tools::trace::session_t trace_session(trace_path);
+  try {
+    auto start = std::chrono::steady_clock::now();
+    tools::build_way_index(pt, output);
+    auto seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    LOG_INFO("Took " + std::to_string(seconds) + "s");
+  } catch (std::exception& e) {
+    LOG_ERROR("Failed to build way index: " + std::string(e.what()));
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,790 @@
+#include <algorithm>
+#include <atomic>
+#include <boost/property_tree/ptree_fwd.hpp>
+#include <cxxopts.hpp>
+#include <numeric>
+#include <valhalla/baldr/graphid.h>
+#include <valhalla/baldr/graphreader.h>
+#include <valhalla/baldr/rapidjson_utils.h>
+#include <valhalla/sif/dynamiccost.h>
+
+#include "argparse_utils.h"
+#include "costing.h"
+#include "executor.h"
+#include "trace.h"
+#include <bit>
+#include <fstream>
+#include <gdal_priv.h>
+#include <mutex>
+#include <ogrsf_frmts.h>
+
+namespace {
+using namespace valhalla::baldr;
+using valhalla::tools::executor_options_t;
+using valhalla::tools::executor_t;
+using valhalla::tools::per_worker_t;
+namespace trace = valhalla::tools::trace;
+
+constexpr uint32_t kInvalidIndex = std::numeric_limits<uint32_t>::max();
+
+// per node flags
+constexpr uint8_t kAllowed = 1;
+constexpr uint8_t kForward = 2;
+constexpr uint8_t kBackward = 4;
+
+/**
+ * Calls fn(begin, end) for chunks of [0, count) on the executor.
+ */
+template <typename Fn>
+void parallel_chunks(executor_t& executor,
+                     size_t count,
+                     size_t chunk_size,
+                     Fn fn) {
+  executor.for_each((count + chunk_size - 1) / chunk_size,
+                    [&](size_t, size_t chunk) {
+                      auto begin = chunk * chunk_size;
+                      fn(begin, std::min(begin + chunk_size, count));
+                    });
+}
+
+/**
+ * Lock free union-find over the global node space. Roots are always
+ * linked below the smaller index so parent pointers only ever decrease,
+ * which makes concurrent path halving safe.
+ */
+class union_find_t {
+public:
+  explicit union_find_t(size_t n) : parents_(n) {
+    for (size_t i = 0; i < n; ++i)
+      parents_[i].store(static_cast<uint32_t>(i), std::memory_order_relaxed);
+  }
+
+  uint32_t find(uint32_t x) {
+    while (true) {
+      auto p = parents_[x].load(std::memory_order_relaxed);
+      if (p == x)
+        return x;
+      auto gp = parents_[p].load(std::memory_order_relaxed);
+      if (p != gp)
+        parents_[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+      x = gp;
+    }
+  }
+
+  void unite(uint32_t a, uint32_t b) {
+    while (true) {
+      a = find(a);
+      b = find(b);
+      if (a == b)
+        return;
+      if (a < b)
+        std::swap(a, b);
+      auto expected = a;
+      if (parents_[a].compare_exchange_strong(expected, b,
+                                              std::memory_order_relaxed))
+        return;
+    }
+  }
+
+private:
+  std::vector<std::atomic<uint32_t>> parents_;
+};
+
+/**
+ * Maps GraphIds to indices in a dense, global node space: the tiles are
+ * sorted and every tile gets the range of indices after its predecessor.
+ */
+class node_space_t {
+public:
+  void init(std::vector<GraphId>&& tiles) {
+    tiles_ = std::move(tiles);
+    std::sort(tiles_.begin(), tiles_.end());
+    for (size_t i = 0; i < tiles_.size(); ++i) {
+      auto& lookup = lookup_[tiles_[i].level()];
+      if (lookup.size() <= tiles_[i].tileid())
+        lookup.resize(tiles_[i].tileid() + 1, kInvalidIndex);
+      lookup[tiles_[i].tileid()] = static_cast<uint32_t>(i);
+    }
+    bases_.resize(tiles_.size() + 1, 0);
+  }
+
+  void set_node_count(size_t tile_index, uint32_t count) {
+    bases_[tile_index + 1] = count;
+  }
+
+  // turns the counts into offsets
+  void finalize() {
+    std::partial_sum(bases_.begin(), bases_.end(), bases_.begin());
+    if (bases_.back() >= kInvalidIndex)
+      throw std::runtime_error("Too many nodes for 32 bit node indices");
+  }
+
+  uint32_t index(const GraphId& node) const {
+    const auto& lookup = lookup_[node.level()];
+    if (node.tileid() >= lookup.size() ||
+        lookup[node.tileid()] == kInvalidIndex)
+      return kInvalidIndex;
+    return static_cast<uint32_t>(bases_[lookup[node.tileid()]] + node.id());
+  }
+
+  uint32_t base(size_t tile_index) const {
+    return static_cast<uint32_t>(bases_[tile_index]);
+  }
+
+  const std::vector<GraphId>& tiles() const {
+    return tiles_;
+  }
+
+  size_t node_count() const {
+    return bases_.back();
+  }
+
+  // reverse lookup, only used for the few nodes we report
+  GraphId graph_id(uint32_t index) const {
+    auto it = std::upper_bound(bases_.begin(), bases_.end(), index) - 1;
+    auto tile_index = std::distance(bases_.begin(), it);
+    const auto& tile = tiles_[tile_index];
+    return GraphId(tile.tileid(), tile.level(), index - *it);
+  }
+
+private:
+  std::vector<GraphId> tiles_;
+  std::vector<uint64_t> bases_;
+  std::array<std::vector<uint32_t>, 8> lookup_;
+};
+
+/**
+ * Compressed sparse row adjacency
+ */
+struct csr_t {
+  std::vector<uint64_t> offsets;
+  std::vector<uint32_t> targets;
+};
+
+struct options_t {
+  bool strong{false};
+  uint32_t max_component_size{0};
+  std::string output_dir;
+};
+
+class connectivity_t {
+public:
+  connectivity_t(const boost::property_tree::ptree& config,
+                 const valhalla::sif::cost_ptr_t& costing,
+                 const options_t& options)
+      : config_(config), costing_(costing), options_(options),
+        executor_(executor_options_t::from_config(config)),
+        readers_(executor_, [&config]() {
+          return new GraphReader(config.get_child("mjolnir"));
+        }) {
+  }
+
+  void run(std::ostream& out);
+
+private:
+  /**
+   * Calls fn(reader, tile index, tile) for every tile on the executor,
+   * every worker keeps its own reader across the phases.
+   */
+  template <typename Fn>
+  void for_each_tile(Fn fn, const std::string& label = "") {
+    executor_.for_each(
+        space_.tiles().size(),
+        [&](size_t worker, size_t i) {
+          auto& reader = readers_[worker];
+          if (reader.OverCommitted())
+            reader.Trim();
+          const auto& tile_id = space_.tiles()[i];
+          graph_tile_ptr tile;
+          {
+            trace::span_t span("load", "io", "tile_id", tile_id.value);
+            tile = reader.GetGraphTile(tile_id);
+          }
+          if (tile) {
+            trace::span_t span("process", "tile", "tile_id", tile_id.value);
+            fn(reader, i, tile);
+          }
+        },
+        label);
+  }
+
+  /**
+   * Calls fn(from, to) for every arc leaving the nodes of a tile that is
+   * allowed by the costing, i.e. directed edges and transitions.
+   */
+  template <typename Fn>
+  void for_each_arc(size_t tile_index, const graph_tile_ptr& tile, Fn fn) {
+    auto base = space_.base(tile_index);
+    for (uint32_t n = 0; n < tile->header()->nodecount(); ++n) {
+      auto from = base + n;
+      if (!(flags_[from] & kAllowed))
+        continue;
+      const auto* ni = tile->node(n);
+      for (uint32_t e = 0; e < ni->edge_count(); ++e) {
+        const auto* de = tile->directededge(ni->edge_index() + e);
+        if (de->is_shortcut() ||
+            !costing_->Allowed(de, tile, valhalla::sif::kDisallowNone))
+          continue;
+        auto to = space_.index(de->endnode());
+        if (to != kInvalidIndex && (flags_[to] & kAllowed))
+          fn(from, to);
+      }
+      for (uint32_t t = 0; t < ni->transition_count(); ++t) {
+        const auto* trans = tile->transition(ni->transition_index() + t);
+        auto to = space_.index(trans->endnode());
+        if (to != kInvalidIndex && (flags_[to] & kAllowed))
+          fn(from, to);
+      }
+    }
+  }
+
+  void index_nodes();
+  void weak_components();
+  void build_csr();
+  void strong_components();
+  void bfs(const csr_t& graph, uint32_t source, uint8_t flag);
+  void tarjan(const std::vector<uint32_t>& nodes,
+              std::vector<uint32_t>& index,
+              std::vector<uint32_t>& low,
+              uint32_t& counter);
+  void export_components(const std::vector<uint32_t>& labels,
+                         const std::vector<uint32_t>& sizes,
+                         const std::string& name);
+  void serialize(rapidjson::writer_wrapper_t& writer,
+                 const std::vector<uint32_t>& labels,
+                 const std::vector<uint32_t>& sizes);
+
+  const boost::property_tree::ptree& config_;
+  valhalla::sif::cost_ptr_t costing_;
+  const options_t& options_;
+  executor_t executor_;
+  per_worker_t<GraphReader> readers_;
+
+  node_space_t space_;
+  std::vector<uint8_t> flags_;
+  std::vector<uint32_t> weak_;
+  std::vector<uint32_t> weak_sizes_;
+  std::vector<uint32_t> out_degrees_;
+  csr_t forward_;
+  csr_t backward_;
+  std::vector<uint32_t> strong_;
+  std::vector<uint32_t> strong_sizes_;
+};
+
+/**
+ * Counts the nodes per tile to lay out the global node space and flags the
+ * nodes the costing allows.
+ */
+void connectivity_t::index_nodes() {
+  {
+    GraphReader reader(config_.get_child("mjolnir"));
+    auto tile_set = reader.GetTileSet();
+    space_.init(std::vector<GraphId>(tile_set.begin(), tile_set.end()));
+  }
+
+  std::vector<std::vector<uint8_t>> allowed(space_.tiles().size());
+  for_each_tile(
+      [&](GraphReader&, size_t i, const graph_tile_ptr& tile) {
+        space_.set_node_count(i, tile->header()->nodecount());
+        auto& a = allowed[i];
+        a.resize(tile->header()->nodecount());
+        for (uint32_t n = 0; n < a.size(); ++n)
+          a[n] = costing_->Allowed(tile->node(n)) ? kAllowed : 0;
+      },
+      "Indexing nodes");
+  space_.finalize();
+
+  flags_.resize(space_.node_count());
+  for (size_t i = 0; i < allowed.size(); ++i) {
+    std::copy(allowed[i].begin(), allowed[i].end(),
+              flags_.begin() + space_.base(i));
+  }
+  LOG_INFO("Indexed " + std::to_string(space_.node_count()) +
+           " nodes in " + std::to_string(space_.tiles().size()) + " tiles");
+}
+
+/**
+ * Unites the end points of every allowed arc and counts the out degrees
+ * on the way, which we need for the adjacency later on.
+ */
+void connectivity_t::weak_components() {
+  union_find_t uf(space_.node_count());
+  out_degrees_.assign(space_.node_count(), 0);
+  for_each_tile(
+      [&](GraphReader&, size_t i, const graph_tile_ptr& tile) {
+        for_each_arc(i, tile, [&](uint32_t from, uint32_t to) {
+          out_degrees_[from]++;
+          uf.unite(from, to);
+        });
+      },
+      "Uniting arcs");
+
+  weak_.resize(space_.node_count());
+  parallel_chunks(executor_, weak_.size(), 1 << 16,
+                  [&](size_t begin, size_t end) {
+                    for (size_t n = begin; n < end; ++n)
+                      weak_[n] = uf.find(static_cast<uint32_t>(n));
+                  });
+}
+
+void connectivity_t::build_csr() {
+  auto n = space_.node_count();
+  forward_.offsets.resize(n + 1, 0);
+  std::partial_sum(out_degrees_.begin(), out_degrees_.end(),
+                   forward_.offsets.begin() + 1);
+  out_degrees_.clear();
+  out_degrees_.shrink_to_fit();
+  forward_.targets.resize(forward_.offsets.back());
+
+  // every node's arcs come from its own tile so tiles fill disjoint ranges
+  for_each_tile(
+      [&](GraphReader&, size_t i, const graph_tile_ptr& tile) {
+        uint32_t current = kInvalidIndex;
+        uint64_t pos = 0;
+        for_each_arc(i, tile, [&](uint32_t from, uint32_t to) {
+          if (from != current) {
+            current = from;
+            pos = forward_.offsets[from];
+          }
+          forward_.targets[pos++] = to;
+        });
+      },
+      "Building adjacency");
+
+  // transpose for the backward search
+  std::vector<std::atomic<uint32_t>> in_degrees(n);
+  parallel_chunks(executor_, n, 1 << 14, [&](size_t begin, size_t end) {
+    for (size_t u = begin; u < end; ++u)
+      for (auto a = forward_.offsets[u]; a < forward_.offsets[u + 1]; ++a)
+        in_degrees[forward_.targets[a]].fetch_add(1,
+                                                  std::memory_order_relaxed);
+  });
+  backward_.offsets.resize(n + 1, 0);
+  for (size_t u = 0; u < n; ++u)
+    backward_.offsets[u + 1] = backward_.offsets[u] + in_degrees[u].load();
+  backward_.targets.resize(backward_.offsets.back());
+
+  // reuse the in degrees as insert cursors
+  for (size_t u = 0; u < n; ++u)
+    in_degrees[u].store(0, std::memory_order_relaxed);
+  parallel_chunks(executor_, n, 1 << 14, [&](size_t begin, size_t end) {
+    for (size_t u = begin; u < end; ++u)
+      for (auto a = forward_.offsets[u]; a < forward_.offsets[u + 1]; ++a) {
+        auto v = forward_.targets[a];
+        auto slot =
+            in_degrees[v].fetch_add(1, std::memory_order_relaxed);
+        backward_.targets[backward_.offsets[v] + slot] =
+            static_cast<uint32_t>(u);
+      }
+  });
+  LOG_INFO("Built adjacency with " +
+           std::to_string(forward_.targets.size()) + " arcs");
+}
+
+/**
+ * Level synchronous parallel breadth first search which sets flag on every
+ * node reached from source within its weak component.
+ */
+void connectivity_t::bfs(const csr_t& graph, uint32_t source, uint8_t flag) {
+  auto flags = [this](uint32_t v) { return std::atomic_ref(flags_[v]); };
+  flags(source).fetch_or(flag);
+
+  std::vector<uint32_t> frontier{source};
+  while (!frontier.empty()) {
+    std::vector<std::vector<uint32_t>> next(executor_.size());
+    executor_.for_each((frontier.size() + 1023) / 1024,
+                       [&](size_t worker, size_t chunk) {
+                         auto begin = chunk * 1024;
+                         auto end = std::min(begin + 1024, frontier.size());
+                         for (auto f = begin; f < end; ++f) {
+                           auto u = frontier[f];
+                           for (auto a = graph.offsets[u];
+                                a < graph.offsets[u + 1]; ++a) {
+                             auto v = graph.targets[a];
+                             if (flags(v).load(std::memory_order_relaxed) &
+                                 flag)
+                               continue;
+                             if (!(flags(v).fetch_or(flag) & flag))
+                               next[worker].push_back(v);
+                           }
+                         }
+                       });
+    frontier.clear();
+    for (auto& n : next)
+      frontier.insert(frontier.end(), n.begin(), n.end());
+  }
+}
+
+/**
+ * Iterative Tarjan over a set of nodes, arcs into the already labelled
+ * giant component are ignored.
+ */
+void connectivity_t::tarjan(const std::vector<uint32_t>& nodes,
+                            std::vector<uint32_t>& index,
+                            std::vector<uint32_t>& low,
+                            uint32_t& counter) {
+  auto skip = [this](uint32_t v) {
+    return (flags_[v] & (kForward | kBackward)) == (kForward | kBackward);
+  };
+
+  std::vector<uint32_t> stack;
+  std::vector<std::pair<uint32_t, uint64_t>> calls;
+  for (auto s : nodes) {
+    if (index[s])
+      continue;
+    index[s] = low[s] = ++counter;
+    stack.push_back(s);
+    calls.emplace_back(s, forward_.offsets[s]);
+
+    while (!calls.empty()) {
+      auto u = calls.back().first;
+      auto& pos = calls.back().second;
+      if (pos < forward_.offsets[u + 1]) {
+        auto v = forward_.targets[pos++];
+        if (skip(v))
+          continue;
+        if (!index[v]) {
+          index[v] = low[v] = ++counter;
+          stack.push_back(v);
+          calls.emplace_back(v, forward_.offsets[v]);
+        } else if (strong_[v] == kInvalidIndex) {
+          // still on the stack
+          low[u] = std::min(low[u], index[v]);
+        }
+        continue;
+      }
+
+      if (low[u] == index[u]) {
+        uint32_t w;
+        do {
+          w = stack.back();
+          stack.pop_back();
+          strong_[w] = u;
+        } while (w != u);
+      }
+      calls.pop_back();
+      if (!calls.empty()) {
+        auto parent = calls.back().first;
+        low[parent] = std::min(low[parent], low[u]);
+      }
+    }
+  }
+}
+
+/**
+ * Forward-backward search from a pivot in the largest weak component
+ * finds the giant strongly connected component, the few remaining nodes
+ * are handled by Tarjan, one weak component per task.
+ */
+void connectivity_t::strong_components() {
+  build_csr();
+  auto n = space_.node_count();
+  strong_.assign(n, kInvalidIndex);
+
+  // pivot is the node with the most arcs in the largest weak component
+  auto largest = static_cast<uint32_t>(
+      std::max_element(weak_sizes_.begin(), weak_sizes_.end()) -
+      weak_sizes_.begin());
+  uint32_t pivot = kInvalidIndex;
+  uint64_t best = 0;
+  for (uint32_t u = 0; u < n; ++u) {
+    auto degree = forward_.offsets[u + 1] - forward_.offsets[u];
+    if (weak_[u] == largest && (flags_[u] & kAllowed) &&
+        (pivot == kInvalidIndex || degree > best)) {
+      pivot = u;
+      best = degree;
+    }
+  }
+
+  if (pivot != kInvalidIndex) {
+    bfs(forward_, pivot, kForward);
+    bfs(backward_, pivot, kBackward);
+    for (uint32_t u = 0; u < n; ++u) {
+      if ((flags_[u] & (kForward | kBackward)) == (kForward | kBackward))
+        strong_[u] = pivot;
+    }
+  }
+
+  // group the rest by weak component, arcs never leave those
+  std::vector<std::pair<uint32_t, uint32_t>> rest;
+  for (uint32_t u = 0; u < n; ++u) {
+    if ((flags_[u] & kAllowed) && strong_[u] == kInvalidIndex)
+      rest.emplace_back(weak_[u], u);
+  }
+  std::sort(rest.begin(), rest.end());
+  std::vector<std::vector<uint32_t>> groups;
+  for (size_t i = 0; i < rest.size(); ++i) {
+    if (i == 0 || rest[i].first != rest[i - 1].first)
+      groups.emplace_back();
+    groups.back().push_back(rest[i].second);
+  }
+  rest.clear();
+  rest.shrink_to_fit();
+  std::sort(groups.begin(), groups.end(),
+            [](const auto& a, const auto& b) { return a.size() > b.size(); });
+  LOG_INFO("Running Tarjan on " + std::to_string(groups.size()) +
+           " remaining weak components");
+
+  // groups are disjoint so every thread only touches its own nodes
+  std::vector<uint32_t> index(n, 0);
+  std::vector<uint32_t> low(n, 0);
+  std::vector<uint32_t> counters(executor_.size(), 0);
+  executor_.for_each(
+      groups.size(),
+      [&](size_t worker, size_t g) {
+        tarjan(groups[g], index, low, counters[worker]);
+      },
+      "Tarjan");
+}
+
+/**
+ * Counts the members of every component, indexed by label.
+ */
+std::vector<uint32_t> component_sizes(const std::vector<uint32_t>& labels,
+                                      const std::vector<uint8_t>& flags) {
+  std::vector<uint32_t> sizes(labels.size(), 0);
+  for (size_t n = 0; n < labels.size(); ++n) {
+    if ((flags[n] & kAllowed) && labels[n] != kInvalidIndex)
+      sizes[labels[n]]++;
+  }
+  return sizes;
+}
+
+void connectivity_t::serialize(rapidjson::writer_wrapper_t& writer,
+                               const std::vector<uint32_t>& labels,
+                               const std::vector<uint32_t>& sizes) {
+  uint64_t count = 0;
+  uint64_t small = 0;
+  uint32_t largest = 0;
+  uint32_t largest_label = kInvalidIndex;
+  // power of two bins of component sizes
+  std::array<uint64_t, 33> histogram{};
+  for (size_t label = 0; label < sizes.size(); ++label) {
+    auto size = sizes[label];
+    if (!size)
+      continue;
+    count++;
+    small += size <= options_.max_component_size;
+    histogram[std::bit_width(size)]++;
+    if (size > largest) {
+      largest = size;
+      largest_label = static_cast<uint32_t>(label);
+    }
+  }
+
+  writer("component_count", count);
+  writer("small_component_count", small);
+  writer("largest_component_size", static_cast<uint64_t>(largest));
+  if (largest_label != kInvalidIndex)
+    writer("largest_component_node",
+           std::to_string(space_.graph_id(largest_label)));
+  writer.start_array("size_histogram");
+  for (size_t i = 1; i < histogram.size(); ++i) {
+    if (!histogram[i])
+      continue;
+    writer.start_object();
+    writer("min_size", static_cast<uint64_t>(1ULL << (i - 1)));
+    writer("max_size", static_cast<uint64_t>((1ULL << i) - 1));
+    writer("count", histogram[i]);
+    writer.end_object();
+  }
+  writer.end_array();
+}
+
+/**
+ * Writes the edges of all components with at most max_component_size
+ * nodes to a FlatGeobuf file.
+ */
+void connectivity_t::export_components(const std::vector<uint32_t>& labels,
+                                       const std::vector<uint32_t>& sizes,
+                                       const std::string& name) {
+  struct feature_t {
+    GraphId edge_id;
+    uint64_t way_id;
+    uint32_t component;
+    uint32_t size;
+    std::vector<PointLL> shape;
+  };
+  std::mutex lock;
+  std::vector<feature_t> features;
+  for_each_tile(
+      [&](GraphReader&, size_t i, const graph_tile_ptr& tile) {
+        std::vector<feature_t> local;
+        auto base = space_.base(i);
+        const auto& tile_id = space_.tiles()[i];
+        for (uint32_t n = 0; n < tile->header()->nodecount(); ++n) {
+          auto label = labels[base + n];
+          if (!(flags_[base + n] & kAllowed) || label == kInvalidIndex ||
+              sizes[label] > options_.max_component_size)
+            continue;
+          const auto* ni = tile->node(n);
+          for (uint32_t e = 0; e < ni->edge_count(); ++e) {
+            auto idx = ni->edge_index() + e;
+            const auto* de = tile->directededge(idx);
+            if (de->is_shortcut() ||
+                !costing_->Allowed(de, tile, valhalla::sif::kDisallowNone))
+              continue;
+            auto ei = tile->edgeinfo(de);
+            local.push_back({GraphId(tile_id.tileid(), tile_id.level(), idx),
+                             ei.wayid(), label, sizes[label], ei.shape()});
+          }
+        }
+        std::lock_guard l(lock);
+        features.insert(features.end(), std::make_move_iterator(local.begin()),
+                        std::make_move_iterator(local.end()));
+      },
+      "Exporting components");
+
+  GDALDriver* driver =
+      GetGDALDriverManager()->GetDriverByName("FlatGeobuf");
+  if (!driver)
+    throw std::runtime_error("FlatGeoBuf driver not available");
+
+  auto location = options_.output_dir +
+                  filesystem::path::preferred_separator + name + ".fgb";
+  filesystem::create_directories(options_.output_dir);
+  GDALDataset* dataset = driver->Create(location.c_str(), 0, 0, 0,
+                                        GDT_Unknown, nullptr);
+  if (!dataset)
+    throw std::runtime_error("Unable to create " + location);
+
+  OGRSpatialReference spatialRef;
+  spatialRef.SetWellKnownGeogCS("WGS84");
+  OGRLayer* layer =
+      dataset->CreateLayer(name.c_str(), &spatialRef, wkbLineString, nullptr);
+  for (auto field : {"edgeid", "wayid", "component", "size"}) {
+    OGRFieldDefn field_name(field, OFTInteger64);
+    layer->CreateField(&field_name);
+  }
+
+  for (const auto& f : features) {
+    OGRFeature* feature = OGRFeature::CreateFeature(layer->GetLayerDefn());
+    OGRLineString* line = new OGRLineString();
+    for (const auto& pt : f.shape)
+      line->addPoint(pt.lng(), pt.lat());
+    feature->SetGeometryDirectly(line);
+    feature->SetField("edgeid", static_cast<GIntBig>(f.edge_id.value));
+    feature->SetField("wayid", static_cast<GIntBig>(f.way_id));
+    feature->SetField("component", static_cast<GIntBig>(f.component));
+    feature->SetField("size", static_cast<GIntBig>(f.size));
+    if (layer->CreateFeature(feature) != OGRERR_NONE) {
+      LOG_ERROR("Failed to create feature");
+    }
+    OGRFeature::DestroyFeature(feature);
+  }
+  GDALClose(dataset);
+  LOG_INFO("Wrote " + std::to_string(features.size()) + " edges to " +
+           location);
+}
+
+void connectivity_t::run(std::ostream& out) {
+  {
+    trace::span_t span("index_nodes", "phase");
+    index_nodes();
+  }
+  {
+    trace::span_t span("weak_components", "phase");
+    weak_components();
+  }
+  weak_sizes_ = component_sizes(weak_, flags_);
+  LOG_INFO("Found weakly connected components");
+
+  if (options_.strong) {
+    trace::span_t span("strong_components", "phase");
+    strong_components();
+    strong_sizes_ = component_sizes(strong_, flags_);
+    LOG_INFO("Found strongly connected components");
+  }
+
+  rapidjson::writer_wrapper_t writer(4096);
+  writer.start_object();
+  uint64_t allowed = 0;
+  for (auto f : flags_)
+    allowed += f & kAllowed;
+  writer("node_count", static_cast<uint64_t>(space_.node_count()));
+  writer("allowed_node_count", allowed);
+  writer("max_small_component_size",
+         static_cast<uint64_t>(options_.max_component_size));
+  writer.start_object("weak");
+  serialize(writer, weak_, weak_sizes_);
+  writer.end_object();
+  if (options_.strong) {
+    writer.start_object("strong");
+    serialize(writer, strong_, strong_sizes_);
+    writer.end_object();
+  }
+  writer.end_object();
+  out << writer.get_buffer() << "\n";
+
+  if (!options_.output_dir.empty() && options_.max_component_size) {
+    trace::span_t span("write", "io");
+    export_components(weak_, weak_sizes_, "weak_components");
+    if (options_.strong)
+      export_components(strong_, strong_sizes_, "strong_components");
+  }
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  const auto program = filesystem::path(__FILE__).stem().string();
+  boost::property_tree::ptree pt;
+  std::string costing_str;
+  std::string output;
+  std::string trace_path;
+  options_t connectivity_options;
+
+  try {
+    cxxopts::Options
+        options(program,
+                "finds the weakly and strongly connected components of a "
+                "valhalla graph for a given costing.\n");
+
+    // clang-format off
+    options.add_options()
+    ("h,help", "Print this help message.")
+    ("j,concurrency", "Number of threads to use.", cxxopts::value<unsigned int>())
+    ("c,config", "Path to the json configuration file.", cxxopts::value<std::string>())
+    ("i,inline-config", "Inline json config.",cxxopts::value<std::string>())
+    ("o,costing", "Costing to use", cxxopts::value<std::string>(costing_str)->default_value("auto"))
+    ("s,strong", "Also compute strongly connected components.", cxxopts::value<bool>(connectivity_options.strong))
+    ("m,max-component-size", "Components with at most this many nodes are exported.", cxxopts::value<uint32_t>(connectivity_options.max_component_size)->default_value("100"))
+    ("d,output-directory", "Directory to write the edges of small components to as FlatGeobuf.", cxxopts::value<std::string>(connectivity_options.output_dir))
+    ("r,report", "File to write the JSON report to, defaults to stdout.", cxxopts::value<std::string>(output))
+    ("trace", "Write a Chrome trace of the run to this file, it can be opened in Perfetto.", cxxopts::value<std::string>(trace_path));
+    // clang-format on
+
+    auto result = options.parse(argc, argv);
+    options.custom_help("");
+    if (!parse_common_args(program, options, result, pt, "mjolnir.logging",
+                           true))
+      return EXIT_SUCCESS;
+
+  } catch (cxxopts::exceptions::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  } catch (std::exception& e) {
+    std::cerr << "Unable to parse command line options because: "
+              << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  trace::session_t trace_session(trace_path);
+  try {
+    // register gdal drivers
+    GDALAllRegister();
+
+    connectivity_t connectivity(pt,
+                                valhalla::tools::create_costing(costing_str),
+                                connectivity_options);
+    if (output.empty() || output == "-") {
+      connectivity.run(std::cout);
+    } else {
+      std::ofstream file(output);
+      connectivity.run(file);
+    }
+  } catch (std::exception& e) {
+    LOG_ERROR("Failed to analyze connectivity: " + std::string(e.what()));
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
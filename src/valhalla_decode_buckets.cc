@@ -1,9 +1,20 @@
+#include "batch.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
 #include <cxxopts.hpp>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <thread>
 #include <valhalla/baldr/predictedspeeds.h>
 
 namespace {
+using namespace valhalla;
 
 inline constexpr std::array<const char[4], 7> days_of_week{
     "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat",
@@ -24,11 +35,138 @@ void print_bucket_speeds(const std::string& encoded) {
               << std::setfill('0') << minutes << " " << speed << "\n";
   }
 }
+
+enum class Aggregate { kMin, kMax, kMean };
+
+struct bulk_options_t {
+  std::vector<uint32_t> buckets;
+  std::vector<Aggregate> aggregates;
+  bool binary = false;
+};
+
+/**
+ * Parses a comma separated list of buckets and inclusive bucket ranges,
+ * e.g. 0-287,300
+ */
+std::vector<uint32_t> parse_buckets(const std::string& s) {
+  std::vector<uint32_t> buckets;
+  std::stringstream ss(s);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    auto dash = item.find('-');
+    auto first = std::stoul(item.substr(0, dash));
+    auto last = dash == std::string::npos ? first
+                                          : std::stoul(item.substr(dash + 1));
+    if (first > last || last >= baldr::kBucketsPerWeek)
+      throw std::runtime_error("Invalid bucket range: " + item);
+    for (auto b = first; b <= last; ++b)
+      buckets.push_back(b);
+  }
+  if (buckets.empty())
+    throw std::runtime_error("No buckets selected");
+  return buckets;
+}
+
+Aggregate aggregate_from_string(const std::string& s) {
+  if (s == "min")
+    return Aggregate::kMin;
+  if (s == "max")
+    return Aggregate::kMax;
+  if (s == "mean")
+    return Aggregate::kMean;
+  throw std::runtime_error("Unknown aggregate: " + s);
+}
+
+template <typename T> void append_number(std::string& out, T value) {
+  char buf[32];
+  auto res = std::to_chars(buf, buf + sizeof(buf), value);
+  out.append(buf, res.ptr);
+}
+
+/**
+ * Decodes one chunk of id,encoded rows. Rows that can't be decoded are
+ * skipped in CSV and written as zeros in binary output, so that binary
+ * rows still line up with the input.
+ */
+void decode_chunk(std::string_view lines,
+                  std::string& out,
+                  const bulk_options_t& options,
+                  std::atomic<size_t>& rows,
+                  std::atomic<size_t>& invalid) {
+  thread_local std::string encoded;
+  thread_local std::vector<float> speeds;
+  speeds.resize(options.buckets.size());
+  size_t chunk_rows = 0, chunk_invalid = 0;
+
+  tools::for_each_line(lines, [&](std::string_view line) {
+    ++chunk_rows;
+    auto comma = line.find(',');
+    auto id = comma == std::string_view::npos ? std::string_view()
+                                              : line.substr(0, comma);
+    encoded.assign(comma == std::string_view::npos ? line
+                                                   : line.substr(comma + 1));
+
+    std::array<int16_t, baldr::kCoefficientCount> coefs;
+    try {
+      coefs = baldr::decode_compressed_speeds(encoded);
+    } catch (const std::exception&) {
+      ++chunk_invalid;
+      if (options.binary)
+        out.append(options.buckets.size(), '\0');
+      return;
+    }
+
+    for (size_t i = 0; i < options.buckets.size(); ++i)
+      speeds[i] = baldr::decompress_speed_bucket(coefs.data(),
+                                                 options.buckets[i]);
+
+    if (options.binary) {
+      for (auto speed : speeds)
+        out.push_back(static_cast<char>(
+            std::clamp<long>(std::lround(speed), 0, 255)));
+      return;
+    }
+
+    out.append(id);
+    if (options.aggregates.empty()) {
+      for (auto speed : speeds) {
+        out.push_back(',');
+        append_number(out, std::lround(speed));
+      }
+    }
+    for (auto aggregate : options.aggregates) {
+      float value = 0;
+      switch (aggregate) {
+        case Aggregate::kMin:
+          value = *std::min_element(speeds.begin(), speeds.end());
+          break;
+        case Aggregate::kMax:
+          value = *std::max_element(speeds.begin(), speeds.end());
+          break;
+        case Aggregate::kMean:
+          for (auto speed : speeds)
+            value += speed;
+          value /= speeds.size();
+          break;
+      }
+      out.push_back(',');
+      append_number(out, std::round(value * 10) / 10);
+    }
+    out.push_back('\n');
+  });
+
+  rows += chunk_rows;
+  invalid += chunk_invalid;
+}
 } // namespace
 
 int main(int argc, char** argv) {
   // store some options
   std::vector<std::string> encoded;
+  bulk_options_t bulk_options;
+  std::string input, output;
+  std::string trace_path;
+  size_t concurrency = std::thread::hardware_concurrency();
   // clang-format off
   cxxopts::Options options(
     "valhalla_decode_buckets",
@@ -38,26 +176,99 @@ int main(int argc, char** argv) {
   
   options.add_options()
     ("h,help", "Print this help message.")
-    ("ENCODED", "The encoded string to process", cxxopts::value<std::vector<std::string>>());
+    ("ENCODED", "The encoded string to process", cxxopts::value<std::vector<std::string>>())
+    ("b,bulk", "Decode id,encoded rows from this file, - for stdin.", cxxopts::value<std::string>()->implicit_value("-"))
+    ("o,output", "File to write the bulk output to, defaults to stdout.", cxxopts::value<std::string>())
+    ("f,format", "Bulk output format, csv or binary.", cxxopts::value<std::string>()->default_value("csv"))
+    ("buckets", "Only output these buckets, e.g. 0-287,300.", cxxopts::value<std::string>())
+    ("a,aggregates", "Output aggregates over the (selected) buckets instead of the speeds: min, max and/or mean.", cxxopts::value<std::vector<std::string>>())
+    ("j,concurrency", "Number of threads to use.", cxxopts::value<size_t>())
+    ("trace", "Write a Chrome trace of the bulk run to this file, it can be opened in Perfetto.", cxxopts::value<std::string>(trace_path));
   // clang-format on
 
   options.custom_help("ENCODED");
   options.positional_help("The encoded string to process");
   options.parse_positional({"ENCODED"});
-  auto vm = options.parse(argc, argv);
 
-  if (vm.count("help")) {
-    std::cout << options.help() << "\n";
-    return EXIT_SUCCESS;
-  }
+  try {
+    auto vm = options.parse(argc, argv);
+
+    if (vm.count("help")) {
+      std::cout << options.help() << "\n";
+      return EXIT_SUCCESS;
+    }
+
+    if (!vm.count("bulk")) {
+      if (vm.count("ENCODED") == 1) {
+        encoded = vm["ENCODED"].as<std::vector<std::string>>();
+      } else {
+        std::cerr << "Single encoded speeds string required\n";
+        return EXIT_FAILURE;
+      }
+
+      print_bucket_speeds(encoded[0]);
+      return EXIT_SUCCESS;
+    }
 
-  if (vm.count("ENCODED") == 1) {
-    encoded = vm["ENCODED"].as<std::vector<std::string>>();
-  } else {
-    std::cerr << "Single encoded speeds string required\n";
+    input = vm["bulk"].as<std::string>();
+    if (vm.count("output"))
+      output = vm["output"].as<std::string>();
+    if (vm.count("concurrency"))
+      concurrency = vm["concurrency"].as<size_t>();
+
+    auto format = vm["format"].as<std::string>();
+    if (format != "csv" && format != "binary")
+      throw std::runtime_error("Unknown format: " + format);
+    bulk_options.binary = format == "binary";
+
+    if (vm.count("buckets")) {
+      bulk_options.buckets = parse_buckets(vm["buckets"].as<std::string>());
+    } else {
+      for (uint32_t b = 0; b < baldr::kBucketsPerWeek; ++b)
+        bulk_options.buckets.push_back(b);
+    }
+    if (vm.count("aggregates")) {
+      for (const auto& a : vm["aggregates"].as<std::vector<std::string>>())
+        bulk_options.aggregates.push_back(aggregate_from_string(a));
+      if (bulk_options.binary)
+        throw std::runtime_error("Aggregates are only supported for csv");
+    }
+  } catch (std::exception& e) {
+    std::cerr << e.what() << "\n";
     return EXIT_FAILURE;
   }
 
-  print_bucket_speeds(encoded[0]);
+  tools::trace::session_t trace_session(trace_path);
+  try {
+    std::ifstream in_file;
+    if (input != "-") {
+      in_file.open(input, std::ios::in | std::ios::binary);
+      if (!in_file.is_open())
+        throw std::runtime_error("Unable to open " + input);
+    }
+    std::ofstream out_file;
+    if (!output.empty()) {
+      out_file.open(output,
+                    std::ios::out | std::ios::binary | std::ios::trunc);
+      if (!out_file.is_open())
+        throw std::runtime_error("Unable to open " + output);
+    }
+    std::ios::sync_with_stdio(false);
+
+    std::atomic<size_t> rows{0}, invalid{0};
+    tools::process_lines(
+        input == "-" ? std::cin : in_file,
+        output.empty() ? std::cout : out_file, concurrency,
+        [&](std::string_view lines, std::string& out) {
+          decode_chunk(lines, out, bulk_options, rows, invalid);
+        });
+
+    if (invalid)
+      std::cerr << "Failed to decode " << invalid << " of " << rows
+                << " rows\n";
+  } catch (std::exception& e) {
+    std::cerr << "Failed to decode buckets: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
   return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,307 @@
+#include "batch.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cxxopts.hpp>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <valhalla/baldr/predictedspeeds.h>
+
+namespace {
+using namespace valhalla;
+
+constexpr size_t kBuckets = baldr::kBucketsPerWeek;
+constexpr size_t kCoefs = baldr::kCoefficientCount;
+
+// rows and buckets per block of the matrix multiply
+constexpr size_t kRowBlock = 64;
+constexpr size_t kBucketBlock = 128;
+
+/**
+ * @brief The transposed basis that turns 2016 speeds into 200
+ * coefficients, stored bucket major ([bucket][coefficient]) so that the
+ * inner loop runs over contiguous coefficients.
+ *
+ * It is derived from decompress_speed_bucket instead of hard coding the
+ * DCT: decompression is linear in the coefficients, so decoding unit
+ * coefficient vectors yields the synthesis matrix D (2016 x 200), and the
+ * least squares encoder is (D^T D)^-1 D^T. For the DCT D^T D is diagonal
+ * and this is the truncated DCT-II, but it stays right whatever scaling
+ * the library uses.
+ */
+std::vector<float> compute_basis() {
+  std::vector<double> d(kBuckets * kCoefs);
+  std::array<int16_t, kCoefs> unit{};
+  for (size_t k = 0; k < kCoefs; ++k) {
+    unit[k] = 1;
+    for (size_t n = 0; n < kBuckets; ++n)
+      d[n * kCoefs + k] = baldr::decompress_speed_bucket(unit.data(), n);
+    unit[k] = 0;
+  }
+
+  // gram matrix and its cholesky factor, in place
+  std::vector<double> g(kCoefs * kCoefs, 0.);
+  for (size_t n = 0; n < kBuckets; ++n) {
+    for (size_t i = 0; i < kCoefs; ++i)
+      for (size_t j = 0; j <= i; ++j)
+        g[i * kCoefs + j] += d[n * kCoefs + i] * d[n * kCoefs + j];
+  }
+  for (size_t j = 0; j < kCoefs; ++j) {
+    for (size_t k = 0; k < j; ++k)
+      g[j * kCoefs + j] -= g[j * kCoefs + k] * g[j * kCoefs + k];
+    if (g[j * kCoefs + j] <= 0)
+      throw std::runtime_error("Speed bucket basis is singular");
+    g[j * kCoefs + j] = std::sqrt(g[j * kCoefs + j]);
+    for (size_t i = j + 1; i < kCoefs; ++i) {
+      for (size_t k = 0; k < j; ++k)
+        g[i * kCoefs + j] -= g[i * kCoefs + k] * g[j * kCoefs + k];
+      g[i * kCoefs + j] /= g[j * kCoefs + j];
+    }
+  }
+
+  // solve L L^T x = d_n for every bucket's row of D
+  std::vector<float> basis(kBuckets * kCoefs);
+  std::array<double, kCoefs> x;
+  for (size_t n = 0; n < kBuckets; ++n) {
+    for (size_t i = 0; i < kCoefs; ++i) {
+      x[i] = d[n * kCoefs + i];
+      for (size_t k = 0; k < i; ++k)
+        x[i] -= g[i * kCoefs + k] * x[k];
+      x[i] /= g[i * kCoefs + i];
+    }
+    for (size_t i = kCoefs; i-- > 0;) {
+      for (size_t k = i + 1; k < kCoefs; ++k)
+        x[i] -= g[k * kCoefs + i] * x[k];
+      x[i] /= g[i * kCoefs + i];
+    }
+    std::copy(x.begin(), x.end(), basis.begin() + n * kCoefs);
+  }
+  return basis;
+}
+
+/**
+ * Round trip errors of the rows encoded so far
+ */
+struct report_t {
+  size_t rows = 0;
+  double sum_rmse = 0;
+  double max_rmse = 0;
+  double max_error = 0;
+  std::string worst_id;
+
+  void merge(const report_t& other) {
+    rows += other.rows;
+    sum_rmse += other.sum_rmse;
+    max_error = std::max(max_error, other.max_error);
+    if (other.max_rmse > max_rmse) {
+      max_rmse = other.max_rmse;
+      worst_id = other.worst_id;
+    }
+  }
+};
+
+/**
+ * Parses id,speed_0,...,speed_2015 into the id and a row of speeds
+ */
+bool parse_row(std::string_view line, std::string_view& id, float* speeds) {
+  auto comma = line.find(',');
+  if (comma == std::string_view::npos)
+    return false;
+  id = line.substr(0, comma);
+  const char* pos = line.data() + comma;
+  const char* end = line.data() + line.size();
+  for (size_t n = 0; n < kBuckets; ++n) {
+    if (pos == end || *pos != ',')
+      return false;
+    auto res = std::from_chars(pos + 1, end, speeds[n]);
+    if (res.ec != std::errc())
+      return false;
+    pos = res.ptr;
+  }
+  return pos == end;
+}
+
+/**
+ * coefs (rows x 200) = speeds (rows x 2016) * basis (2016 x 200), blocked
+ * over buckets so a slice of the basis stays in cache for all rows
+ */
+void multiply(const std::vector<float>& basis,
+              const float* speeds,
+              size_t rows,
+              float* coefs) {
+  std::fill(coefs, coefs + rows * kCoefs, 0.f);
+  for (size_t n0 = 0; n0 < kBuckets; n0 += kBucketBlock) {
+    auto n1 = std::min(n0 + kBucketBlock, kBuckets);
+    for (size_t r = 0; r < rows; ++r) {
+      auto* c = coefs + r * kCoefs;
+      for (size_t n = n0; n < n1; ++n) {
+        auto s = speeds[r * kBuckets + n];
+        const auto* b = basis.data() + n * kCoefs;
+        for (size_t k = 0; k < kCoefs; ++k)
+          c[k] += s * b[k];
+      }
+    }
+  }
+}
+
+void encode_chunk(std::string_view lines,
+                  std::string& out,
+                  const std::vector<float>& basis,
+                  bool with_report,
+                  report_t& report,
+                  std::mutex& report_lock,
+                  std::atomic<size_t>& invalid) {
+  thread_local std::vector<float> speeds(kRowBlock * kBuckets);
+  thread_local std::vector<float> coefs(kRowBlock * kCoefs);
+  std::vector<std::string_view> ids;
+  ids.reserve(kRowBlock);
+  report_t chunk_report;
+  size_t chunk_invalid = 0;
+
+  auto flush = [&]() {
+    multiply(basis, speeds.data(), ids.size(), coefs.data());
+    std::array<int16_t, kCoefs> quantized;
+    for (size_t r = 0; r < ids.size(); ++r) {
+      for (size_t k = 0; k < kCoefs; ++k)
+        quantized[k] = static_cast<int16_t>(
+            std::clamp(std::round(coefs[r * kCoefs + k]), -32768.f, 32767.f));
+      out.append(ids[r]);
+      out.push_back(',');
+      out.append(baldr::encode_compressed_speeds(quantized.data()));
+      out.push_back('\n');
+
+      if (!with_report)
+        continue;
+      double squared = 0, max_error = 0;
+      for (size_t n = 0; n < kBuckets; ++n) {
+        double error = baldr::decompress_speed_bucket(quantized.data(), n) -
+                       speeds[r * kBuckets + n];
+        squared += error * error;
+        max_error = std::max(max_error, std::abs(error));
+      }
+      auto rmse = std::sqrt(squared / kBuckets);
+      chunk_report.rows++;
+      chunk_report.sum_rmse += rmse;
+      chunk_report.max_error = std::max(chunk_report.max_error, max_error);
+      if (rmse > chunk_report.max_rmse || chunk_report.rows == 1) {
+        chunk_report.max_rmse = rmse;
+        chunk_report.worst_id = ids[r];
+      }
+    }
+    ids.clear();
+  };
+
+  tools::for_each_line(lines, [&](std::string_view line) {
+    std::string_view id;
+    if (!parse_row(line, id, speeds.data() + ids.size() * kBuckets)) {
+      ++chunk_invalid;
+      return;
+    }
+    ids.push_back(id);
+    if (ids.size() == kRowBlock)
+      flush();
+  });
+  if (!ids.empty())
+    flush();
+
+  invalid += chunk_invalid;
+  if (with_report) {
+    std::lock_guard l(report_lock);
+    report.merge(chunk_report);
+  }
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  std::string input = "-", output;
+  std::string trace_path;
+  bool with_report = false;
+  size_t concurrency = std::thread::hardware_concurrency();
+  // clang-format off
+  cxxopts::Options options(
+    "valhalla_encode_buckets",
+    "valhalla_encode_buckets"
+    "\n\nvalhalla_encode_buckets is a program that encodes\n"
+    "speed profiles of 2016 5-minute buckets into valhalla's\n"
+    "compressed speed format.\n");
+
+  options.add_options()
+    ("h,help", "Print this help message.")
+    ("INPUT", "File with id,speed_0,...,speed_2015 rows, defaults to stdin.", cxxopts::value<std::string>())
+    ("o,output", "File to write the id,encoded rows to, defaults to stdout.", cxxopts::value<std::string>())
+    ("r,report", "Decode every encoded profile again and report the round trip error.")
+    ("j,concurrency", "Number of threads to use.", cxxopts::value<size_t>())
+    ("trace", "Write a Chrome trace of the run to this file, it can be opened in Perfetto.", cxxopts::value<std::string>(trace_path));
+  // clang-format on
+
+  options.custom_help("[INPUT]");
+  options.parse_positional({"INPUT"});
+
+  try {
+    auto vm = options.parse(argc, argv);
+    if (vm.count("help")) {
+      std::cout << options.help() << "\n";
+      return EXIT_SUCCESS;
+    }
+    if (vm.count("INPUT"))
+      input = vm["INPUT"].as<std::string>();
+    if (vm.count("output"))
+      output = vm["output"].as<std::string>();
+    if (vm.count("concurrency"))
+      concurrency = vm["concurrency"].as<size_t>();
+    with_report = vm.count("report");
+  } catch (std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  tools::trace::session_t trace_session(trace_path);
+  try {
+    std::ifstream in_file;
+    if (input != "-") {
+      in_file.open(input, std::ios::in | std::ios::binary);
+      if (!in_file.is_open())
+        throw std::runtime_error("Unable to open " + input);
+    }
+    std::ofstream out_file;
+    if (!output.empty()) {
+      out_file.open(output,
+                    std::ios::out | std::ios::binary | std::ios::trunc);
+      if (!out_file.is_open())
+        throw std::runtime_error("Unable to open " + output);
+    }
+    std::ios::sync_with_stdio(false);
+
+    auto basis = compute_basis();
+    report_t report;
+    std::mutex report_lock;
+    std::atomic<size_t> invalid{0};
+    tools::process_lines(
+        input == "-" ? std::cin : in_file,
+        output.empty() ? std::cout : out_file, concurrency,
+        [&](std::string_view lines, std::string& out) {
+          encode_chunk(lines, out, basis, with_report, report, report_lock,
+                       invalid);
+        });
+
+    if (invalid)
+      std::cerr << "Skipped " << invalid << " rows without " << kBuckets
+                << " speeds\n";
+    if (with_report && report.rows) {
+      std::cerr << "Round trip error over " << report.rows << " rows: "
+                << "mean RMSE " << report.sum_rmse / report.rows
+                << " kph, max RMSE " << report.max_rmse << " kph (id "
+                << report.worst_id << "), max error " << report.max_error
+                << " kph\n";
+    }
+  } catch (std::exception& e) {
+    std::cerr << "Failed to encode buckets: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
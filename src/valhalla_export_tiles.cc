@@ -1,7 +1,13 @@
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
+#include <ctime>
 #include <cxxopts.hpp>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <memory>
 #include <ogr_core.h>
-#include <queue>
 #include <valhalla/baldr/attributes_controller.h>
 #include <valhalla/baldr/directededge.h>
 #include <valhalla/baldr/graphid.h>
@@ -18,422 +24,20 @@
 #include <valhalla/third_party/rapidjson/document.h>
 
 #include "argparse_utils.h"
+#include "costing.h"
+#include "executor.h"
+#include "export.h"
+#include "fgb_writer.h"
+#include "live_traffic.h"
+#include "pgcopy.h"
+#include "prefetch.h"
+#include "shard.h"
+#include "trace.h"
 #include <gdal_priv.h>
 #include <ogrsf_frmts.h>
 
 namespace {
-
-const std::string kEdgePredictedSpeeds = "edge.predicted_speeds";
-
-struct AttributeFilter {
-  AttributeFilter(
-      std::vector<std::string>&& includes_v,
-      std::vector<std::string>&& excludes_v,
-      std::vector<unsigned int>&& predspeedindices,
-      valhalla::baldr::PathLocation::SearchFilter& searchfilter,
-      bool only_shortcuts) {
-
-    search_filter = searchfilter;
-
-    pred_speed_indices = std::move(predspeedindices);
-    std::unordered_set<std::string> includes;
-    includes.reserve(includes_v.size());
-    for (auto& inc : includes_v) {
-      includes.insert(std::move(inc));
-    }
-    std::unordered_set<std::string> excludes;
-    excludes.reserve(excludes_v.size());
-    for (auto& exc : excludes_v) {
-      excludes.insert(std::move(exc));
-    }
-
-    std::vector<std::pair<bool&, std::string>> edge_pairs = {
-        {localidx, kEdgeId},
-        {density, kEdgeDensity},
-        {road_class, kEdgeRoadClass},
-        {use, kEdgeUse},
-        {speed, kEdgeSpeed},
-        {tunnel, kEdgeTunnel},
-        {bridge, kEdgeBridge},
-        {traversability, kEdgeTraversability},
-        {surface, kEdgeSurface},
-        {urban, kEdgeIsUrban},
-        {predicted_speeds, kEdgePredictedSpeeds},
-        {country_crossing, kEdgeCountryCrossing},
-    };
-
-    std::vector<std::pair<bool&, std::string>> node_pairs = {
-        {type, kNodeType},
-    };
-
-    for (auto& p : edge_pairs) {
-      if (includes.find(p.second) != includes.end()) {
-        edges = true;
-        p.first = true;
-      }
-
-      if (excludes.find(p.second) != includes.end()) {
-        edges = true;
-        p.first = false;
-      }
-    }
-
-    for (auto& p : node_pairs) {
-      if (includes.find(p.second) != includes.end()) {
-        nodes = true;
-        p.first = true;
-      }
-
-      if (excludes.find(p.second) != includes.end()) {
-        nodes = true;
-        p.first = false;
-      }
-    }
-
-    shortcuts_only = only_shortcuts;
-  }
-
-  /**
-   * Taken from upstream valhalla (src/loki/search.cc)
-   */
-  bool is_filtered(const DirectedEdge* de,
-                   graph_tile_ptr tile,
-                   valhalla::sif::cost_ptr_t costing) const {
-    // check if this edge matches any of the exclusion filters
-    uint32_t road_class = static_cast<uint32_t>(de->classification());
-    uint32_t min_road_class =
-        static_cast<uint32_t>(search_filter.min_road_class_);
-    uint32_t max_road_class =
-        static_cast<uint32_t>(search_filter.max_road_class_);
-
-    // Note that min_ and max_road_class are integers where, by default,
-    // max_road_class is 0 and min_road_class is 7. This filter rejects
-    // roads where the functional road class is outside of the min to max
-    // range.
-    return (road_class > min_road_class || road_class < max_road_class) ||
-           (search_filter.exclude_tunnel_ && de->tunnel()) ||
-           (search_filter.exclude_bridge_ && de->bridge()) ||
-           (search_filter.exclude_toll_ && de->toll()) ||
-           (search_filter.exclude_ramp_ && (de->use() == Use::kRamp)) ||
-           (search_filter.exclude_ferry_ &&
-            (de->use() == Use::kFerry || de->use() == Use::kRailFerry)) ||
-           (search_filter.exclude_closures_ &&
-            (costing->flow_mask() & kCurrentFlowMask) &&
-            tile->IsClosed(de)) ||
-           (search_filter.level_ != kMaxLevel &&
-            !tile->edgeinfo(de).includes_level(search_filter.level_));
-  }
-
-  valhalla::baldr::PathLocation::SearchFilter search_filter;
-
-  // edges
-  bool localidx{false};
-  bool road_class{false};
-  bool use{false};
-  bool speed{false};
-  bool tunnel{false};
-  bool bridge{false};
-  bool traversability{false};
-  bool surface{false};
-  bool density{false};
-  bool urban{false};
-  bool country_crossing{false};
-  bool predicted_speeds{false};
-  std::vector<unsigned int> pred_speed_indices{};
-
-  bool shortcuts_only{false};
-
-  // nodes
-  bool type{false};
-
-  // which data sets does the user want
-  bool edges{false};
-  bool nodes{false};
-};
-
-OGRLineString* ConvertToOGRLineString(const std::vector<PointLL>& points) {
-  OGRLineString* line = new OGRLineString();
-  for (const auto& pt : points) {
-    line->addPoint(pt.lng(), pt.lat());
-  }
-  return line;
-}
-
-valhalla::sif::cost_ptr_t create_costing(const std::string& costing_str) {
-  valhalla::Options options;
-  valhalla::Costing::Type costing;
-  if (valhalla::Costing_Enum_Parse(costing_str, &costing)) {
-    options.set_costing_type(costing);
-  } else {
-    options.set_costing_type(valhalla::Costing::none_);
-  }
-  auto& co = (*options.mutable_costings())[costing];
-  co.set_type(costing);
-  return valhalla::sif::CostFactory{}.Create(options);
-}
-enum class FeatureType : uint8_t { kEdges = 0, kNodes = 1 };
-
-/**
- * Exports features that match the passed tileid to the specified
- * directory.
- */
-void export_tile(valhalla::baldr::GraphReader& reader,
-                 const valhalla::baldr::GraphId tile_id,
-                 const std::string& output_dir,
-                 const std::string& file_suffix,
-                 valhalla::sif::cost_ptr_t costing,
-                 GDALDriver* gdal_driver,
-                 char** dataset_options,
-                 const AttributeFilter& filter) {
-  // get the file path
-  auto edge_suffix =
-      valhalla::baldr::GraphTile::FileSuffix(tile_id.Tile_Base(),
-                                             "_edges" + file_suffix +
-                                                 ".fgb");
-  auto node_suffix =
-      valhalla::baldr::GraphTile::FileSuffix(tile_id.Tile_Base(),
-                                             "_nodes" + file_suffix +
-                                                 ".fgb");
-  auto edge_location =
-      output_dir + filesystem::path::preferred_separator + edge_suffix;
-  auto node_location =
-      output_dir + filesystem::path::preferred_separator + node_suffix;
-
-  // make sure all the subdirectories exist
-  auto dir = filesystem::path(edge_location);
-  dir.replace_filename("");
-  filesystem::create_directories(dir);
-  GDALDataset* edge_data = nullptr;
-  GDALDataset* node_data = nullptr;
-
-  if (filter.edges) {
-    LOG_INFO("Writing edges to disk at " + edge_location);
-    edge_data = gdal_driver->Create(edge_location.c_str(), 0, 0, 0,
-                                    GDT_Unknown, nullptr);
-  } else {
-    LOG_INFO("No edges will be written");
-  }
-
-  if (filter.nodes) {
-    LOG_INFO("Writing edges to disk at " + node_location);
-    node_data = gdal_driver->Create(node_location.c_str(), 0, 0, 0,
-                                    GDT_Unknown, nullptr);
-  } else {
-    LOG_INFO("No nodes will be written");
-  }
-
-  if (!edge_data && !node_data) {
-    LOG_INFO("No attributes specified, skipping export");
-    return;
-  }
-
-  // now go through the tile and convert the features
-  if (!reader.DoesTileExist(tile_id)) {
-    LOG_ERROR("Tile " + std::to_string(tile_id) +
-              " does not exist. Skipping...");
-    if (edge_data)
-      GDALClose(edge_data);
-    if (node_data)
-      GDALClose(node_data);
-    return;
-  }
-  // Trim reader if over-committed
-  if (reader.OverCommitted()) {
-    reader.Trim();
-  }
-
-  OGRSpatialReference spatialRef;
-  spatialRef.SetWellKnownGeogCS("WGS84");
-
-  OGRLayer* edges_layer;
-  OGRLayer* nodes_layer;
-  if (edge_data)
-    edges_layer = edge_data->CreateLayer("edges", &spatialRef,
-                                         wkbLineString, dataset_options);
-
-  if (node_data)
-    nodes_layer = node_data->CreateLayer("nodes", &spatialRef, wkbPoint,
-                                         dataset_options);
-
-  // create fields
-  if (filter.localidx) {
-    OGRFieldDefn field_name("edgeid", OFTInteger);
-    edges_layer->CreateField(&field_name);
-  }
-  if (filter.road_class) {
-    OGRFieldDefn field_name("road_class", OFTString);
-    edges_layer->CreateField(&field_name);
-  }
-
-  if (filter.density) {
-    OGRFieldDefn field_name("density", OFTInteger);
-    edges_layer->CreateField(&field_name);
-  }
-
-  if (filter.urban) {
-    OGRFieldDefn field_name("urban", OFTInteger);
-    edges_layer->CreateField(&field_name);
-  }
-
-  if (filter.country_crossing) {
-    OGRFieldDefn field_name("country_crossing", OFTInteger);
-    edges_layer->CreateField(&field_name);
-  }
-
-  if (filter.predicted_speeds) {
-    for (const auto& i : filter.pred_speed_indices) {
-      std::string name = "predspeed_" + std::to_string(i);
-      OGRFieldDefn field_name(name.c_str(), OFTInteger);
-      edges_layer->CreateField(&field_name);
-    }
-  }
-
-  if (filter.type) {
-    OGRFieldDefn field_name("type", OFTString);
-    nodes_layer->CreateField(&field_name);
-  }
-
-  auto tile = reader.GetGraphTile(tile_id);
-
-  GraphId nodeid = tile_id;
-
-  if (filter.nodes) {
-    // export nodes
-    for (size_t idx = 0; idx < tile->header()->nodecount();
-         ++idx, nodeid++) {
-      auto ni = tile->node(idx);
-      if (!costing->Allowed(ni))
-        continue;
-      auto ll = tile->get_node_ll(nodeid);
-      OGRFeature* feature =
-          OGRFeature::CreateFeature(nodes_layer->GetLayerDefn());
-      auto point = new OGRPoint();
-      point->setX(ll.lng());
-      point->setY(ll.lat());
-      feature->SetGeometryDirectly(point);
-
-      if (filter.type) {
-        feature->SetField("type",
-                          valhalla::baldr::to_string(ni->type()).c_str());
-      }
-      if (nodes_layer->CreateFeature(feature) != OGRERR_NONE) {
-        LOG_ERROR("Failed to create feature");
-      }
-
-      OGRFeature::DestroyFeature(feature);
-    }
-  }
-
-  if (!filter.edges)
-    return;
-
-  // export edges
-  for (size_t idx = 0; idx < tile->header()->directededgecount(); ++idx) {
-    auto de = tile->directededge(idx);
-
-    // it's a shortcut but we want none or it's not but we only want
-    // shortcuts
-    if ((!filter.shortcuts_only && de->is_shortcut()) ||
-        (filter.shortcuts_only && !de->is_shortcut()))
-      continue;
-
-    if (!costing->Allowed(de, tile, valhalla::sif::kDisallowNone) ||
-        filter.is_filtered(de, tile, costing))
-      continue;
-
-    auto ei = tile->edgeinfo(de);
-
-    auto shape = ei.shape();
-    OGRLineString* line = ConvertToOGRLineString(shape);
-    OGRFeature* feature =
-        OGRFeature::CreateFeature(edges_layer->GetLayerDefn());
-    feature->SetGeometryDirectly(line);
-
-    if (filter.localidx) {
-      feature->SetField("edgeid", static_cast<int>(idx));
-    }
-    if (filter.road_class) {
-      feature->SetField("road_class",
-                        valhalla::baldr::to_string(de->classification())
-                            .c_str());
-    }
-    if (filter.density) {
-      feature->SetField("density", static_cast<int>(de->density()));
-    }
-    if (filter.urban) {
-      feature->SetField("urban", static_cast<int>(de->density() > 8));
-    }
-    if (filter.country_crossing) {
-      feature->SetField("country_crossing",
-                        static_cast<int>(de->ctry_crossing()));
-    }
-    if (filter.predicted_speeds) {
-      for (const auto& i : filter.pred_speed_indices) {
-        std::string field_name = "predspeed_" + std::to_string(i);
-        if (de->has_predicted_speed()) {
-          uint8_t sources = 0;
-          auto s =
-              tile->GetSpeed(de, valhalla::baldr::kPredictedFlowMask,
-                             i * valhalla::baldr::kSpeedBucketSizeSeconds,
-                             costing->is_hgv(), &sources);
-          if (sources & valhalla::baldr::kPredictedFlowMask) {
-            feature->SetField(field_name.c_str(), static_cast<int>(s));
-
-          } else {
-            feature->SetField(field_name.c_str(), static_cast<int>(0));
-          }
-        } else {
-          feature->SetField(field_name.c_str(), static_cast<int>(0));
-        }
-      }
-    }
-    if (edges_layer->CreateFeature(feature) != OGRERR_NONE) {
-      LOG_ERROR("Failed to create feature");
-    }
-
-    OGRFeature::DestroyFeature(feature);
-  }
-
-  if (edge_data)
-    GDALClose(edge_data);
-
-  if (node_data)
-    GDALClose(node_data);
-};
-
-void work(boost::property_tree::ptree& config,
-          const std::string& output_dir,
-          const std::string& file_suffix,
-          valhalla::sif::cost_ptr_t costing,
-          const AttributeFilter& filter,
-          std::queue<valhalla::baldr::GraphId>& tile_queue,
-          std::mutex& lock) {
-  valhalla::baldr::GraphReader reader(config.get_child("mjolnir"));
-  valhalla::baldr::GraphId tile_id;
-  const char* driver_name = "FlatGeobuf";
-  GDALDriver* driver =
-      GetGDALDriverManager()->GetDriverByName(driver_name);
-  if (!driver) {
-    LOG_ERROR("FlatGeoBuf driver not available");
-    return;
-  }
-  // create some options
-  char** dataset_options = NULL;
-  dataset_options =
-      CSLSetNameValue(dataset_options, "SPATIAL_INDEX", "YES");
-
-  while (true) {
-    {
-      std::lock_guard l(lock);
-      if (tile_queue.empty())
-        break;
-      tile_id = tile_queue.front();
-      tile_queue.pop();
-    }
-    export_tile(reader, tile_id, output_dir, file_suffix, costing, driver,
-                dataset_options, filter);
-  }
-}
+using namespace valhalla::tools;
 
 /**
  * Exports features that match the passed tileids to the specified
@@ -455,41 +59,270 @@ int export_tiles(boost::property_tree::ptree& config,
                  const AttributeFilter& filter,
                  std::vector<std::string>& tile_ids) {
 
-  std::queue<valhalla::baldr::GraphId> tile_queue;
-
-  // fill up a queue
+  std::vector<valhalla::baldr::GraphId> tiles;
+  tiles.reserve(tile_ids.size());
   for (const auto& tile_id : tile_ids) {
     try {
-      tile_queue.push(GraphId(tile_id));
-    } catch (std::exception& e) {
+      tiles.emplace_back(tile_id);
+    } catch (std::exception&) {
       LOG_ERROR("Error converting tile ID: " + tile_id);
-      throw e;
+      throw;
     }
   }
   // no need for this anymore
   tile_ids.resize(0);
   tile_ids.shrink_to_fit();
+  auto shard = shard_t::from_config(config);
+  shard.select(config, tiles);
 
-  // multithread it
-  std::vector<std::shared_ptr<std::thread>> threads(
-      config.get<size_t>("mjolnir.concurrency"));
-  std::mutex lock;
-
-  for (size_t i = 0; i < threads.size(); ++i) {
-    threads[i] = std::make_shared<std::thread>(work, std::ref(config),
-                                               std::cref(output_dir),
-                                               std::cref(file_suffix),
-                                               costing, std::cref(filter),
-                                               std::ref(tile_queue),
-                                               std::ref(lock));
-  }
+  GDALDriver* driver =
+      GetGDALDriverManager()->GetDriverByName("FlatGeobuf");
+  if (!driver)
+    throw std::runtime_error("FlatGeoBuf driver not available");
+  // create some options, they are only ever read so all workers share them
+  char** dataset_options = NULL;
+  dataset_options =
+      CSLSetNameValue(dataset_options, "SPATIAL_INDEX", "YES");
 
-  for (const auto& thread : threads)
-    thread->join();
+  executor_t executor(executor_options_t::from_config(config));
+  per_worker_t<valhalla::baldr::GraphReader> readers(executor, [&]() {
+    return new valhalla::baldr::GraphReader(config.get_child("mjolnir"));
+  });
+  tile_prefetcher_t prefetcher(config, tiles);
+  try {
+    executor.for_each(
+        tiles.size(),
+        [&](size_t worker, size_t i) {
+          prefetcher.advance(i);
+          export_tile(readers[worker], tiles[i], output_dir, file_suffix,
+                      costing, driver, dataset_options, filter);
+        },
+        "Exporting tiles");
+  } catch (...) {
+    CSLDestroy(dataset_options);
+    throw;
+  }
+  CSLDestroy(dataset_options);
+  prefetcher.log_stats();
+  shard.mark_done();
 
   return EXIT_SUCCESS;
 };
 
+/**
+ * Exports features that match the passed tileids as PostgreSQL binary
+ * COPY streams. The workers hand in the rows of every tile by index, so
+ * the rows come out in tile order.
+ *
+ * @param config the config object
+ * @param edges_path where to write the edges, empty for none
+ * @param nodes_path where to write the nodes, empty for none
+ * @param costing the costing to filter allowed/disallowed edges
+ * @param filter which attributes to include/exclude
+ * @param tile_ids which tiles to export
+ */
+int export_tiles_pgcopy(boost::property_tree::ptree& config,
+                        const std::string& edges_path,
+                        const std::string& nodes_path,
+                        valhalla::sif::cost_ptr_t costing,
+                        const AttributeFilter& filter,
+                        const std::vector<std::string>& tile_ids) {
+  std::vector<valhalla::baldr::GraphId> tiles;
+  tiles.reserve(tile_ids.size());
+  for (const auto& tile_id : tile_ids)
+    tiles.emplace_back(tile_id);
+  auto shard = shard_t::from_config(config);
+  shard.select(config, tiles);
+
+  std::unique_ptr<pgcopy_sink_t> edges, nodes;
+  if (filter.edges)
+    edges = std::make_unique<pgcopy_sink_t>(edges_path);
+  if (filter.nodes)
+    nodes = std::make_unique<pgcopy_sink_t>(nodes_path);
+
+  executor_t executor(executor_options_t::from_config(config));
+  per_worker_t<valhalla::baldr::GraphReader> readers(executor, [&]() {
+    return new valhalla::baldr::GraphReader(config.get_child("mjolnir"));
+  });
+  tile_prefetcher_t prefetcher(config, tiles);
+  std::atomic<uint64_t> features{0};
+  executor.for_each(
+      tiles.size(),
+      [&](size_t worker, size_t i) {
+        prefetcher.advance(i);
+        std::string edge_rows, node_rows;
+        try {
+          features += export_tile_pgcopy(readers[worker], tiles[i], costing,
+                                         filter, edges ? &edge_rows : nullptr,
+                                         nodes ? &node_rows : nullptr);
+          if (edges)
+            edges->write(i, std::move(edge_rows));
+          if (nodes)
+            nodes->write(i, std::move(node_rows));
+        } catch (...) {
+          // the later tiles would wait for this one forever
+          if (edges)
+            edges->abort();
+          if (nodes)
+            nodes->abort();
+          throw;
+        }
+      },
+      "Exporting tiles");
+  if (edges)
+    edges->finish();
+  if (nodes)
+    nodes->finish();
+  prefetcher.log_stats();
+  LOG_INFO("Wrote " + std::to_string(features.load()) + " rows (" +
+           std::to_string((edges ? edges->bytes() : 0) +
+                          (nodes ? nodes->bytes() : 0)) +
+           " bytes)");
+  shard.mark_done();
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Exports features that match the passed tileids into one edges and one
+ * nodes FlatGeobuf file in the output directory. The features are sorted
+ * externally, so memory stays within sort_memory however large the
+ * export gets.
+ *
+ * @param config the config object
+ * @param output_dir the directory to which the files will be written
+ * @param file_suffix file suffix to be applied prior to the file extension
+ * @param costing the costing to filter allowed/disallowed edges
+ * @param filter which attributes to include/exclude
+ * @param tile_ids which tiles to export
+ * @param sort_memory bytes of features to hold in memory per layer
+ */
+int export_tiles_merged(boost::property_tree::ptree& config,
+                        const std::string& output_dir,
+                        std::string file_suffix,
+                        valhalla::sif::cost_ptr_t costing,
+                        const AttributeFilter& filter,
+                        const std::vector<std::string>& tile_ids,
+                        size_t sort_memory) {
+  std::vector<valhalla::baldr::GraphId> tiles;
+  tiles.reserve(tile_ids.size());
+  for (const auto& tile_id : tile_ids)
+    tiles.emplace_back(tile_id);
+  auto shard = shard_t::from_config(config);
+  shard.select(config, tiles);
+  // every shard writes its own files
+  if (shard.enabled())
+    file_suffix += "_" + std::to_string(shard.index()) + "_of_" +
+                   std::to_string(shard.count());
+
+  executor_t executor(executor_options_t::from_config(config));
+  std::filesystem::create_directories(output_dir);
+  auto path = [&](const std::string& layer) {
+    return (std::filesystem::path(output_dir) /
+            (layer + file_suffix + ".fgb"))
+        .string();
+  };
+  std::unique_ptr<fgb_writer_t> edges, nodes;
+  if (filter.edges)
+    edges = std::make_unique<fgb_writer_t>(
+        path("edges"), "edges", fgb_geometry_type_t::kLineString,
+        fgb_edge_columns(filter), executor.size(), sort_memory);
+  if (filter.nodes)
+    nodes = std::make_unique<fgb_writer_t>(
+        path("nodes"), "nodes", fgb_geometry_type_t::kPoint,
+        fgb_node_columns(filter), executor.size(), sort_memory);
+  if (!edges && !nodes) {
+    LOG_INFO("No attributes specified, skipping export");
+    return EXIT_SUCCESS;
+  }
+
+  per_worker_t<valhalla::baldr::GraphReader> readers(executor, [&]() {
+    return new valhalla::baldr::GraphReader(config.get_child("mjolnir"));
+  });
+  tile_prefetcher_t prefetcher(config, tiles);
+  executor.for_each(
+      tiles.size(),
+      [&](size_t worker, size_t i) {
+        prefetcher.advance(i);
+        export_tile_fgb(readers[worker], tiles[i], costing, filter,
+                        edges.get(), nodes.get(), worker);
+      },
+      "Exporting tiles");
+  prefetcher.log_stats();
+  if (edges)
+    edges->finish();
+  if (nodes)
+    nodes->finish();
+  shard.mark_done();
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Writes the live traffic of the edges whose traffic changed to
+ * <output_dir>/traffic-<unix time>.csv every interval seconds until
+ * SIGINT. Only the words of the traffic extract are compared, no tiles
+ * are read. The first file has every edge with live traffic.
+ *
+ * @param config the config object, with mjolnir.traffic_extract
+ * @param output_dir the directory to which the files will be written
+ * @param interval seconds from the start of one snapshot to the next
+ */
+int export_traffic_deltas(boost::property_tree::ptree& config,
+                          const std::string& output_dir,
+                          unsigned int interval) {
+  auto path = config.get<std::string>("mjolnir.traffic_extract", "");
+  if (path.empty())
+    throw std::runtime_error(
+        "Traffic deltas need mjolnir.traffic_extract");
+  std::filesystem::create_directories(output_dir);
+
+  std::string header = "id";
+  for (const auto& column : live_speed_columns())
+    header += "," + column;
+  header += '\n';
+
+  // the executor also makes SIGINT stop the loop
+  executor_t executor(executor_options_t::from_config(config));
+  traffic_delta_t delta(path);
+  auto next = std::chrono::steady_clock::now();
+  while (!interrupted()) {
+    auto start = std::chrono::steady_clock::now();
+    auto time = std::to_string(std::time(nullptr));
+    std::string rows = header;
+    size_t changed;
+    try {
+      changed = delta.poll(executor, rows);
+    } catch (const interrupted_error&) {
+      break;
+    }
+    if (changed) {
+      auto file = (std::filesystem::path(output_dir) /
+                   ("traffic-" + time + ".csv"))
+                      .string();
+      {
+        std::ofstream out(file + ".tmp", std::ios::binary);
+        out.write(rows.data(), rows.size());
+        if (!out)
+          throw std::runtime_error("Unable to write " + file);
+      }
+      std::filesystem::rename(file + ".tmp", file);
+    }
+    auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    LOG_INFO(std::to_string(changed) + " edges changed, took " +
+             std::to_string(millis) + "ms");
+
+    // a slow snapshot delays the next one instead of queueing them up
+    next = std::max(next + std::chrono::seconds(interval),
+                    std::chrono::steady_clock::now());
+    while (!interrupted() && std::chrono::steady_clock::now() < next)
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  return EXIT_SUCCESS;
+}
+
 } // namespace
 int main(int argc, char** argv) {
   const auto program = filesystem::path(__FILE__).stem().string();
@@ -505,6 +338,14 @@ int main(int argc, char** argv) {
   std::vector<unsigned int> predicted_speed_indices;
   bool shortcuts_only = false;
   bool complete_graph = false;
+  std::string pgcopy_edges, pgcopy_nodes;
+  bool pgcopy_schema_only = false;
+  simplify_options_t simplify;
+  bool merged = false;
+  bool traffic_deltas = false;
+  unsigned int traffic_interval = 60;
+  size_t sort_memory = 1024;
+  std::string trace_path;
 
   try {
     cxxopts::Options
@@ -517,6 +358,7 @@ int main(int argc, char** argv) {
     ("j,concurrency", "Number of threads to use.", cxxopts::value<unsigned int>())
     ("c,config", "Path to the json configuration file.", cxxopts::value<std::string>())
     ("i,inline-config", "Inline json config.",cxxopts::value<std::string>())
+    ("prefetch-depth", "Number of tiles per thread to load ahead of time, 0 turns it off. Overrides mjolnir.prefetch_depth, defaults to 4.", cxxopts::value<unsigned int>())
     ("o,costing", "Costing to use", cxxopts::value<std::string>()->default_value("none"))
     ("e,exclude-attributes", "Attributes to exclude", cxxopts::value<std::vector<std::string>>())
     ("a,include-attributes", "Attributes to include", cxxopts::value<std::vector<std::string>>())
@@ -527,6 +369,19 @@ int main(int argc, char** argv) {
     ("se,predicted-speed-index-end", "At which bucket index to end exporting predicted speeds", cxxopts::value<unsigned int>())
     ("t,shortcuts-only", "Whether to only output shortcut edges", cxxopts::value<bool>())
     ("u,file-suffix", "suffix to apply prior to the file extension", cxxopts::value<std::string>())
+    ("simplify", "Simplify edge shapes with this tolerance, in meters or z<zoom> for the size of a pixel at that zoom", cxxopts::value<std::string>())
+    ("simplify-method", "douglas-peucker or visvalingam", cxxopts::value<std::string>()->default_value("douglas-peucker"))
+    ("drop-short-edges", "With --simplify, leave out edges shorter than the tolerance", cxxopts::value<bool>())
+    ("merged", "Write all tiles into one edges<suffix>.fgb and nodes<suffix>.fgb, sorted and indexed with bounded memory", cxxopts::value<bool>(merged))
+    ("sort-memory", "With --merged, MiB of features per layer to hold in memory before spilling sorted runs to the output directory", cxxopts::value<size_t>(sort_memory)->default_value("1024"))
+    ("traffic-deltas", "Instead of tiles, export the live traffic of the edges whose traffic changed to <output-directory>/traffic-<unix time>.csv every --traffic-interval seconds until interrupted, straight from mjolnir.traffic_extract", cxxopts::value<bool>(traffic_deltas))
+    ("traffic-interval", "Seconds between two --traffic-deltas snapshots", cxxopts::value<unsigned int>(traffic_interval)->default_value("60"))
+    ("pgcopy-edges", "Write the edges as a PostgreSQL binary COPY stream to this file or named pipe, - for stdout, instead of FlatGeobuf files", cxxopts::value<std::string>(pgcopy_edges))
+    ("pgcopy-nodes", "Write the nodes as a PostgreSQL binary COPY stream to this file or named pipe, - for stdout", cxxopts::value<std::string>(pgcopy_nodes))
+    ("pgcopy-schema", "Print the CREATE TABLE statements for the COPY streams and exit", cxxopts::value<bool>(pgcopy_schema_only))
+    ("shard", "Only process shard i/n of the tiles (0 <= i < n), split by tile size. Writes shard-<i>-of-<n>.done once finished.", cxxopts::value<std::string>())
+    ("shard-marker-dir", "Where to write the shard's completion marker, defaults to the output directory.", cxxopts::value<std::string>())
+    ("trace", "Write a Chrome trace of the run to this file, it can be opened in Perfetto.", cxxopts::value<std::string>(trace_path))
     ("TILEID", "If provided, only export features matching the passed tile IDs. Can alternatively be passed via stdin", cxxopts::value<std::vector<std::string>>());
     // clang-format on
 
@@ -538,6 +393,23 @@ int main(int argc, char** argv) {
                            true))
       return EXIT_SUCCESS;
 
+    if (pgcopy_edges == "-" && pgcopy_nodes == "-")
+      throw std::runtime_error("Only one COPY stream can go to stdout");
+    // the COPY stream owns stdout
+    if (pgcopy_edges == "-" || pgcopy_nodes == "-")
+      valhalla::midgard::logging::Configure({{"type", "std_err"}});
+
+    if (result.count("prefetch-depth"))
+      pt.put("mjolnir.prefetch_depth",
+             result["prefetch-depth"].as<unsigned int>());
+
+    if (result.count("shard"))
+      pt.put("mjolnir.shard", result["shard"].as<std::string>());
+    if (result.count("shard-marker-dir"))
+      pt.put("mjolnir.shard_marker_dir",
+             result["shard-marker-dir"].as<std::string>());
+    shard_t::from_config(pt);
+
     // try from positional arguments
     if (result["TILEID"].count() != 0) {
       tile_ids = result["TILEID"].as<std::vector<std::string>>();
@@ -597,6 +469,15 @@ int main(int argc, char** argv) {
       }
     }
 
+    if (result["simplify"].count() != 0) {
+      simplify = parse_simplify_options(
+          result["simplify"].as<std::string>(),
+          result["simplify-method"].as<std::string>());
+      simplify.drop_short_edges = result["drop-short-edges"].count() != 0;
+    } else if (result["drop-short-edges"].count() != 0) {
+      throw cxxopts::exceptions::missing_argument("simplify");
+    }
+
     if (result["shortcuts-only"].count() != 0) {
       shortcuts_only = true;
     }
@@ -621,7 +502,7 @@ int main(int argc, char** argv) {
     }
 
     // read tile ids from stdin
-    if (tile_ids.size() == 0) {
+    if (tile_ids.size() == 0 && !pgcopy_schema_only && !traffic_deltas) {
       std::string tileid;
       while (std::getline(std::cin, tileid)) {
         if (!tileid.empty()) {
@@ -630,13 +511,16 @@ int main(int argc, char** argv) {
       }
     }
 
-    if (tile_ids.size() == 0) {
+    if (tile_ids.size() == 0 && !traffic_deltas) {
       LOG_INFO("No Tile IDs passed, exporting all tiles");
     }
 
     if (result["output-directory"].count() > 0) {
       output_dir = result["output-directory"].as<std::string>();
-    } else {
+      if (!result.count("shard-marker-dir"))
+        pt.put("mjolnir.shard_marker_dir", output_dir);
+    } else if (pgcopy_edges.empty() && pgcopy_nodes.empty() &&
+               !pgcopy_schema_only) {
       throw cxxopts::exceptions::missing_argument("output-dir");
     }
 
@@ -661,6 +545,7 @@ int main(int argc, char** argv) {
     return EXIT_FAILURE;
   }
 
+  trace::session_t trace_session(trace_path);
   try {
     // register gdal drivers
     GDALAllRegister();
@@ -668,11 +553,33 @@ int main(int argc, char** argv) {
     AttributeFilter filter(std::move(includes), std::move(excludes),
                            std::move(predicted_speed_indices),
                            search_filter, shortcuts_only);
-    valhalla::sif::cost_ptr_t costing = create_costing(costing_str);
+    filter.simplify = simplify;
+    if (pgcopy_schema_only) {
+      std::cout << pgcopy_schema(filter, "edges", "nodes");
+      return EXIT_SUCCESS;
+    }
+
+    if (traffic_deltas)
+      return export_traffic_deltas(pt, output_dir,
+                                   std::max(traffic_interval, 1U));
+
+    valhalla::sif::cost_ptr_t costing =
+        valhalla::tools::create_costing(costing_str);
+    if (!pgcopy_edges.empty() || !pgcopy_nodes.empty()) {
+      if (filter.edges && pgcopy_edges.empty())
+        throw std::runtime_error("Edge attributes need --pgcopy-edges");
+      if (filter.nodes && pgcopy_nodes.empty())
+        throw std::runtime_error("Node attributes need --pgcopy-nodes");
+      return export_tiles_pgcopy(pt, pgcopy_edges, pgcopy_nodes, costing,
+                                 filter, tile_ids);
+    }
+    if (merged)
+      return export_tiles_merged(pt, output_dir, file_suffix, costing,
+                                 filter, tile_ids, sort_memory << 20);
     return export_tiles(pt, output_dir, file_suffix, costing, filter,
                         tile_ids);
   } catch (std::exception& e) {
-    std::cout << "Failed to export tiles: " << e.what() << "\n";
+    std::cerr << "Failed to export tiles: " << e.what() << "\n";
     return EXIT_FAILURE;
   }
 }
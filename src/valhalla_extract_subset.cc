@@ -0,0 +1,234 @@
+#include "executor.h"
+#include "tile_extract.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cxxopts.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <valhalla/midgard/logging.h>
+
+namespace {
+using namespace valhalla;
+
+enum class Format { kTar, kDirectory };
+
+std::vector<uint32_t> read_tile_ids(std::istream& in) {
+  std::vector<uint32_t> tile_ids;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line == "\r")
+      continue;
+    tile_ids.push_back(tools::parse_tile_id(line));
+  }
+  std::sort(tile_ids.begin(), tile_ids.end());
+  tile_ids.erase(std::unique(tile_ids.begin(), tile_ids.end()),
+                 tile_ids.end());
+  return tile_ids;
+}
+
+/**
+ * Looks up the tiles in the source index, tiles that aren't in there are
+ * skipped with a warning. Returns the source entries sorted by their
+ * offset, so the source is read front to back.
+ */
+std::vector<tools::tile_index_entry_t>
+select_tiles(const std::vector<tools::tile_index_entry_t>& index,
+             const std::vector<uint32_t>& tile_ids) {
+  std::unordered_map<uint32_t, const tools::tile_index_entry_t*> lookup;
+  lookup.reserve(index.size());
+  for (const auto& entry : index)
+    lookup.emplace(entry.tile_id, &entry);
+
+  std::vector<tools::tile_index_entry_t> selected;
+  selected.reserve(tile_ids.size());
+  for (auto tile_id : tile_ids) {
+    auto found = lookup.find(tile_id);
+    if (found == lookup.end()) {
+      LOG_WARN("Tile " + tools::tile_file_path(tile_id) +
+               " is not in the extract");
+      continue;
+    }
+    selected.push_back(*found->second);
+  }
+  std::sort(selected.begin(), selected.end(),
+            [](const auto& a, const auto& b) { return a.offset < b.offset; });
+  return selected;
+}
+
+void write_tar(int in_fd,
+               const std::vector<tools::tile_index_entry_t>& selected,
+               const std::string& output,
+               tools::executor_t& executor) {
+  auto entries = selected;
+  auto total_size = tools::layout_extract(entries);
+
+  int out_fd = ::open(output.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (out_fd < 0)
+    throw std::runtime_error("Unable to open " + output);
+  try {
+    tools::write_extract_skeleton(out_fd, entries, total_size);
+    executor.for_each(
+        entries.size(),
+        [&](size_t, size_t i) {
+          tools::copy_range(in_fd, selected[i].offset, out_fd,
+                            entries[i].offset, entries[i].size);
+        },
+        "Copying tiles");
+  } catch (...) {
+    ::close(out_fd);
+    throw;
+  }
+  ::close(out_fd);
+}
+
+void write_directory(int in_fd,
+                     const std::vector<tools::tile_index_entry_t>& selected,
+                     const std::string& output,
+                     tools::executor_t& executor) {
+  // directories first, many tiles share them
+  std::vector<std::filesystem::path> paths;
+  paths.reserve(selected.size());
+  for (const auto& entry : selected) {
+    paths.push_back(std::filesystem::path(output) /
+                    tools::tile_file_path(entry.tile_id));
+    std::filesystem::create_directories(paths.back().parent_path());
+  }
+
+  executor.for_each(
+      selected.size(),
+      [&](size_t, size_t i) {
+        int out_fd =
+            ::open(paths[i].c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out_fd < 0)
+          throw std::runtime_error("Unable to open " + paths[i].string());
+        try {
+          tools::copy_range(in_fd, selected[i].offset, out_fd, 0,
+                            selected[i].size);
+        } catch (...) {
+          ::close(out_fd);
+          throw;
+        }
+        ::close(out_fd);
+      },
+      "Copying tiles");
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  const auto program = std::filesystem::path(__FILE__).stem().string();
+  std::string extract, tiles = "-", output;
+  Format format = Format::kTar;
+  size_t concurrency = std::thread::hardware_concurrency();
+  std::string trace_path;
+
+  try {
+    cxxopts::Options options(program,
+                             "copies a subset of tiles from a tile extract "
+                             "into a new extract or a tile directory.");
+
+    // clang-format off
+    options.add_options()
+    ("h,help", "Print this help message.")
+    ("x,extract", "The tile extract to copy the tiles from.", cxxopts::value<std::string>())
+    ("t,tiles", "File with one tile ID (level/tile/0) per line, defaults to stdin.", cxxopts::value<std::string>())
+    ("o,output", "The tar or directory to write the tiles to.", cxxopts::value<std::string>())
+    ("f,format", "Output format, tar or dir. Defaults to tar if the output ends with .tar.", cxxopts::value<std::string>())
+    ("j,concurrency", "Number of threads to use.", cxxopts::value<size_t>())
+    ("trace", "Write a Chrome trace of the run to this file, it can be opened in Perfetto.", cxxopts::value<std::string>(trace_path));
+    // clang-format on
+
+    auto result = options.parse(argc, argv);
+    if (result.count("help")) {
+      std::cout << options.help() << "\n";
+      return EXIT_SUCCESS;
+    }
+    if (!result.count("extract"))
+      throw cxxopts::exceptions::missing_argument("extract");
+    if (!result.count("output"))
+      throw cxxopts::exceptions::missing_argument("output");
+    extract = result["extract"].as<std::string>();
+    output = result["output"].as<std::string>();
+    if (result.count("tiles"))
+      tiles = result["tiles"].as<std::string>();
+    if (result.count("concurrency"))
+      concurrency = std::max(result["concurrency"].as<size_t>(), size_t(1));
+
+    auto format_str =
+        result.count("format")
+            ? result["format"].as<std::string>()
+            : (std::filesystem::path(output).extension() == ".tar" ? "tar"
+                                                                   : "dir");
+    if (format_str == "tar")
+      format = Format::kTar;
+    else if (format_str == "dir")
+      format = Format::kDirectory;
+    else
+      throw std::runtime_error("Unknown format: " + format_str);
+  } catch (cxxopts::exceptions::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  } catch (std::exception& e) {
+    std::cerr << "Unable to parse command line options because: "
+              << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  tools::trace::session_t trace_session(trace_path);
+  try {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<uint32_t> tile_ids;
+    if (tiles == "-") {
+      tile_ids = read_tile_ids(std::cin);
+    } else {
+      std::ifstream file(tiles);
+      if (!file.is_open())
+        throw std::runtime_error("Unable to open " + tiles);
+      tile_ids = read_tile_ids(file);
+    }
+
+    auto selected = select_tiles(tools::read_tile_index(extract), tile_ids);
+    uint64_t bytes = 0;
+    for (const auto& entry : selected)
+      bytes += entry.size;
+
+    tools::executor_options_t executor_options;
+    executor_options.concurrency = concurrency;
+    tools::executor_t executor(executor_options);
+
+    int in_fd = ::open(extract.c_str(), O_RDONLY);
+    if (in_fd < 0)
+      throw std::runtime_error("Unable to open " + extract);
+    try {
+      if (format == Format::kTar)
+        write_tar(in_fd, selected, output, executor);
+      else
+        write_directory(in_fd, selected, output, executor);
+    } catch (...) {
+      ::close(in_fd);
+      throw;
+    }
+    ::close(in_fd);
+
+    auto seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    LOG_INFO("Copied " + std::to_string(selected.size()) + " of " +
+             std::to_string(tile_ids.size()) + " tiles (" +
+             std::to_string(bytes) + " bytes) to " + output + " in " +
+             std::to_string(seconds) + "s");
+  } catch (std::exception& e) {
+    std::cerr << "Failed to extract tiles: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
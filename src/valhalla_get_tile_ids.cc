@@ -1,5 +1,16 @@
+#include "executor.h"
+#include "tile_cover.h"
+#include "tile_extract.h"
+
+#include <algorithm>
+#include <array>
 #include <cxxopts.hpp>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 #include <valhalla/baldr/graphid.h>
 #include <valhalla/baldr/tilehierarchy.h>
 #include <valhalla/midgard/aabb2.h>
@@ -18,7 +29,7 @@ midgard::AABB2<midgard::PointLL> parse_bbox_str(const std::string& s) {
   while ((next = s.find(delim, last)) != std::string::npos) {
     std::string coord = s.substr(last, next - last);
 
-    if (idx > 3)
+    if (idx > 2)
       throw std::runtime_error("Too many coordinates provided for bbox");
 
     try {
@@ -30,34 +41,177 @@ midgard::AABB2<midgard::PointLL> parse_bbox_str(const std::string& s) {
     ++idx;
   }
 
-  // get the last one
-  std::string coord = s.substr(last);
-  pts[idx] = std::stod(coord);
-
   if (idx != 3)
-    std::runtime_error("Invalid bbox string provided");
+    throw std::runtime_error("Invalid bbox string provided");
+
+  // get the last one
+  try {
+    pts[idx] = std::stod(s.substr(last));
+  } catch (std::exception& e) {
+    throw std::runtime_error("Unable to parse bounding box");
+  }
 
   return midgard::AABB2<midgard::PointLL>(midgard::PointLL(pts[0], pts[1]),
                                           midgard::PointLL(pts[2],
                                                            pts[3]));
 }
+
+std::string read_input(const std::string& path) {
+  std::stringstream ss;
+  if (path == "-") {
+    ss << std::cin.rdbuf();
+  } else {
+    std::ifstream file(path);
+    if (!file)
+      throw std::runtime_error("Unable to open " + path);
+    ss << file.rdbuf();
+  }
+  return ss.str();
+}
+using tile_sizes_t = std::unordered_map<uint32_t, uint32_t>;
+
+tile_sizes_t read_tile_sizes(const std::string& extract) {
+  tile_sizes_t sizes;
+  for (const auto& entry : tools::read_tile_index(extract))
+    sizes.emplace(entry.tile_id, entry.size);
+  return sizes;
+}
+
+uint32_t tile_size(const baldr::GraphId& tile_id, const tile_sizes_t& sizes) {
+  auto found = sizes.find(static_cast<uint32_t>(tile_id.value));
+  return found == sizes.cend() ? 0 : found->second;
+}
+
+/**
+ * Prints the tiles of a cover, one per row, optionally prefixed by a
+ * region name and followed by the tile's size in the extract. Returns
+ * the summed size.
+ */
+uint64_t print_tiles(const tools::tile_cover_t& cover,
+                     const std::string& prefix,
+                     const tile_sizes_t& sizes) {
+  uint64_t total = 0;
+  for (const auto& tile_id : cover.graph_ids()) {
+    if (!prefix.empty())
+      std::cout << prefix << delim;
+    std::cout << tile_id;
+    if (!sizes.empty()) {
+      auto size = tile_size(tile_id, sizes);
+      std::cout << delim << size;
+      total += size;
+    }
+    std::cout << "\n";
+  }
+  return total;
+}
+
+/**
+ * Covers all regions in parallel, then prints either the union of the
+ * covers or every region's tiles. A summary per region, including the
+ * number of tiles it shares with any other region, goes to stderr.
+ */
+void cover_regions(const std::vector<tools::region_t>& regions,
+                   double buffer,
+                   const std::vector<uint32_t>& levels,
+                   bool per_region,
+                   const tile_sizes_t& sizes,
+                   size_t concurrency) {
+  std::vector<tools::tile_cover_t> covers(regions.size());
+  tools::executor_options_t options;
+  options.concurrency = concurrency;
+  tools::executor_t executor(options);
+  // no progress, the logs would end up between the tile ids on stdout
+  executor.for_each(regions.size(), [&](size_t, size_t r) {
+    tools::cover_polygons(regions[r].polygons, buffer, levels, covers[r]);
+  });
+
+  // tiles in at least one and in at least two regions
+  tools::tile_cover_t once, twice;
+  for (const auto& cover : covers) {
+    auto shared = once;
+    shared &= cover;
+    twice |= shared;
+    once |= cover;
+  }
+
+  if (per_region) {
+    for (size_t r = 0; r < regions.size(); ++r)
+      print_tiles(covers[r], regions[r].name, sizes);
+  } else {
+    auto bytes = print_tiles(once, "", sizes);
+    std::cerr << "total: " << once.count() << " tiles";
+    if (!sizes.empty())
+      std::cerr << ", " << bytes << " bytes";
+    std::cerr << "\n";
+  }
+
+  for (size_t r = 0; r < regions.size(); ++r) {
+    std::cerr << regions[r].name << ": " << covers[r].count() << " tiles, "
+              << covers[r].count_shared(twice) << " shared";
+    if (!sizes.empty()) {
+      uint64_t bytes = 0;
+      for (const auto& tile_id : covers[r].graph_ids())
+        bytes += tile_size(tile_id, sizes);
+      std::cerr << ", " << bytes << " bytes";
+    }
+    std::cerr << "\n";
+  }
+}
 } // namespace
 
 int main(int argc, char** argv) {
   const auto program = std::filesystem::path(__FILE__).stem().string();
   midgard::AABB2<midgard::PointLL> bbox;
+  tools::multipolygon_t polygons;
+  std::vector<tools::linestring_t> lines;
+  std::vector<tools::region_t> regions;
+  tile_sizes_t sizes;
+  bool per_region = false;
+  size_t concurrency = std::thread::hardware_concurrency();
+  double buffer = 0;
+  std::vector<uint32_t> levels;
+  bool exact = false;
 
   try {
     cxxopts::Options options(program,
                              "prints a list of Valhalla tile IDs that "
-                             "intersect with a given bounding box.");
+                             "intersect with a given bounding box, "
+                             "GeoJSON polygons or along a line.");
 
     // clang-format off
     options.add_options()
     ("h,help", "Print this help message.")
     ("b,bounding-box",
        "the bounding box to intersect with",
-       cxxopts::value<std::string>());
+       cxxopts::value<std::string>())
+    ("p,polygon",
+       "GeoJSON file with (Multi)Polygons to intersect with, - for stdin.",
+       cxxopts::value<std::string>())
+    ("t,trace",
+       "Encoded polyline, GeoJSON LineString or CSV of lon,lat points to get "
+       "the tiles along, - for stdin.",
+       cxxopts::value<std::string>()->implicit_value("-"))
+    ("precision",
+       "Precision of an encoded polyline passed to --trace.",
+       cxxopts::value<double>()->default_value("1e-6"))
+    ("buffer",
+       "Buffer around the bounding box, polygons or trace in meters.",
+       cxxopts::value<double>()->default_value("0"))
+    ("l,levels",
+       "Hierarchy levels to get the tiles of, defaults to all.",
+       cxxopts::value<std::vector<uint32_t>>())
+    ("r,regions",
+       "GeoJSON FeatureCollection or CSV of name,minx,miny,maxx,maxy rows "
+       "with many regions to cover at once, - for stdin.",
+       cxxopts::value<std::string>())
+    ("per-region",
+       "With --regions, print region,tile_id rows instead of the union.")
+    ("x,extract",
+       "Tile extract whose index is used to print the size of every tile.",
+       cxxopts::value<std::string>())
+    ("j,concurrency",
+       "Number of threads to use.",
+       cxxopts::value<size_t>());
     // clang-format on
 
     auto result = options.parse(argc, argv);
@@ -66,11 +220,53 @@ int main(int argc, char** argv) {
       std::cout << options.help() << "\n";
       return EXIT_SUCCESS;
     }
-    if (result.count("bounding-box")) {
+    if (result.count("regions")) {
+      regions = tools::parse_regions(
+          read_input(result["regions"].as<std::string>()));
+      if (regions.empty())
+        throw std::runtime_error("No regions found in input");
+      exact = true;
+    } else if (result.count("trace")) {
+      lines = tools::parse_linestrings(
+          read_input(result["trace"].as<std::string>()),
+          result["precision"].as<double>());
+      if (lines.empty())
+        throw std::runtime_error("No lines found in input");
+      exact = true;
+    } else if (result.count("polygon")) {
+      polygons = tools::parse_geojson_polygons(
+          read_input(result["polygon"].as<std::string>()));
+      if (polygons.empty())
+        throw std::runtime_error("No polygons found in GeoJSON");
+      exact = true;
+    } else if (result.count("bounding-box")) {
       bbox = parse_bbox_str(result["bounding-box"].as<std::string>());
     } else {
       throw cxxopts::exceptions::missing_argument("bounding-box");
     }
+
+    per_region = result.count("per-region");
+    if (result.count("concurrency"))
+      concurrency = result["concurrency"].as<size_t>();
+    concurrency = std::max(concurrency, size_t(1));
+    if (result.count("extract")) {
+      sizes = read_tile_sizes(result["extract"].as<std::string>());
+      exact = true;
+    }
+
+    buffer = result["buffer"].as<double>();
+    if (buffer < 0)
+      throw std::runtime_error("Buffer must not be negative");
+    if (buffer > 0)
+      exact = true;
+
+    if (result.count("levels")) {
+      levels = result["levels"].as<std::vector<uint32_t>>();
+      exact = true;
+    } else {
+      for (const auto& level : baldr::TileHierarchy::levels())
+        levels.push_back(level.level);
+    }
   }
 
   catch (cxxopts::exceptions::exception& e) {
@@ -83,12 +279,30 @@ int main(int argc, char** argv) {
   }
 
   try {
-    for (const auto& tile_id : baldr::TileHierarchy::GetGraphIds(bbox)) {
-      std::cout << tile_id << "\n";
+    if (!exact) {
+      for (const auto& tile_id : baldr::TileHierarchy::GetGraphIds(bbox)) {
+        std::cout << tile_id << "\n";
+      }
+      return EXIT_SUCCESS;
+    }
+
+    if (!regions.empty()) {
+      cover_regions(regions, buffer, levels, per_region, sizes, concurrency);
+      return EXIT_SUCCESS;
     }
+
+    tools::tile_cover_t cover;
+    if (!lines.empty()) {
+      for (const auto& line : lines)
+        tools::cover_linestring(line, buffer, levels, cover);
+    } else {
+      if (polygons.empty())
+        polygons.push_back(tools::to_polygon(bbox));
+      tools::cover_polygons(polygons, buffer, levels, cover);
+    }
+    print_tiles(cover, "", sizes);
   } catch (std::exception& e) {
-    std::cerr << "Failed to remove predicted traffic: " << e.what()
-              << "\n";
+    std::cerr << "Failed to get tile IDs: " << e.what() << "\n";
     return EXIT_FAILURE;
   }
-}
\ No newline at end of file
+}
@@ -0,0 +1,89 @@
+#include "executor.h"
+#include "tile_patch.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cxxopts.hpp>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+#include <valhalla/midgard/logging.h>
+
+using namespace valhalla;
+
+int main(int argc, char** argv) {
+  const auto program = std::filesystem::path(__FILE__).stem().string();
+  std::string old_path, new_path, output;
+  int level = 19;
+  size_t concurrency = std::thread::hardware_concurrency();
+  std::string trace_path;
+
+  try {
+    cxxopts::Options options(program,
+                             "writes a patch with the tiles that differ "
+                             "between two tile extracts or tile "
+                             "directories, apply it with "
+                             "valhalla_apply_tile_patch.");
+
+    // clang-format off
+    options.add_options()
+    ("h,help", "Print this help message.")
+    ("old", "The tile extract or directory the patch applies to.", cxxopts::value<std::string>(old_path))
+    ("new", "The tile extract or directory the patch produces.", cxxopts::value<std::string>(new_path))
+    ("o,output", "The patch file to write.", cxxopts::value<std::string>(output))
+    ("l,level", "zstd compression level, 1 to 22. Defaults to 19.", cxxopts::value<int>(level))
+    ("j,concurrency", "Number of threads to use.", cxxopts::value<size_t>())
+    ("trace", "Write a Chrome trace of the run to this file, it can be opened in Perfetto.", cxxopts::value<std::string>(trace_path));
+    // clang-format on
+
+    auto result = options.parse(argc, argv);
+    if (result.count("help")) {
+      std::cout << options.help() << "\n";
+      return EXIT_SUCCESS;
+    }
+    if (old_path.empty())
+      throw cxxopts::exceptions::missing_argument("old");
+    if (new_path.empty())
+      throw cxxopts::exceptions::missing_argument("new");
+    if (output.empty())
+      throw cxxopts::exceptions::missing_argument("output");
+    if (result.count("concurrency"))
+      concurrency = std::max(result["concurrency"].as<size_t>(), size_t(1));
+  } catch (cxxopts::exceptions::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  } catch (std::exception& e) {
+    std::cerr << "Unable to parse command line options because: "
+              << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  tools::trace::session_t trace_session(trace_path);
+  try {
+    auto start = std::chrono::steady_clock::now();
+
+    tools::executor_options_t executor_options;
+    executor_options.concurrency = concurrency;
+    tools::executor_t executor(executor_options);
+    auto stats =
+        tools::make_patch(old_path, new_path, output, level, executor);
+
+    auto seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    LOG_INFO(std::to_string(stats.changed) + " changed, " +
+             std::to_string(stats.added) + " added, " +
+             std::to_string(stats.deleted) + " deleted and " +
+             std::to_string(stats.unchanged) + " unchanged tiles");
+    LOG_INFO("Wrote a " + std::to_string(stats.patch_bytes) +
+             " byte patch for " + std::to_string(stats.new_bytes) +
+             " bytes of tiles to " + output + " in " +
+             std::to_string(seconds) + "s");
+  } catch (std::exception& e) {
+    std::cerr << "Failed to make tile patch: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
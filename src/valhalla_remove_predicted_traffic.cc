@@ -4,11 +4,14 @@
 #include <valhalla/mjolnir/graphtilebuilder.h>
 
 #include "argparse_utils.h"
+#include <shard.h>
+#include <trace.h>
 #include <traffic.h>
 
 int main(int argc, char** argv) {
   const auto program = filesystem::path(__FILE__).stem().string();
   boost::property_tree::ptree pt;
+  std::string trace_path;
 
   try {
     cxxopts::Options options(program, "removes predicted traffic from valhalla tiles.\n");
@@ -18,7 +21,11 @@ int main(int argc, char** argv) {
     ("h,help", "Print this help message.")
     ("j,concurrency", "Number of threads to use.", cxxopts::value<unsigned int>())
     ("c,config", "Path to the json configuration file.", cxxopts::value<std::string>())
-    ("i,inline-config", "Inline json config.",cxxopts::value<std::string>());
+    ("i,inline-config", "Inline json config.",cxxopts::value<std::string>())
+    ("prefetch-depth", "Number of tiles per thread to load ahead of time, 0 turns it off. Overrides mjolnir.prefetch_depth, defaults to 4.", cxxopts::value<unsigned int>())
+    ("shard", "Only process shard i/n of the tiles (0 <= i < n), split by tile size. Writes shard-<i>-of-<n>.done once finished.", cxxopts::value<std::string>())
+    ("shard-marker-dir", "Where to write the shard's completion marker, defaults to the working directory.", cxxopts::value<std::string>())
+    ("trace", "Write a Chrome trace of the run to this file, it can be opened in Perfetto.", cxxopts::value<std::string>(trace_path));
     // clang-format on
 
     auto result = options.parse(argc, argv);
@@ -26,6 +33,17 @@ int main(int argc, char** argv) {
     if (!parse_common_args(program, options, result, pt, "mjolnir.logging", true))
       return EXIT_SUCCESS;
 
+    if (result.count("prefetch-depth"))
+      pt.put("mjolnir.prefetch_depth",
+             result["prefetch-depth"].as<unsigned int>());
+
+    if (result.count("shard"))
+      pt.put("mjolnir.shard", result["shard"].as<std::string>());
+    if (result.count("shard-marker-dir"))
+      pt.put("mjolnir.shard_marker_dir",
+             result["shard-marker-dir"].as<std::string>());
+    valhalla::tools::shard_t::from_config(pt);
+
   } catch (cxxopts::exceptions::exception& e) {
     std::cerr << e.what() << std::endl;
     return EXIT_FAILURE;
@@ -34,6 +52,7 @@ int main(int argc, char** argv) {
     return EXIT_FAILURE;
   }
 
+  valhalla::tools::trace::session_t trace_session(trace_path);
   try {
     valhalla::tools::remove_predicted_traffic(pt);
   } catch (std::exception& e) {
@@ -1,6 +1,8 @@
 #include "rest.h"
 
 #include "argparse_utils.h"
+#include "trace.h"
+#include <csignal>
 #include <cxxopts.hpp>
 #include <prime_server/prime_server.hpp>
 
@@ -11,6 +13,7 @@ int main(int argc, char** argv) {
   const auto program = std::filesystem::path(__FILE__).stem().string();
   boost::property_tree::ptree pt;
   std::string port;
+  std::string trace_path;
 
   // read args
   // clang-format off
@@ -21,7 +24,8 @@ int main(int argc, char** argv) {
     ("h,help", "Print this help message.")
     ("c,config", "Path to the configuration file", cxxopts::value<std::string>())
     ("i,inline-config", "Inline JSON config", cxxopts::value<std::string>())
-    ("p,port", "Port to listen to", cxxopts::value<std::string>(port)->default_value("8004"));
+    ("p,port", "Port to listen to", cxxopts::value<std::string>(port)->default_value("8004"))
+    ("trace", "Write a Chrome trace of the requests to this file on shutdown, it can be opened in Perfetto.", cxxopts::value<std::string>(trace_path));
 
   // clang-format on
   auto result = options.parse(argc, argv);
@@ -29,7 +33,23 @@ int main(int argc, char** argv) {
                          true))
     return EXIT_SUCCESS;
 
+  // the file to read again on every reload
+  std::string config_path;
+  if (!result.count("inline-config") && result.count("config"))
+    config_path = result["config"].as<std::string>();
+
+  // SIGHUP reloads the graph. It's blocked before any thread starts so
+  // all of them inherit that and only the graph's own thread takes it.
+  sigset_t hangup;
+  sigemptyset(&hangup);
+  sigaddset(&hangup, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &hangup, nullptr);
+
+  valhalla::tools::trace::session_t trace_session(trace_path);
   try {
+    tools::graph_handle_t graph(pt, config_path);
+    graph.reload_on_hangup();
+
     prime_server::
         quiesce(pt.get<unsigned int>("httpd.service.drain_seconds", 28U),
                 pt.get<unsigned int>("httpd.service.shutting_seconds",
@@ -53,7 +73,8 @@ int main(int argc, char** argv) {
     proxy_thread.detach();
 
     // only allow one thread
-    auto worker_thread = std::thread(tools::run_service, std::cref(pt));
+    auto worker_thread =
+        std::thread(tools::run_service, std::cref(pt), std::ref(graph));
     worker_thread.detach();
 
     // wait forever (or for interrupt)
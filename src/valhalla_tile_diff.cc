@@ -0,0 +1,554 @@
+#include <algorithm>
+#include <boost/property_tree/ptree_fwd.hpp>
+#include <cxxopts.hpp>
+#include <valhalla/baldr/graphid.h>
+#include <valhalla/baldr/graphreader.h>
+#include <valhalla/baldr/rapidjson_utils.h>
+
+#include "argparse_utils.h"
+#include "checksum.h"
+#include "executor.h"
+#include "extract_reader.h"
+#include "shard.h"
+#include "trace.h"
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+using namespace valhalla::baldr;
+namespace tools = valhalla::tools;
+namespace trace = valhalla::tools::trace;
+
+/**
+ * Directed edge attributes that are compared between two builds.
+ */
+using attribute_t = std::pair<const char*, uint32_t (*)(const DirectedEdge*)>;
+const std::array<attribute_t, 16> kAttributes{{
+    {"speed",
+     [](const DirectedEdge* de) -> uint32_t { return de->speed(); }},
+    {"free_flow_speed",
+     [](const DirectedEdge* de) -> uint32_t {
+       return de->free_flow_speed();
+     }},
+    {"constrained_flow_speed",
+     [](const DirectedEdge* de) -> uint32_t {
+       return de->constrained_flow_speed();
+     }},
+    {"truck_speed",
+     [](const DirectedEdge* de) -> uint32_t { return de->truck_speed(); }},
+    {"road_class",
+     [](const DirectedEdge* de) -> uint32_t {
+       return static_cast<uint32_t>(de->classification());
+     }},
+    {"use",
+     [](const DirectedEdge* de) -> uint32_t {
+       return static_cast<uint32_t>(de->use());
+     }},
+    {"surface",
+     [](const DirectedEdge* de) -> uint32_t {
+       return static_cast<uint32_t>(de->surface());
+     }},
+    {"forward_access",
+     [](const DirectedEdge* de) -> uint32_t {
+       return de->forwardaccess();
+     }},
+    {"reverse_access",
+     [](const DirectedEdge* de) -> uint32_t {
+       return de->reverseaccess();
+     }},
+    {"length",
+     [](const DirectedEdge* de) -> uint32_t { return de->length(); }},
+    {"lanecount",
+     [](const DirectedEdge* de) -> uint32_t { return de->lanecount(); }},
+    {"density",
+     [](const DirectedEdge* de) -> uint32_t { return de->density(); }},
+    {"toll", [](const DirectedEdge* de) -> uint32_t { return de->toll(); }},
+    {"tunnel",
+     [](const DirectedEdge* de) -> uint32_t { return de->tunnel(); }},
+    {"bridge",
+     [](const DirectedEdge* de) -> uint32_t { return de->bridge(); }},
+    {"has_predicted_speed",
+     [](const DirectedEdge* de) -> uint32_t {
+       return de->has_predicted_speed();
+     }},
+}};
+
+struct edge_change_t {
+  uint64_t way_id;
+  GraphId old_id;
+  GraphId new_id;
+  // index into kAttributes, ignored for added/removed edges
+  size_t attribute;
+  uint32_t old_value;
+  uint32_t new_value;
+};
+
+struct tile_diff_t {
+  GraphId tile_id;
+  int64_t old_node_count{0};
+  int64_t new_node_count{0};
+  int64_t old_edge_count{0};
+  int64_t new_edge_count{0};
+  uint64_t edges_added{0};
+  uint64_t edges_removed{0};
+  uint64_t edges_modified{0};
+  std::array<uint64_t, kAttributes.size()> attribute_changes{};
+
+  // only filled when drilling down
+  std::vector<edge_change_t> added;
+  std::vector<edge_change_t> removed;
+  std::vector<edge_change_t> modified;
+};
+
+struct diff_t {
+  uint64_t old_tile_count{0};
+  uint64_t new_tile_count{0};
+  uint64_t identical_count{0};
+  std::vector<GraphId> added;
+  std::vector<GraphId> removed;
+  std::vector<tile_diff_t> changed;
+
+  void operator+=(diff_t& other) {
+    old_tile_count += other.old_tile_count;
+    new_tile_count += other.new_tile_count;
+    identical_count += other.identical_count;
+    added.insert(added.end(), other.added.begin(), other.added.end());
+    removed.insert(removed.end(), other.removed.begin(),
+                   other.removed.end());
+    changed.insert(changed.end(),
+                   std::make_move_iterator(other.changed.begin()),
+                   std::make_move_iterator(other.changed.end()));
+  }
+};
+
+struct options_t {
+  bool drill_down{false};
+  size_t max_edge_changes{100};
+};
+
+/**
+ * Checksum of everything but the header, which contains the build date
+ * and dataset id that differ between any two builds.
+ */
+uint64_t body_checksum(const graph_tile_ptr& tile) {
+  const auto* begin = reinterpret_cast<const char*>(tile->header());
+  return valhalla::tools::checksum(begin + sizeof(GraphTileHeader),
+                                   tile->header()->end_offset() -
+                                       sizeof(GraphTileHeader));
+}
+
+/**
+ * Identifies an edge across builds: the OSM way it was derived from, its
+ * geometry and its direction along that geometry.
+ */
+struct edge_key_t {
+  uint64_t way_id;
+  uint64_t shape;
+  bool forward;
+  bool shortcut;
+
+  bool operator==(const edge_key_t& other) const {
+    return way_id == other.way_id && shape == other.shape &&
+           forward == other.forward && shortcut == other.shortcut;
+  }
+};
+
+struct edge_key_hash_t {
+  size_t operator()(const edge_key_t& key) const {
+    return key.way_id ^ (key.shape + (key.forward << 1) + key.shortcut);
+  }
+};
+
+edge_key_t make_key(const graph_tile_ptr& tile, const DirectedEdge* de) {
+  auto ei = tile->edgeinfo(de);
+  return {ei.wayid(), valhalla::tools::checksum(ei.encoded_shape()),
+          de->forward(), de->is_shortcut()};
+}
+
+void diff_edges(const GraphId& tile_id,
+                const graph_tile_ptr& old_tile,
+                const graph_tile_ptr& new_tile,
+                const options_t& options,
+                tile_diff_t& diff) {
+  // index the old edges, there can be duplicates so keep a list each
+  std::unordered_map<edge_key_t, std::vector<uint32_t>, edge_key_hash_t>
+      old_edges;
+  old_edges.reserve(old_tile->header()->directededgecount());
+  for (uint32_t i = 0; i < old_tile->header()->directededgecount(); ++i) {
+    old_edges[make_key(old_tile, old_tile->directededge(i))].push_back(i);
+  }
+
+  auto record = [&options](std::vector<edge_change_t>& changes,
+                           edge_change_t&& change) {
+    if (options.drill_down && changes.size() < options.max_edge_changes)
+      changes.push_back(std::move(change));
+  };
+
+  for (uint32_t i = 0; i < new_tile->header()->directededgecount(); ++i) {
+    const auto* new_de = new_tile->directededge(i);
+    auto key = make_key(new_tile, new_de);
+    GraphId new_id(tile_id.tileid(), tile_id.level(), i);
+
+    auto found = old_edges.find(key);
+    if (found == old_edges.end() || found->second.empty()) {
+      diff.edges_added++;
+      record(diff.added, {key.way_id, {}, new_id, 0, 0, 0});
+      continue;
+    }
+
+    auto old_idx = found->second.back();
+    found->second.pop_back();
+    const auto* old_de = old_tile->directededge(old_idx);
+    GraphId old_id(tile_id.tileid(), tile_id.level(), old_idx);
+
+    bool modified = false;
+    for (size_t a = 0; a < kAttributes.size(); ++a) {
+      auto old_value = kAttributes[a].second(old_de);
+      auto new_value = kAttributes[a].second(new_de);
+      if (old_value == new_value)
+        continue;
+      modified = true;
+      diff.attribute_changes[a]++;
+      record(diff.modified,
+             {key.way_id, old_id, new_id, a, old_value, new_value});
+    }
+    diff.edges_modified += modified;
+  }
+
+  // whatever is left was removed
+  for (const auto& [key, indices] : old_edges) {
+    for (auto old_idx : indices) {
+      diff.edges_removed++;
+      record(diff.removed,
+             {key.way_id, GraphId(tile_id.tileid(), tile_id.level(), old_idx),
+              {}, 0, 0, 0});
+    }
+  }
+}
+
+/**
+ * The config and extract mapping of one of the tile sets. Both sets need
+ * their own mapping, plain GraphReaders would all read the first extract
+ * the process opened.
+ */
+struct tile_set_t {
+  explicit tile_set_t(const boost::property_tree::ptree& config)
+      : mjolnir(config.get_child("mjolnir")),
+        extract(tools::extract_reader_t::map_extract(mjolnir)) {
+  }
+
+  boost::property_tree::ptree mjolnir;
+  tools::extract_reader_t::extract_ptr_t extract;
+};
+
+struct worker_t {
+  worker_t(const tile_set_t& old_set, const tile_set_t& new_set)
+      : old_reader(old_set.mjolnir, old_set.extract),
+        new_reader(new_set.mjolnir, new_set.extract) {
+  }
+
+  tools::extract_reader_t old_reader;
+  tools::extract_reader_t new_reader;
+  diff_t diff;
+};
+
+void diff_tile(worker_t& worker,
+               const GraphId& tile_id,
+               const options_t& options) {
+  auto& old_reader = worker.old_reader;
+  auto& new_reader = worker.new_reader;
+  auto& diff = worker.diff;
+
+  // Trim readers if over-committed
+  if (old_reader.OverCommitted())
+    old_reader.Trim();
+  if (new_reader.OverCommitted())
+    new_reader.Trim();
+
+  graph_tile_ptr old_tile, new_tile;
+  {
+    trace::span_t span("load", "io", "tile_id", tile_id.value);
+    if (old_reader.DoesTileExist(tile_id))
+      old_tile = old_reader.GetGraphTile(tile_id);
+    if (new_reader.DoesTileExist(tile_id))
+      new_tile = new_reader.GetGraphTile(tile_id);
+  }
+  trace::span_t span("diff", "tile", "tile_id", tile_id.value);
+  diff.old_tile_count += old_tile != nullptr;
+  diff.new_tile_count += new_tile != nullptr;
+
+  if (!old_tile && !new_tile) {
+    LOG_WARN("Unable to load tile " + std::to_string(tile_id));
+    return;
+  }
+
+  if (!old_tile) {
+    diff.added.push_back(tile_id);
+    return;
+  }
+
+  if (!new_tile) {
+    diff.removed.push_back(tile_id);
+    return;
+  }
+
+  if (old_tile->header()->end_offset() ==
+          new_tile->header()->end_offset() &&
+      body_checksum(old_tile) == body_checksum(new_tile)) {
+    diff.identical_count++;
+    return;
+  }
+
+  tile_diff_t tile_diff{tile_id};
+  tile_diff.old_node_count = old_tile->header()->nodecount();
+  tile_diff.new_node_count = new_tile->header()->nodecount();
+  tile_diff.old_edge_count = old_tile->header()->directededgecount();
+  tile_diff.new_edge_count = new_tile->header()->directededgecount();
+  diff_edges(tile_id, old_tile, new_tile, options, tile_diff);
+  diff.changed.push_back(std::move(tile_diff));
+}
+
+void serialize_change(rapidjson::writer_wrapper_t& writer,
+                      const edge_change_t& change,
+                      bool with_attribute) {
+  writer.start_object();
+  writer("way_id", change.way_id);
+  if (change.old_id.Is_Valid())
+    writer("old_edge_id", std::to_string(change.old_id));
+  if (change.new_id.Is_Valid())
+    writer("new_edge_id", std::to_string(change.new_id));
+  if (with_attribute) {
+    writer("attribute", std::string(kAttributes[change.attribute].first));
+    writer("old", static_cast<uint64_t>(change.old_value));
+    writer("new", static_cast<uint64_t>(change.new_value));
+  }
+  writer.end_object();
+}
+
+void write_json(std::ostream& out, diff_t& diff, const options_t& options) {
+  auto by_id = [](const auto& a, const auto& b) { return a < b; };
+  std::sort(diff.added.begin(), diff.added.end(), by_id);
+  std::sort(diff.removed.begin(), diff.removed.end(), by_id);
+  std::sort(diff.changed.begin(), diff.changed.end(),
+            [](const tile_diff_t& a, const tile_diff_t& b) {
+              return a.tile_id < b.tile_id;
+            });
+
+  tile_diff_t total;
+  for (const auto& t : diff.changed) {
+    total.old_node_count += t.old_node_count;
+    total.new_node_count += t.new_node_count;
+    total.old_edge_count += t.old_edge_count;
+    total.new_edge_count += t.new_edge_count;
+    total.edges_added += t.edges_added;
+    total.edges_removed += t.edges_removed;
+    total.edges_modified += t.edges_modified;
+    for (size_t a = 0; a < kAttributes.size(); ++a)
+      total.attribute_changes[a] += t.attribute_changes[a];
+  }
+
+  rapidjson::writer_wrapper_t writer(1 << 16);
+  writer.start_object();
+
+  writer.start_object("tiles");
+  writer("old", diff.old_tile_count);
+  writer("new", diff.new_tile_count);
+  writer("identical", diff.identical_count);
+  writer("changed", static_cast<uint64_t>(diff.changed.size()));
+  writer.start_array("added");
+  for (const auto& id : diff.added)
+    writer(std::to_string(id));
+  writer.end_array();
+  writer.start_array("removed");
+  for (const auto& id : diff.removed)
+    writer(std::to_string(id));
+  writer.end_array();
+  writer.end_object();
+
+  // totals over the changed tiles only
+  writer.start_object("nodes");
+  writer("old", total.old_node_count);
+  writer("new", total.new_node_count);
+  writer.end_object();
+  writer.start_object("edges");
+  writer("old", total.old_edge_count);
+  writer("new", total.new_edge_count);
+  writer("added", total.edges_added);
+  writer("removed", total.edges_removed);
+  writer("modified", total.edges_modified);
+  writer.end_object();
+  writer.start_object("attributes");
+  for (size_t a = 0; a < kAttributes.size(); ++a)
+    writer(kAttributes[a].first, total.attribute_changes[a]);
+  writer.end_object();
+
+  writer.start_array("changed_tiles");
+  for (const auto& t : diff.changed) {
+    writer.start_object();
+    writer("tile_id", std::to_string(t.tile_id));
+    writer("node_delta", t.new_node_count - t.old_node_count);
+    writer("edge_delta", t.new_edge_count - t.old_edge_count);
+    writer("edges_added", t.edges_added);
+    writer("edges_removed", t.edges_removed);
+    writer("edges_modified", t.edges_modified);
+    if (options.drill_down) {
+      writer.start_array("added");
+      for (const auto& c : t.added)
+        serialize_change(writer, c, false);
+      writer.end_array();
+      writer.start_array("removed");
+      for (const auto& c : t.removed)
+        serialize_change(writer, c, false);
+      writer.end_array();
+      writer.start_array("modified");
+      for (const auto& c : t.modified)
+        serialize_change(writer, c, true);
+      writer.end_array();
+    }
+    writer.end_object();
+  }
+  writer.end_array();
+
+  writer.end_object();
+  out << writer.get_buffer() << "\n";
+}
+
+void tile_diff(const boost::property_tree::ptree& old_config,
+               const boost::property_tree::ptree& new_config,
+               const options_t& options,
+               const std::string& output) {
+  std::vector<GraphId> tiles;
+  tile_set_t old_set(old_config);
+  tile_set_t new_set(new_config);
+
+  // pair up the tiles of both sets
+  {
+    tools::extract_reader_t old_reader(old_set.mjolnir, old_set.extract);
+    tools::extract_reader_t new_reader(new_set.mjolnir, new_set.extract);
+    std::unordered_set<GraphId> tile_set = old_reader.GetTileSet();
+    for (const auto& tile : new_reader.GetTileSet())
+      tile_set.insert(tile);
+    tiles.assign(tile_set.begin(), tile_set.end());
+  }
+  // most tiles are in both sets, the new ones are what takes the time
+  auto shard = tools::shard_t::from_config(old_config);
+  shard.select(new_config, tiles);
+
+  std::shuffle(tiles.begin(), tiles.end(), std::mt19937(0));
+
+  tools::executor_t executor(
+      tools::executor_options_t::from_config(old_config));
+  tools::per_worker_t<worker_t> workers(executor, [&]() {
+    return new worker_t(old_set, new_set);
+  });
+  executor.for_each(
+      tiles.size(),
+      [&](size_t worker, size_t i) {
+        diff_tile(workers[worker], tiles[i], options);
+      },
+      "Diffing tiles");
+
+  diff_t diff;
+  workers.for_each([&](worker_t& worker) { diff += worker.diff; });
+
+  LOG_INFO("Finished tile diff");
+  LOG_INFO("Identical tiles: " + std::to_string(diff.identical_count));
+  LOG_INFO("Changed tiles: " + std::to_string(diff.changed.size()));
+  LOG_INFO("Added tiles: " + std::to_string(diff.added.size()));
+  LOG_INFO("Removed tiles: " + std::to_string(diff.removed.size()));
+
+  if (output.empty() || output == "-") {
+    write_json(std::cout, diff, options);
+  } else {
+    std::ofstream file(output);
+    if (!file)
+      throw std::runtime_error("Unable to open " + output);
+    write_json(file, diff, options);
+    if (!file.flush())
+      throw std::runtime_error("Unable to write " + output);
+  }
+  shard.mark_done();
+}
+
+/**
+ * Reads a config from a file or inline json. valhalla::config() can't be
+ * used for a second config, it keeps returning the first one it read.
+ */
+boost::property_tree::ptree read_config(const std::string& config) {
+  boost::property_tree::ptree pt;
+  if (filesystem::is_regular_file(config)) {
+    rapidjson::read_json(config, pt);
+  } else {
+    std::stringstream json(config);
+    rapidjson::read_json(json, pt);
+  }
+  return pt;
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  const auto program = filesystem::path(__FILE__).stem().string();
+  boost::property_tree::ptree old_config;
+  boost::property_tree::ptree new_config;
+  std::string output;
+  std::string trace_path;
+  options_t diff_options;
+
+  try {
+    cxxopts::Options
+        options(program,
+                "compares two valhalla tile sets and summarizes what "
+                "changed as JSON.\n");
+
+    // clang-format off
+    options.add_options()
+    ("h,help", "Print this help message.")
+    ("j,concurrency", "Number of threads to use.", cxxopts::value<unsigned int>())
+    ("c,config", "Path to the json configuration file of the old tile set.", cxxopts::value<std::string>())
+    ("i,inline-config", "Inline json config of the old tile set.",cxxopts::value<std::string>())
+    ("n,new-config", "Path to (or inline) json configuration of the new tile set.", cxxopts::value<std::string>())
+    ("o,output", "File to write the JSON summary to, defaults to stdout.", cxxopts::value<std::string>(output))
+    ("D,drill-down", "Include the added, removed and modified edges of every changed tile.", cxxopts::value<bool>(diff_options.drill_down))
+    ("m,max-edge-changes", "Maximum number of edge changes listed per tile and kind when drilling down.", cxxopts::value<size_t>(diff_options.max_edge_changes)->default_value("100"))
+    ("shard", "Only process shard i/n of the tiles (0 <= i < n), split by tile size. Writes shard-<i>-of-<n>.done once finished.", cxxopts::value<std::string>())
+    ("shard-marker-dir", "Where to write the shard's completion marker, defaults to the working directory.", cxxopts::value<std::string>())
+    ("trace", "Write a Chrome trace of the run to this file, it can be opened in Perfetto.", cxxopts::value<std::string>(trace_path));
+    // clang-format on
+
+    auto result = options.parse(argc, argv);
+    options.custom_help("");
+    if (!parse_common_args(program, options, result, old_config,
+                           "mjolnir.logging", true))
+      return EXIT_SUCCESS;
+
+    if (!result.count("new-config"))
+      throw cxxopts::exceptions::missing_argument("new-config");
+    new_config = read_config(result["new-config"].as<std::string>());
+
+    if (result.count("shard"))
+      old_config.put("mjolnir.shard", result["shard"].as<std::string>());
+    if (result.count("shard-marker-dir"))
+      old_config.put("mjolnir.shard_marker_dir",
+                     result["shard-marker-dir"].as<std::string>());
+    valhalla::tools::shard_t::from_config(old_config);
+
+  } catch (cxxopts::exceptions::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  } catch (std::exception& e) {
+    std::cerr << "Unable to parse command line options because: "
+              << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  trace::session_t trace_session(trace_path);
+  try {
+    tile_diff(old_config, new_config, diff_options, output);
+  } catch (std::exception& e) {
+    LOG_ERROR("Failed to diff tile sets: " + std::string(e.what()));
+    return EXIT_FAILURE;
+  }
+}
@@ -1,136 +1,23 @@
-#include <algorithm>
-#include <boost/property_tree/ptree_fwd.hpp>
+#include <thread>
+
+#include <boost/property_tree/ptree.hpp>
 #include <cxxopts.hpp>
-#include <valhalla/baldr/graphid.h>
-#include <valhalla/baldr/graphreader.h>
 
 #include "argparse_utils.h"
-#include <future>
-#include <random>
-
-namespace {
-using namespace valhalla::baldr;
-
-class PublicGraphtile : public GraphTile {
-public:
-  uint32_t complex_restriction_count() const {
-    return complex_restriction_forward_size_ +
-           complex_restriction_reverse_size_;
-  }
-};
-
-struct stats_t {
-  uint32_t node_count{0};
-  uint32_t directededge_count{0};
-  uint32_t shortcut_count{0};
-  uint32_t acceessrestriction_count{0};
-  uint32_t complexrestriction_count{0};
-
-  void operator+=(const stats_t& other) {
-    node_count += other.node_count;
-    directededge_count += other.directededge_count;
-    shortcut_count += other.shortcut_count;
-    acceessrestriction_count += other.acceessrestriction_count;
-    complexrestriction_count += other.complexrestriction_count;
-  }
-};
-
-void work(std::mutex& lock,
-          std::deque<GraphId>& tiles,
-          boost::property_tree::ptree& config,
-          std::promise<stats_t>& stat) {
-  // go through the tiles, peak into each header, update the count and set
-  // the results
-
-  GraphReader reader(config.get_child("mjolnir"));
-  stats_t stats;
-  while (true) {
-    GraphId tile_id;
-    {
-      std::lock_guard l(lock);
-      if (tiles.empty()) {
-        break;
-      }
-
-      tile_id = tiles.back();
-      tiles.pop_back();
-    }
-
-    auto tile = reader.GetGraphTile(tile_id);
-
-    if (!tile) {
-      continue;
-    }
-
-    auto header = tile->header();
-    stats.node_count += header->nodecount();
-    stats.directededge_count += header->directededgecount();
-    stats.acceessrestriction_count += header->access_restriction_count();
-    auto public_tile = static_cast<const PublicGraphtile*>(tile.get());
-    stats.complexrestriction_count +=
-        public_tile->complex_restriction_count();
-
-    GraphId edgeid = tile_id;
-    for (size_t i = 0; i < header->directededgecount(); ++i, ++edgeid) {
-      auto* de = tile->directededge(i);
-      stats.shortcut_count += de->is_shortcut();
-    }
-  }
-
-  stat.set_value(stats);
-}
-
-void tile_stats(boost::property_tree::ptree& config) {
-  std::list<std::promise<stats_t>> results;
-  std::deque<GraphId> tiles;
+#include "shard.h"
+#include "tile_stats.h"
+#include "trace.h"
 
-  GraphReader reader(config.get_child("mjolnir"));
-
-  for (const auto& tile : reader.GetTileSet()) {
-    tiles.push_back(tile);
-  }
-
-  std::shuffle(tiles.begin(), tiles.end(), std::mt19937(0));
-
-  std::vector<std::shared_ptr<std::thread>> threads(
-      std::max(static_cast<unsigned int>(1),
-               config.get<
-                   unsigned int>("mjolnir.concurrency",
-                                 std::thread::hardware_concurrency())));
-
-  std::mutex lock;
-  for (auto& thread : threads) {
-    auto& s = results.emplace_back();
-    thread = std::make_shared<std::thread>(work, std::ref(lock),
-                                           std::ref(tiles),
-                                           std::ref(config), std::ref(s));
-  }
-
-  for (auto& thread : threads) {
-    thread->join();
-  }
-
-  stats_t stats;
-
-  for (auto& result : results) {
-    stats += result.get_future().get();
-  }
-
-  LOG_INFO("Finished tile stats");
-  LOG_INFO("Node count: " + std::to_string(stats.node_count));
-  LOG_INFO("Directededge count: " +
-           std::to_string(stats.directededge_count));
-  LOG_INFO("Shortcut count: " + std::to_string(stats.shortcut_count));
-  LOG_INFO("Access restriction count: " +
-           std::to_string(stats.acceessrestriction_count));
-  LOG_INFO("Complex restriction count: " +
-           std::to_string(stats.complexrestriction_count));
-}
-} // namespace
+using namespace valhalla::tools;
 
 int main(int argc, char** argv) {
   const auto program = filesystem::path(__FILE__).stem().string();
   boost::property_tree::ptree pt;
+  std::string output;
+  std::string format;
+  std::string per_tile_output;
+  std::string trace_path;
+  tile_stats_options_t stats_options;
 
   try {
     cxxopts::Options
@@ -142,7 +29,16 @@ int main(int argc, char** argv) {
     ("h,help", "Print this help message.")
     ("j,concurrency", "Number of threads to use.", cxxopts::value<unsigned int>())
     ("c,config", "Path to the json configuration file.", cxxopts::value<std::string>())
-    ("i,inline-config", "Inline json config.",cxxopts::value<std::string>());
+    ("i,inline-config", "Inline json config.",cxxopts::value<std::string>())
+    ("prefetch-depth", "Number of tiles per thread to load ahead of time, 0 turns it off. Overrides mjolnir.prefetch_depth, defaults to 4.", cxxopts::value<unsigned int>())
+    ("o,output", "Write per level statistics and histograms to this file, - for stdout.", cxxopts::value<std::string>(output))
+    ("f,format", "Output format of --output, json or csv.", cxxopts::value<std::string>(format)->default_value("json"))
+    ("t,per-tile", "Write the counts and histograms of every tile to this file, in the long CSV format of --output.", cxxopts::value<std::string>(per_tile_output))
+    ("s,sections", "Only read the tile headers and report the bytes per tile section instead of the edge histograms.", cxxopts::value<bool>(stats_options.sections))
+    ("n,top", "Number of largest tiles to report with --sections.", cxxopts::value<size_t>(stats_options.top_n)->default_value("10"))
+    ("shard", "Only process shard i/n of the tiles (0 <= i < n), split by tile size. Writes shard-<i>-of-<n>.done once finished.", cxxopts::value<std::string>())
+    ("shard-marker-dir", "Where to write the shard's completion marker, defaults to the working directory.", cxxopts::value<std::string>())
+    ("trace", "Write a Chrome trace of the run to this file, it can be opened in Perfetto.", cxxopts::value<std::string>(trace_path));
     // clang-format on
 
     auto result = options.parse(argc, argv);
@@ -151,6 +47,23 @@ int main(int argc, char** argv) {
                            true))
       return EXIT_SUCCESS;
 
+    if (result.count("prefetch-depth"))
+      pt.put("mjolnir.prefetch_depth",
+             result["prefetch-depth"].as<unsigned int>());
+
+    if (result.count("shard"))
+      pt.put("mjolnir.shard", result["shard"].as<std::string>());
+    if (result.count("shard-marker-dir"))
+      pt.put("mjolnir.shard_marker_dir",
+             result["shard-marker-dir"].as<std::string>());
+    shard_t::from_config(pt);
+
+    stats_options.per_tile = !per_tile_output.empty();
+
+    if (format != "json" && format != "csv")
+      throw cxxopts::exceptions::exception("Unknown output format: " +
+                                           format);
+
   } catch (cxxopts::exceptions::exception& e) {
     std::cerr << e.what() << std::endl;
     return EXIT_FAILURE;
@@ -160,9 +73,12 @@ int main(int argc, char** argv) {
     return EXIT_FAILURE;
   }
 
+  trace::session_t trace_session(trace_path);
   try {
-    tile_stats(pt);
+    tile_stats(pt, stats_options, output, format, per_tile_output);
   } catch (std::exception& e) {
     LOG_ERROR("Failed to create tileset stats: " + std::string(e.what()));
+    return EXIT_FAILURE;
   }
+  return EXIT_SUCCESS;
 }
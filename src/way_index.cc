@@ -0,0 +1,217 @@
+#include "way_index.h"
+#include "executor.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <valhalla/baldr/graphreader.h>
+#include <valhalla/midgard/logging.h>
+
+namespace {
+using namespace valhalla;
+namespace trace = valhalla::tools::trace;
+
+constexpr char kMagic[8] = {'V', 'T', 'W', 'A', 'Y', 'I', 'D', 'X'};
+constexpr uint32_t kVersion = 1;
+
+// way id, directed edge id
+using pair_t = std::pair<uint64_t, uint64_t>;
+
+struct worker_t {
+  explicit worker_t(const boost::property_tree::ptree& config)
+      : reader(config.get_child("mjolnir")) {
+  }
+
+  baldr::GraphReader reader;
+  std::vector<pair_t> pairs;
+};
+
+void collect_pairs(worker_t& worker, const baldr::GraphId& tile_id) {
+  auto& reader = worker.reader;
+  if (reader.OverCommitted())
+    reader.Trim();
+
+  baldr::graph_tile_ptr tile;
+  {
+    trace::span_t span("load", "io", "tile_id", tile_id.value);
+    tile = reader.GetGraphTile(tile_id);
+  }
+  if (!tile)
+    return;
+
+  trace::span_t span("scan", "tile", "tile_id", tile_id.value);
+  auto count = tile->header()->directededgecount();
+  for (uint32_t e = 0; e < count; ++e) {
+    const auto* de = tile->directededge(e);
+    if (de->is_shortcut())
+      continue;
+    auto way_id = tile->edgeinfo(de).wayid();
+    if (!way_id)
+      continue;
+    worker.pairs.emplace_back(
+        way_id, baldr::GraphId(tile_id.tileid(), tile_id.level(), e).value);
+  }
+}
+
+/**
+ * Sorts the per worker pairs and merges them pairwise, the result ends up
+ * in the first element.
+ */
+void sort_pairs(tools::executor_t& executor,
+                std::vector<std::vector<pair_t>>& parts) {
+  trace::span_t span("sort", "phase");
+  executor.for_each(parts.size(), [&](size_t, size_t i) {
+    std::sort(parts[i].begin(), parts[i].end());
+  });
+  for (size_t stride = 1; stride < parts.size(); stride *= 2) {
+    auto merges = (parts.size() + stride - 1) / (2 * stride);
+    executor.for_each(merges, [&](size_t, size_t merge) {
+      auto& a = parts[merge * 2 * stride];
+      auto& b = parts[merge * 2 * stride + stride];
+      std::vector<pair_t> merged;
+      merged.reserve(a.size() + b.size());
+      std::merge(a.begin(), a.end(), b.begin(), b.end(),
+                 std::back_inserter(merged));
+      a.swap(merged);
+      b = {};
+    });
+  }
+}
+
+uint64_t write_index(const std::vector<pair_t>& pairs,
+                     const std::string& path) {
+  trace::span_t span("write", "io");
+  tools::way_index_header_t header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.edge_count = pairs.size();
+  for (size_t i = 0; i < pairs.size(); ++i)
+    header.way_count += i == 0 || pairs[i].first != pairs[i - 1].first;
+
+  // readers never see a half written index
+  auto tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary);
+    if (!out)
+      throw std::runtime_error("Unable to open " + tmp);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (size_t i = 0; i < pairs.size(); ++i) {
+      if (i > 0 && pairs[i].first == pairs[i - 1].first)
+        continue;
+      tools::way_index_entry_t entry{pairs[i].first, i};
+      out.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+    }
+    for (const auto& pair : pairs)
+      out.write(reinterpret_cast<const char*>(&pair.second),
+                sizeof(pair.second));
+    if (!out)
+      throw std::runtime_error("Unable to write " + tmp);
+  }
+  std::filesystem::rename(tmp, path);
+  return header.way_count;
+}
+
+} // namespace
+
+namespace valhalla {
+
+namespace tools {
+
+uint64_t build_way_index(const boost::property_tree::ptree& config,
+                         const std::string& path) {
+  std::vector<baldr::GraphId> tiles;
+  {
+    baldr::GraphReader reader(config.get_child("mjolnir"));
+    auto tile_set = reader.GetTileSet();
+    tiles.assign(tile_set.begin(), tile_set.end());
+  }
+  std::sort(tiles.begin(), tiles.end());
+
+  executor_t executor(executor_options_t::from_config(config));
+  std::vector<std::vector<pair_t>> parts;
+  {
+    per_worker_t<worker_t> workers(executor,
+                                   [&]() { return new worker_t(config); });
+    executor.for_each(
+        tiles.size(),
+        [&](size_t worker, size_t i) {
+          collect_pairs(workers[worker], tiles[i]);
+        },
+        "Scanning edges");
+    workers.for_each(
+        [&](worker_t& worker) { parts.push_back(std::move(worker.pairs)); });
+  }
+  if (parts.empty())
+    parts.emplace_back();
+
+  sort_pairs(executor, parts);
+  const auto& pairs = parts.front();
+  auto ways = write_index(pairs, path);
+  LOG_INFO("Wrote " + std::to_string(ways) + " ways with " +
+           std::to_string(pairs.size()) + " edges to " + path);
+  return ways;
+}
+
+way_index_t::way_index_t(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("Unable to open way index " + path);
+  struct stat st;
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(way_index_header_t)) {
+    ::close(fd);
+    throw std::runtime_error("Not a way index: " + path);
+  }
+  size_ = st.st_size;
+  data_ = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data_ == MAP_FAILED) {
+    data_ = nullptr;
+    throw std::runtime_error("Unable to map way index " + path);
+  }
+
+  header_ = static_cast<const way_index_header_t*>(data_);
+  auto expected = sizeof(way_index_header_t) +
+                  header_->way_count * sizeof(way_index_entry_t) +
+                  header_->edge_count * sizeof(uint64_t);
+  if (std::memcmp(header_->magic, kMagic, sizeof(kMagic)) != 0 ||
+      header_->version != kVersion || expected != size_) {
+    ::munmap(data_, size_);
+    data_ = nullptr;
+    throw std::runtime_error("Not a valid way index: " + path);
+  }
+  ways_ = reinterpret_cast<const way_index_entry_t*>(header_ + 1);
+  edges_ = reinterpret_cast<const uint64_t*>(ways_ + header_->way_count);
+}
+
+way_index_t::~way_index_t() {
+  if (data_)
+    ::munmap(data_, size_);
+}
+
+std::vector<baldr::GraphId> way_index_t::find(uint64_t way_id) const {
+  auto end = ways_ + header_->way_count;
+  auto found = std::lower_bound(ways_, end, way_id,
+                                [](const way_index_entry_t& entry,
+                                   uint64_t id) { return entry.way_id < id; });
+  if (found == end || found->way_id != way_id)
+    return {};
+
+  auto last = found + 1 == end ? header_->edge_count : (found + 1)->first_edge;
+  std::vector<baldr::GraphId> edges;
+  edges.reserve(last - found->first_edge);
+  for (auto e = found->first_edge; e < last; ++e)
+    edges.emplace_back(edges_[e]);
+  return edges;
+}
+
+} // namespace tools
+} // namespace valhalla
@@ -0,0 +1,87 @@
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "tile_cover.h"
+
+/**
+ * Parses the line inputs of valhalla_get_tile_ids in all formats, including
+ * an encoded polyline starting with { and malformed GeoJSON.
+ */
+
+namespace {
+namespace tools = valhalla::tools;
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+  if (!ok) {
+    std::cerr << "FAILED: " << what << "\n";
+    failures++;
+  }
+}
+
+bool near(const valhalla::midgard::PointLL& p, double lng, double lat) {
+  return std::abs(p.lng() - lng) < 1e-6 && std::abs(p.lat() - lat) < 1e-6;
+}
+
+/**
+ * The 2 points line every input below encodes.
+ */
+void check_line(const std::vector<tools::linestring_t>& lines,
+                const std::string& what) {
+  check(lines.size() == 1 && lines.front().size() == 2 &&
+            near(lines.front()[0], 13.4, 52.500014) &&
+            near(lines.front()[1], 13.41, 52.510014),
+        what);
+}
+
+void check_throws(const std::function<void()>& f, const std::string& what) {
+  try {
+    f();
+  } catch (const std::runtime_error&) {
+    return;
+  }
+  check(false, what);
+}
+} // namespace
+
+int main() {
+  check_line(tools::parse_linestrings("{ajccB_{zpX_pR_pR"),
+             "polyline starting with {");
+  check_line(tools::parse_linestrings(
+                 "{\"type\":\"LineString\",\"coordinates\":"
+                 "[[13.4,52.500014],[13.41,52.510014]]}"),
+             "GeoJSON LineString");
+  check_line(tools::parse_linestrings(
+                 "lon,lat\n13.4,52.500014\n13.41,52.510014\n"),
+             "CSV with a header");
+
+  check_throws(
+      [] {
+        tools::parse_linestrings(
+            "{\"type\":\"LineString\",\"coordinates\":{}}");
+      },
+      "LineString without coordinates array");
+  check_throws(
+      [] {
+        tools::parse_linestrings(
+            "{\"type\":\"LineString\",\"coordinates\":[[13.4,\"x\"]]}");
+      },
+      "coordinate that isn't a number");
+  check_throws(
+      [] { tools::parse_linestrings("{\"type\":1}"); },
+      "type that isn't a string");
+  check_throws(
+      [] {
+        tools::parse_regions("{\"type\":\"FeatureCollection\","
+                             "\"features\":[1]}");
+      },
+      "feature that isn't an object");
+
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,220 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <valhalla/baldr/directededge.h>
+#include <valhalla/baldr/graphconstants.h>
+#include <valhalla/baldr/graphid.h>
+#include <valhalla/baldr/nodeinfo.h>
+#include <valhalla/baldr/tilehierarchy.h>
+#include <valhalla/midgard/pointll.h>
+#include <valhalla/mjolnir/graphtilebuilder.h>
+
+#include "tile_extract.h"
+
+/**
+ * Diffs two tile extracts that differ in one tile's speeds and in an added
+ * tile with valhalla_tile_diff, whose path is the only argument.
+ */
+
+namespace {
+namespace baldr = valhalla::baldr;
+namespace midgard = valhalla::midgard;
+namespace mjolnir = valhalla::mjolnir;
+namespace tools = valhalla::tools;
+namespace fs = std::filesystem;
+
+constexpr uint32_t kLevel = 2;
+constexpr uint32_t kNodesPerSide = 4;
+const midgard::PointLL kOrigin{13.4, 52.5};
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+  if (!ok) {
+    std::cerr << "FAILED: " << what << "\n";
+    failures++;
+  }
+}
+
+baldr::GraphId tile_id(uint32_t col) {
+  const auto& tiles = baldr::TileHierarchy::levels()[kLevel].tiles;
+  midgard::PointLL ll(kOrigin.lng() + col * tiles.TileSize(),
+                      kOrigin.lat());
+  return baldr::GraphId(tiles.TileId(ll), kLevel, 0);
+}
+
+/**
+ * A grid of nodes connected to their right and upper neighbours, all
+ * edges with the given speed.
+ */
+void build_tile(const fs::path& tile_dir,
+                const baldr::GraphId& id,
+                uint32_t speed) {
+  const auto& tiles = baldr::TileHierarchy::levels()[kLevel].tiles;
+  auto base = tiles.Base(id.tileid());
+  auto spacing = tiles.TileSize() / kNodesPerSide;
+  auto node_ll = [&](uint32_t x, uint32_t y) {
+    return midgard::PointLL(base.lng() + (x + 0.5) * spacing,
+                            base.lat() + (y + 0.5) * spacing);
+  };
+
+  mjolnir::GraphTileBuilder builder(tile_dir.string(), id, false);
+  builder.header_builder().set_base_ll(base);
+  auto& nodes = builder.nodes();
+  auto& edges = builder.directededges();
+  for (uint32_t y = 0; y < kNodesPerSide; ++y) {
+    for (uint32_t x = 0; x < kNodesPerSide; ++x) {
+      baldr::GraphId start(id.tileid(), kLevel, y * kNodesPerSide + x);
+      baldr::NodeInfo node;
+      node.set_latlng(base, node_ll(x, y));
+      node.set_access(baldr::kAllAccess);
+      node.set_type(baldr::NodeType::kStreetIntersection);
+      node.set_edge_index(edges.size());
+
+      uint32_t count = 0;
+      for (auto [nx, ny] : {std::pair{x + 1, y}, std::pair{x, y + 1}}) {
+        if (nx >= kNodesPerSide || ny >= kNodesPerSide)
+          continue;
+        baldr::GraphId end(id.tileid(), kLevel, ny * kNodesPerSide + nx);
+        std::list<midgard::PointLL> shape{node_ll(x, y), node_ll(nx, ny)};
+
+        baldr::DirectedEdge edge;
+        edge.set_endnode(end);
+        edge.set_length(shape.front().Distance(shape.back()));
+        edge.set_classification(baldr::RoadClass::kResidential);
+        edge.set_use(baldr::Use::kRoad);
+        edge.set_speed(speed);
+        edge.set_forwardaccess(baldr::kAllAccess);
+        edge.set_reverseaccess(baldr::kAllAccess);
+        edge.set_forward(true);
+        edge.set_localedgeidx(count);
+
+        bool added = false;
+        auto offset = builder.AddEdgeInfo(
+            edges.size(), start, end, edges.size(), 0.f, 0, speed, shape,
+            {"Synthetic Street"}, {}, {}, 0, added);
+        edge.set_edgeinfo_offset(offset);
+        edges.emplace_back(std::move(edge));
+        count++;
+      }
+      node.set_edge_count(count);
+      nodes.emplace_back(std::move(node));
+    }
+  }
+  builder.StoreTileData();
+}
+
+/**
+ * Packs a tile dir into an extract with an index, like valhalla_build_tar
+ */
+void build_extract(const fs::path& tile_dir, const fs::path& tar) {
+  std::vector<tools::tile_index_entry_t> entries;
+  std::vector<fs::path> paths;
+  for (const auto& file : fs::recursive_directory_iterator(tile_dir)) {
+    uint32_t id;
+    if (!file.is_regular_file() ||
+        !tools::tile_id_from_path(
+            fs::relative(file.path(), tile_dir).string(), id))
+      continue;
+    entries.push_back(
+        {0, id, static_cast<uint32_t>(fs::file_size(file.path()))});
+    paths.push_back(file.path());
+  }
+
+  auto total_size = tools::layout_extract(entries);
+  int fd = ::open(tar.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  tools::write_extract_skeleton(fd, entries, total_size);
+  for (size_t i = 0; i < entries.size(); ++i) {
+    std::ifstream in(paths[i], std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)),
+                      std::istreambuf_iterator<char>());
+    tools::write_at(fd, bytes.data(), bytes.size(), entries[i].offset);
+  }
+  ::close(fd);
+}
+
+fs::path write_config(const fs::path& root, const std::string& name) {
+  boost::property_tree::ptree config;
+  config.put("mjolnir.tile_extract", (root / (name + ".tar")).string());
+  // nothing to fall back to, the tiles have to come from the extract
+  config.put("mjolnir.tile_dir", (root / "missing").string());
+  config.put("mjolnir.concurrency", 2);
+  auto path = root / (name + ".json");
+  boost::property_tree::write_json(path.string(), config);
+  return path;
+}
+
+boost::property_tree::ptree diff(const std::string& tool,
+                                 const fs::path& root,
+                                 const std::string& old_name,
+                                 const std::string& new_name) {
+  auto output = root / (old_name + "-" + new_name + ".json");
+  auto command = tool + " -c " + (root / (old_name + ".json")).string() +
+                 " -n " + (root / (new_name + ".json")).string() +
+                 " -o " + output.string();
+  boost::property_tree::ptree result;
+  if (std::system(command.c_str()) != 0) {
+    check(false, command);
+    return result;
+  }
+  boost::property_tree::read_json(output.string(), result);
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " <valhalla_tile_diff>\n";
+    return EXIT_FAILURE;
+  }
+
+  auto root = fs::temp_directory_path() /
+              ("valhalla_tile_diff_test_" + std::to_string(getpid()));
+  fs::create_directories(root);
+
+  // the new build changes the speeds of one tile and adds another
+  build_tile(root / "old", tile_id(0), 50);
+  build_tile(root / "old", tile_id(1), 50);
+  build_tile(root / "new", tile_id(0), 60);
+  build_tile(root / "new", tile_id(1), 50);
+  build_tile(root / "new", tile_id(2), 50);
+  build_extract(root / "old", root / "old.tar");
+  build_extract(root / "new", root / "new.tar");
+  write_config(root, "old");
+  write_config(root, "new");
+
+  auto changes = diff(argv[1], root, "old", "new");
+  check(changes.get<uint64_t>("tiles.old", 0) == 2, "2 old tiles");
+  check(changes.get<uint64_t>("tiles.new", 0) == 3, "3 new tiles");
+  check(changes.get<uint64_t>("tiles.identical", 0) == 1,
+        "1 identical tile");
+  check(changes.get<uint64_t>("tiles.changed", 0) == 1, "1 changed tile");
+  check(changes.get_child("tiles.added", {}).size() == 1, "1 added tile");
+  // 2 edges per node but the ones on the upper and right border
+  auto edges = 2 * kNodesPerSide * (kNodesPerSide - 1);
+  check(changes.get<uint64_t>("edges.modified", 0) == edges,
+        "all edges of the changed tile modified");
+  check(changes.get<uint64_t>("attributes.speed", 0) == edges,
+        "all speeds changed");
+
+  auto same = diff(argv[1], root, "old", "old");
+  check(same.get<uint64_t>("tiles.identical", 0) == 2,
+        "2 identical tiles with itself");
+  check(same.get<uint64_t>("tiles.changed", 1) == 0,
+        "no changed tiles with itself");
+
+  fs::remove_all(root);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}